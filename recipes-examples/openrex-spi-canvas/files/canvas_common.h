@@ -48,13 +48,158 @@
 #define CANVAS_CMD_CIRCLE               (0x04)
 #define CANVAS_CMD_GETCOLOR             (0x05)
 #define CANVAS_CMD_FLUSH_DRAWING        (0x06)
+#define CANVAS_CMD_GETCAPS              (0x07)
+#define CANVAS_CMD_TAGGED               (0x08)
+#define CANVAS_CMD_GETSTATS             (0x0A)
+#define CANVAS_CMD_LAYER_CONFIG         (0x0B)
+#define CANVAS_CMD_LAYER_SELECT         (0x0C)
+#define CANVAS_CMD_COPY_AREA            (0x0D)
+#define CANVAS_CMD_CHART_CONFIG         (0x0E)
+#define CANVAS_CMD_CHART_PUSH           (0x0F)
+#define CANVAS_CMD_PUT_PIXELS           (0x10)
+#define CANVAS_CMD_SET_PALETTE          (0x11)
+#define CANVAS_CMD_PUT_INDEXED          (0x12)
+#define CANVAS_CMD_PUT_IMAGE            (0x13)
+#define CANVAS_CMD_DRAW_ASSET           (0x14)
+#define CANVAS_CMD_ASSET_PALETTE        (0x15)
+#define CANVAS_CMD_SCENE_CONFIG         (0x16)
+#define CANVAS_CMD_SCENE_CREATE         (0x17)
+#define CANVAS_CMD_SCENE_UPDATE         (0x18)
+#define CANVAS_CMD_SCENE_TEXT           (0x19)
+#define CANVAS_CMD_SCENE_DELETE         (0x1A)
+#define CANVAS_CMD_ANIMATE              (0x1B)
+#define CANVAS_CMD_RECT_BATCH           (0x1C)
+#define CANVAS_CMD_CIRCLE_BATCH         (0x1D)
 #define CANVAS_CMD_DUMMY                (0xFF)
 
 /* acknowledge from Linux to baremetal */
 #define CANVAS_ACK_DIMENSION            (0x02)
 #define CANVAS_ACK_GETCOLOR             (0x05)
+#define CANVAS_ACK_GETCAPS              (0x07)
+#define CANVAS_ACK_TAGGED               (0x08)
+#define CANVAS_ACK_CREDITS              (0x09)
+#define CANVAS_ACK_GETSTATS             (0x0A)
+#define CANVAS_ACK_ANIMATE_DONE         (0x0B)
 #define CANVAS_ACK_DUMMY                (0xFF)
 
+/* protocol version reported by CANVAS_CMD_GETCAPS, major << 8 | minor */
+#define CANVAS_PROTOCOL_VERSION         (0x0100)
+
+/* pixel formats the Linux side can draw into */
+#define CANVAS_PIXFMT_RGB565            (1 << 0)
+#define CANVAS_PIXFMT_RGB888            (1 << 1)
+#define CANVAS_PIXFMT_XRGB8888          (1 << 2)
+
+/* optional protocol features reported in 'ack_caps.features' */
+#define CANVAS_FEATURE_TAGGED           (1 << 0)
+#define CANVAS_FEATURE_LAYERS           (1 << 1)
+/* asset pack is loaded, see CANVAS_CMD_DRAW_ASSET */
+#define CANVAS_FEATURE_ASSETS           (1 << 2)
+
+/* Offscreen layers, composited bottom to top into the frame at flush,
+ * only in regions changed since previous flush. Drawing commands go to
+ * layer chosen by CANVAS_CMD_LAYER_SELECT, static background is drawn
+ * once and never sent again. Pixels of 'key_color' in layer which is
+ * not opaque are transparent */
+#define CANVAS_LAYER_BACKGROUND         (0)
+#define CANVAS_LAYER_CONTENT            (1)
+#define CANVAS_LAYER_OVERLAY            (2)
+#define CANVAS_LAYER_COUNT              (3)
+/* draw straight into the frame, default */
+#define CANVAS_LAYER_DIRECT             (0xFF)
+
+/* 'cmd_layer_config.flags' */
+#define CANVAS_LAYER_ENABLE             (1 << 0)
+#define CANVAS_LAYER_OPAQUE             (1 << 1)
+
+/* Strip charts, samples pushed by CANVAS_CMD_CHART_PUSH enter at the
+ * right edge and older ones scroll left, only new columns are drawn.
+ * Chart draws into target selected at the time of push */
+#define CANVAS_CHART_COUNT              (8)
+/* push attributes fit 4096B */
+#define CANVAS_CHART_MAX_SAMPLES        (2044)
+
+/* 'cmd_chart_config.style' */
+#define CANVAS_CHART_LINE               (0)
+#define CANVAS_CHART_DOTS               (1)
+#define CANVAS_CHART_BARS               (2)
+
+/* Palette for indexed images, colors are converted to framebuffer
+ * format once when set. Unset entries are black */
+#define CANVAS_PALETTE_SIZE             (256)
+
+/* Retained scene, objects kept by daemon and changed by property
+ * updates. Regions changed since previous flush are redrawn at flush,
+ * background first and then visible objects in order of 'id'. Object
+ * is given by bounding box, circle is the largest one fitting it */
+#define CANVAS_SCENE_OBJECTS            (256)
+#define CANVAS_SCENE_TEXT_SIZE          (64)
+
+/* 'cmd_scene_create.type' */
+#define CANVAS_SCENE_RECT               (1)
+#define CANVAS_SCENE_CIRCLE             (2)
+/* font asset is sprite of 16 x 6 glyphs of ASCII 32 to 127, box of
+ * text is given by its length, 'width' and 'height' are not used */
+#define CANVAS_SCENE_TEXT               (3)
+/* sprite asset, zero 'width' or 'height' is size of the sprite */
+#define CANVAS_SCENE_SPRITE             (4)
+
+/* 'cmd_scene_create.flags' */
+#define CANVAS_SCENE_VISIBLE            (1 << 0)
+
+/* 'cmd_scene_update.mask', values follow in order of bits */
+#define CANVAS_SCENE_XPOS               (1 << 0)
+#define CANVAS_SCENE_YPOS               (1 << 1)
+#define CANVAS_SCENE_WIDTH              (1 << 2)
+#define CANVAS_SCENE_HEIGHT             (1 << 3)
+#define CANVAS_SCENE_COLOR              (1 << 4)
+#define CANVAS_SCENE_FLAGS              (1 << 5)
+#define CANVAS_SCENE_ASSET              (1 << 6)
+
+/* Animation of one property of scene object (CANVAS_SCENE_XPOS to
+ * CANVAS_SCENE_COLOR), interpolated by daemon at every frame. Daemon
+ * presents frames itself while animations run and slave has nothing
+ * unflushed, finished animation is reported as CANVAS_ACK_TAGGED with
+ * CANVAS_ACK_ANIMATE_DONE and 'tag' of the animation. Animation started
+ * for the same property replaces running one, animation of deleted
+ * object is dropped, neither is reported */
+#define CANVAS_SCENE_ANIMATIONS         (32)
+
+/* 'cmd_animate.easing' */
+#define CANVAS_EASE_LINEAR              (0)
+#define CANVAS_EASE_IN                  (1)
+#define CANVAS_EASE_OUT                 (2)
+#define CANVAS_EASE_IN_OUT              (3)
+
+/* instances of one batch command, positions fit CANVASLINK_MAX_PAYLOAD */
+#define CANVAS_BATCH_MAX                (1016)
+
+/* 'cmd_put_image.flags', chunk starts new image */
+#define CANVAS_IMAGE_BEGIN              (1 << 0)
+
+/* Flow control (CANVAS_FEATURE_TAGGED). Every command except
+ * CANVAS_CMD_DUMMY costs CANVAS_CREDITS_COST(attributes size) credits,
+ * for tagged query only attributes of the query count. Slave sums costs
+ * of everything it sent (modulo 2^32) and may send next command only if
+ * the sum including it does not pass the last received 'credits' limit.
+ * Daemon piggybacks acknowledges on bytes it clocks while reading, so
+ * slave has to parse MOSI stream: 0xFF is idle, other byte starts ack. */
+#define CANVAS_CREDITS_COST(size)       ((((size) + 16 + 15) / 16) * 16)
+
+/* 'cmd_getstats.id' selecting other than command latency */
+#define CANVAS_STATS_VSYNC              (0x100)
+#define CANVAS_STATS_FLUSH              (0x101)
+#define CANVAS_STATS_COMPOSITE          (0x102)
+#define CANVAS_STATS_SCENE              (0x103)
+#define CANVAS_STATS_ROTATE             (0x104)
+/* first command received to frame visible, counted while tracing (-T) */
+#define CANVAS_STATS_VISIBLE            (0x105)
+/* log2 latency histogram, bucket 0 < 1 us, bucket i in [2^(i-1), 2^i) us */
+#define CANVAS_STATS_BUCKETS            (24)
+
+/* test if command is set in 'ack_caps.commands' bitmap */
+#define CANVAS_CAPS_HAS_CMD(caps, code) (((caps)->commands[(uint8_t)(code) >> 3] >> ((code) & 0x7)) & 0x1)
+
 /* NOTE: If some struct member does not have 4B alignment, 
  * use __attribute__((packed)) */
 
@@ -83,11 +228,203 @@ struct cmd_rectangle {
     uint32_t height;
 };
 
+/* position of batch instance */
+struct cmd_batch_position {
+    int16_t xpos;
+    int16_t ypos;
+};
+
+/* equal rectangles, followed by 'count' struct cmd_batch_position */
+struct cmd_rect_batch {
+    uint32_t color;
+    uint32_t in_centre;
+    uint32_t width;
+    uint32_t height;
+    uint32_t count;
+};
+
+/* equal circles, followed by 'count' struct cmd_batch_position, radius
+ * above width + height of screen is not drawn */
+struct cmd_circle_batch {
+    uint32_t color;
+    uint32_t in_centre;
+    uint32_t radius;
+    uint32_t count;
+};
+
+/* copy rectangle within target (frame or layer), areas may overlap,
+ * parts outside the screen on either side are not copied */
+struct cmd_copy_area {
+    int32_t xsrc;
+    int32_t ysrc;
+    uint32_t width;
+    uint32_t height;
+    int32_t xdst;
+    int32_t ydst;
+};
+
+/* chart of zero width is removed, otherwise region is cleared by
+ * 'background' and samples in <min, max> span its height */
+struct cmd_chart_config {
+    uint32_t chart;
+    int32_t xpos;
+    int32_t ypos;
+    uint32_t width;
+    uint32_t height;
+    int32_t min;
+    int32_t max;
+    uint32_t color;
+    uint32_t background;
+    uint32_t style;
+};
+
+/* followed by 'count' int16_t samples (CANVAS_CHART_MAX_SAMPLES at
+ * most), oldest first, attributes size and credits include them */
+struct cmd_chart_push {
+    uint32_t chart;
+    uint32_t count;
+};
+
+/* followed by 'size' bytes of pixels in framebuffer format (pixel_bits
+ * of dimension acknowledge), row after row of 'width' x 'height' image.
+ * Large image is sent in chunks, 'offset' is index of the first pixel
+ * of chunk within the image. Attributes fit 4096B */
+struct cmd_put_pixels {
+    int32_t xpos;
+    int32_t ypos;
+    uint32_t width;
+    uint32_t height;
+    uint32_t offset;
+    uint32_t size;
+};
+
+/* followed by 'count' CANVAS_RGBCOLOR colors of palette entries from
+ * 'first', entries past CANVAS_PALETTE_SIZE are ignored */
+struct cmd_set_palette {
+    uint32_t first;
+    uint32_t count;
+};
+
+/* as cmd_put_pixels, pixels are palette indices of 'depth' bits (8, 4
+ * or 2), packed most significant bits first and not padded at row end.
+ * Chunk starts on byte boundary, 'size' is in bytes */
+struct cmd_put_indexed {
+    int32_t xpos;
+    int32_t ypos;
+    uint32_t width;
+    uint32_t height;
+    uint32_t offset;
+    uint32_t depth;
+    uint32_t size;
+};
+
+/* followed by 'size' bytes of QOI compressed image (header included),
+ * decoded while chunks arrive. First chunk has CANVAS_IMAGE_BEGIN and
+ * position of image, following ones continue the stream. Transparent
+ * pixels (alpha 0) are not drawn */
+struct cmd_put_image {
+    int32_t xpos;
+    int32_t ypos;
+    uint32_t flags;
+    uint32_t size;
+};
+
+/* draw part of sprite from asset pack of daemon, zero 'width' or
+ * 'height' means whole sprite. Unknown asset is not drawn */
+struct cmd_draw_asset {
+    uint32_t id;
+    int32_t xpos;
+    int32_t ypos;
+    uint32_t xsrc;
+    uint32_t ysrc;
+    uint32_t width;
+    uint32_t height;
+};
+
+/* palette asset replaces palette of CANVAS_CMD_SET_PALETTE */
+struct cmd_asset_palette {
+    uint32_t id;
+};
+
+/* scene is drawn into 'layer' (or CANVAS_LAYER_DIRECT), vacated
+ * regions get 'background'. All objects are deleted */
+struct cmd_scene_config {
+    uint32_t layer;
+    uint32_t background;
+};
+
+/* object of 'id' is created or replaced */
+struct cmd_scene_create {
+    uint32_t id;
+    uint32_t type;
+    int32_t xpos;
+    int32_t ypos;
+    uint32_t width;
+    uint32_t height;
+    uint32_t color;
+    uint32_t asset;
+    uint32_t flags;
+};
+
+/* followed by 32bit value of every bit set in 'mask', lowest bit first,
+ * values of unknown bits are skipped */
+struct cmd_scene_update {
+    uint32_t id;
+    uint32_t mask;
+};
+
+/* followed by 'length' characters (CANVAS_SCENE_TEXT_SIZE at most) */
+struct cmd_scene_text {
+    uint32_t id;
+    uint32_t length;
+};
+
+struct cmd_scene_delete {
+    uint32_t id;
+};
+
+/* 'property' is single CANVAS_SCENE_* bit, color is interpolated per
+ * channel */
+struct cmd_animate {
+    uint32_t id;
+    uint32_t property;
+    int32_t start;
+    int32_t end;
+    uint32_t duration_ms;
+    uint32_t easing;
+    uint32_t tag;
+};
+
 struct cmd_getcolor {
     int32_t xpos;
     int32_t ypos;
 };
 
+/* enabled layer starts filled by 'key_color', disabled one is released */
+struct cmd_layer_config {
+    uint32_t layer;
+    /* CANVAS_LAYER_* flags */
+    uint32_t flags;
+    uint32_t key_color;
+};
+
+/* target of drawing commands, enabled layer or CANVAS_LAYER_DIRECT */
+struct cmd_layer_select {
+    uint32_t layer;
+};
+
+/* tagged query, followed by query command code and its attributes.
+ * Answer comes later as CANVAS_ACK_TAGGED with the same tag */
+struct cmd_tagged {
+    uint32_t tag;
+};
+
+/* statistics query attributes */
+struct cmd_getstats {
+    /* command code or CANVAS_STATS_* */
+    uint32_t id;
+};
+
 /* dimension acknowledge attributes */
 struct ack_dimension {
     int32_t width;
@@ -100,4 +437,56 @@ struct ack_getcolor {
     uint32_t color;
 };
 
+/* capabilities acknowledge attributes */
+struct ack_caps {
+    uint32_t protocol_version;
+    /* largest command (code + attributes) daemon accepts */
+    uint32_t max_frame_size;
+    /* CANVAS_PIXFMT_* bitmask */
+    uint32_t pixel_formats;
+    /* optional protocol features, CANVAS_FEATURE_* bitmask */
+    uint32_t features;
+    /* bitmap of supported command codes, bit (code & 7) of byte (code >> 3) */
+    uint8_t commands[32];
+};
+
+/* tagged acknowledge attributes, followed by 'size' bytes of
+ * acknowledge attributes of the answered query */
+struct ack_tagged {
+    uint32_t tag;
+    /* cumulative credit limit */
+    uint32_t credits;
+    /* CANVAS_ACK_* of the answered query */
+    uint32_t ack_code;
+    uint32_t size;
+};
+
+/* finished animation, inside CANVAS_ACK_TAGGED with its tag */
+struct ack_animate_done {
+    uint32_t id;
+    uint32_t property;
+};
+
+/* credits acknowledge attributes, sent when limit moved noticeably */
+struct ack_credits {
+    uint32_t credits;
+};
+
+/* statistics acknowledge attributes, counters wrap at 2^32 */
+struct ack_stats {
+    uint32_t id;
+    /* link totals */
+    uint32_t rx_bytes;
+    uint32_t rx_commands;
+    uint32_t frames;
+    /* latency of 'id' */
+    uint32_t count;
+    uint32_t avg_us;
+    uint32_t max_us;
+    uint32_t histogram[CANVAS_STATS_BUCKETS];
+    /* flushes merged into later present, flushes with nothing drawn */
+    uint32_t frames_merged;
+    uint32_t frames_skipped;
+};
+
 #endif
@@ -0,0 +1,150 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "canvasasset.h"
+
+/* data of entry lies in file and matches its geometry */
+static int32_t canvasasset_check(
+    const struct canvasasset *assets,
+    const struct canvasasset_entry *entry
+)
+{
+    uint64_t expected;
+
+    if ((entry->offset & 0x3) || ((uint64_t)entry->offset + entry->size > assets->map_size))
+        return -1;
+
+    switch (entry->type)
+    {
+        case CANVASASSET_SPRITE:
+            expected = (uint64_t)entry->width * entry->height * (assets->header->bits_per_pixel >> 3);
+        break;
+        case CANVASASSET_PALETTE:
+            expected = (uint64_t)entry->width * sizeof(uint32_t);
+        break;
+        /* unknown type, newer pack */
+        default:
+            return 0;
+    }
+    return expected == entry->size ? 0 : -1;
+}
+
+/* map pack and validate directory, assets themselves are not touched */
+int32_t canvasasset_open(
+    struct canvasasset *assets,
+    const char *path
+)
+{
+    struct stat status;
+    void *map;
+    int fd;
+
+    assert(!(NULL == assets || NULL == path));
+    if (NULL == assets || NULL == path)
+        return -1;
+
+    memset(assets, 0, sizeof(*assets));
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (0 > fd)
+        return -1;
+    if ((0 != fstat(fd, &status)) || (status.st_size < (off_t)sizeof(struct canvasasset_header)))
+    {
+        close(fd);
+        return -2;
+    }
+    map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    /* mapping keeps the file */
+    close(fd);
+    if (MAP_FAILED == map)
+        return -1;
+
+    assets->map = map;
+    assets->map_size = status.st_size;
+    assets->header = map;
+    assets->entries = (const struct canvasasset_entry*)(assets->header + 1);
+
+    if ((CANVASASSET_MAGIC != assets->header->magic) ||
+        (CANVASASSET_VERSION != assets->header->version) ||
+        (sizeof(struct canvasasset_header) + (uint64_t)assets->header->count *
+            sizeof(struct canvasasset_entry) > assets->map_size))
+    {
+        canvasasset_close(assets);
+        return -2;
+    }
+    for (uint32_t i = 0; i < assets->header->count; i++)
+    {
+        /* lookup is binary search */
+        if ((i && (assets->entries[i - 1].id >= assets->entries[i].id)) ||
+            (0 > canvasasset_check(assets, &assets->entries[i])))
+        {
+            canvasasset_close(assets);
+            return -2;
+        }
+    }
+    return 0;
+}
+
+void canvasasset_close(
+    struct canvasasset *assets
+)
+{
+    if ((NULL == assets) || (NULL == assets->map))
+        return;
+
+    munmap((void*)assets->map, assets->map_size);
+    memset(assets, 0, sizeof(*assets));
+}
+
+const struct canvasasset_entry *canvasasset_find(
+    const struct canvasasset *assets,
+    const uint32_t id
+)
+{
+    uint32_t low = 0, high;
+    uint32_t middle;
+
+    if ((NULL == assets) || (NULL == assets->map))
+        return NULL;
+
+    high = assets->header->count;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (assets->entries[middle].id < id)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if ((low < assets->header->count) && (assets->entries[low].id == id))
+        return &assets->entries[low];
+    return NULL;
+}
@@ -0,0 +1,103 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Asset pack, artwork shipped in rootfs instead of being sent by slave
+ * after every power cycle. Pack is mapped read-only, only header and
+ * directory are checked at open, so start does not depend on pack size
+ * and pages of assets are read in when drawn first.
+ *
+ * File layout (little endian):
+ *  struct canvasasset_header
+ *  struct canvasasset_entry * 'count', sorted by 'id'
+ *  data of assets, each at 4B aligned 'offset' from file start
+ */
+
+#ifndef __CANVASASSET_H__
+#define __CANVASASSET_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CANVASASSET_MAGIC               (0x50415643) /* "CVAP" */
+#define CANVASASSET_VERSION             (1)
+
+/* 'canvasasset_entry.type' */
+/* 'width' x 'height' pixels in framebuffer format, row after row.
+ * Fonts are sprites of glyphs drawn by part */
+#define CANVASASSET_SPRITE              (1)
+/* 'width' palette entries in framebuffer format, uint32_t each */
+#define CANVASASSET_PALETTE             (2)
+
+/* 'canvasasset_entry.flags', sprite pixels equal to 'key_pixel' are
+ * not drawn */
+#define CANVASASSET_KEYED               (1 << 0)
+
+struct canvasasset_header {
+    uint32_t magic;
+    uint32_t version;
+    /* format of pixel data, has to match the screen */
+    uint32_t bits_per_pixel;
+    uint32_t count;
+};
+
+struct canvasasset_entry {
+    uint32_t id;
+    uint32_t type;
+    uint32_t width;
+    uint32_t height;
+    uint32_t flags;
+    uint32_t key_pixel;
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct canvasasset {
+    const uint8_t *map;
+    size_t map_size;
+    const struct canvasasset_header *header;
+    const struct canvasasset_entry *entries;
+};
+
+int32_t canvasasset_open(
+    struct canvasasset *assets,
+    const char *path
+);
+
+void canvasasset_close(
+    struct canvasasset *assets
+);
+
+const struct canvasasset_entry *canvasasset_find(
+    const struct canvasasset *assets,
+    const uint32_t id
+);
+
+static inline const uint8_t *canvasasset_data(
+    const struct canvasasset *assets,
+    const struct canvasasset_entry *entry
+)
+{
+    return assets->map + entry->offset;
+}
+
+#endif
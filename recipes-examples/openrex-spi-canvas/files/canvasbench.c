@@ -0,0 +1,878 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Benchmark of drawing primitives on headless screen and of command
+ * decoding over in-memory transport. Results are printed as JSON on
+ * stdout, so they can be compared between releases.
+ */
+
+#include <getopt.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "canvas_common.h"
+#include "spidevice.h"
+#include "fbscreen.h"
+#include "canvascmd.h"
+#include "canvaslink.h"
+#include "canvasstats.h"
+
+/* benchmark settings */
+struct canvasbench_settings {
+    uint32_t xres;
+    uint32_t yres;
+    /* minimal run time of each case */
+    uint32_t min_ms;
+    /* commands decoded by end-to-end cases */
+    uint32_t stream_commands;
+    uint32_t help;
+};
+
+enum canvasbench_type {
+    canvasbench_clear = 0,
+    canvasbench_rectangle,
+    canvasbench_circle,
+    canvasbench_get_pixel,
+    canvasbench_flush,
+    canvasbench_composite,
+    canvasbench_copy_area,
+    canvasbench_chart,
+    canvasbench_put_pixels,
+    canvasbench_put_indexed,
+    canvasbench_put_image,
+    canvasbench_asset,
+    canvasbench_scene,
+    canvasbench_rect_batch,
+    canvasbench_circle_batch,
+    canvasbench_rotate,
+};
+
+struct canvasbench_case;
+
+/* screen case runs on, case may replace it by screen of its own */
+struct canvasbench_run {
+    struct fbscreen *fbscreen;
+    struct fbscreen rotated;
+    struct canvasasset assets;
+};
+
+/* single micro benchmark, 'size' is rectangle or image side, circle
+ * radius, number of pixels read, samples pushed, scene objects, batch
+ * instances or panel rotation. Optional 'setup' prepares screen before
+ * time is measured and 'teardown' leaves it as it was */
+struct canvasbench_case {
+    const char *name;
+    enum canvasbench_type type;
+    int32_t xpos;
+    int32_t ypos;
+    uint32_t size;
+    int32_t (*setup)(struct canvasbench_run *run, const struct canvasbench_case *bench);
+    void (*teardown)(struct canvasbench_run *run, const struct canvasbench_case *bench);
+};
+
+/* in-memory transport, serves 'data' over and over */
+struct canvasbench_stream {
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t pos;
+    uint64_t left;
+};
+
+static int32_t canvasbench_setup_composite(struct canvasbench_run *run, const struct canvasbench_case *bench);
+static void canvasbench_teardown_composite(struct canvasbench_run *run, const struct canvasbench_case *bench);
+static int32_t canvasbench_setup_chart(struct canvasbench_run *run, const struct canvasbench_case *bench);
+static int32_t canvasbench_setup_asset(struct canvasbench_run *run, const struct canvasbench_case *bench);
+static void canvasbench_teardown_asset(struct canvasbench_run *run, const struct canvasbench_case *bench);
+static int32_t canvasbench_setup_scene(struct canvasbench_run *run, const struct canvasbench_case *bench);
+static void canvasbench_teardown_scene(struct canvasbench_run *run, const struct canvasbench_case *bench);
+static int32_t canvasbench_setup_batch(struct canvasbench_run *run, const struct canvasbench_case *bench);
+static int32_t canvasbench_setup_rotate(struct canvasbench_run *run, const struct canvasbench_case *bench);
+static void canvasbench_teardown_rotate(struct canvasbench_run *run, const struct canvasbench_case *bench);
+
+/* positions assume at least 800x480 screen */
+static const struct canvasbench_case canvasbench_cases[] = {
+    { "clear", canvasbench_clear, 0, 0, 0 },
+    { "rectangle_8", canvasbench_rectangle, 100, 100, 8 },
+    { "rectangle_64", canvasbench_rectangle, 100, 100, 64 },
+    { "rectangle_256", canvasbench_rectangle, 100, 100, 256 },
+    { "rectangle_256_clipped", canvasbench_rectangle, -128, -128, 256 },
+    { "rectangle_256_offscreen", canvasbench_rectangle, -1000, -1000, 256 },
+    { "circle_8", canvasbench_circle, 400, 240, 8 },
+    { "circle_64", canvasbench_circle, 400, 240, 64 },
+    { "circle_200", canvasbench_circle, 400, 240, 200 },
+    { "circle_200_clipped", canvasbench_circle, 0, 0, 200 },
+    { "get_pixel_1024", canvasbench_get_pixel, 0, 0, 1024 },
+    { "flush", canvasbench_flush, 0, 0, 0 },
+    { "composite_64", canvasbench_composite, 100, 100, 64,
+        canvasbench_setup_composite, canvasbench_teardown_composite },
+    { "composite_256", canvasbench_composite, 100, 100, 256,
+        canvasbench_setup_composite, canvasbench_teardown_composite },
+    { "scroll_600x200", canvasbench_copy_area, 100, 100, 600 },
+    { "chart_push_1", canvasbench_chart, 100, 100, 1, canvasbench_setup_chart },
+    { "chart_push_16", canvasbench_chart, 100, 100, 16, canvasbench_setup_chart },
+    { "put_pixels_32", canvasbench_put_pixels, 100, 100, 32 },
+    { "put_pixels_64_clipped", canvasbench_put_pixels, -32, -32, 64 },
+    { "put_indexed4_64", canvasbench_put_indexed, 100, 100, 64 },
+    { "put_image_128", canvasbench_put_image, 100, 100, 128 },
+    { "asset_keyed_64", canvasbench_asset, 100, 100, 64,
+        canvasbench_setup_asset, canvasbench_teardown_asset },
+    { "scene_move_32", canvasbench_scene, 100, 100, 32,
+        canvasbench_setup_scene, canvasbench_teardown_scene },
+    { "rect_batch_64", canvasbench_rect_batch, 100, 100, 64, canvasbench_setup_batch },
+    { "circle_batch_64", canvasbench_circle_batch, 100, 100, 64, canvasbench_setup_batch },
+    { "rotate_90_full", canvasbench_rotate, 0, 0, 90,
+        canvasbench_setup_rotate, canvasbench_teardown_rotate },
+    { "rotate_180_full", canvasbench_rotate, 0, 0, 180,
+        canvasbench_setup_rotate, canvasbench_teardown_rotate },
+    { "rotate_270_full", canvasbench_rotate, 0, 0, 270,
+        canvasbench_setup_rotate, canvasbench_teardown_rotate },
+    { NULL },
+};
+
+/* commands the end-to-end cases are decoded with */
+static struct canvascmd canvasbench_commands[] = {
+    { CANVAS_CMD_CLEAR, canvascmd_clear_screen, sizeof(struct cmd_clearscreen), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_RECTANGLE, canvascmd_draw_rectangle, sizeof(struct cmd_rectangle), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_CIRCLE, canvascmd_draw_circle, sizeof(struct cmd_circle), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_GETCOLOR, canvascmd_get_color, sizeof(struct cmd_getcolor), CANVASCMD_FLAG_QUERY },
+    { CANVAS_CMD_FLUSH_DRAWING, canvascmd_flush_drawing, 0, 0 },
+    { CANVAS_CMD_DUMMY, canvascmd_do_nothing, 0, 0 },
+    {0},
+};
+
+/* instances of batch cases, grid of bar-graph segments or LEDs */
+static struct cmd_batch_position canvasbench_positions[CANVAS_BATCH_MAX];
+
+/* JSON entries written so far */
+static uint32_t canvasbench_results = 0;
+
+static void canvasbench_report(
+    const char *name,
+    const uint32_t bpp,
+    const uint64_t iterations,
+    const uint64_t elapsed_ns,
+    const uint64_t bytes
+)
+{
+    printf("%s\n    {\"name\": \"%s\", \"bpp\": %u, \"iterations\": %llu, "
+        "\"ns_per_op\": %.1f, \"ops_per_s\": %.1f",
+        canvasbench_results++ ? "," : "", name, bpp, (unsigned long long)iterations,
+        (double)elapsed_ns / iterations, iterations * 1e9 / elapsed_ns);
+    if (bytes)
+        printf(", \"bytes_per_s\": %.1f", bytes * 1e9 / elapsed_ns);
+    printf("}");
+}
+
+/* QOI stream of 'side' x 'side' image of horizontal bands and
+ * gradients, encoded by run, diff and rgb operations only */
+static uint32_t canvasbench_qoi(
+    uint8_t *buffer,
+    const uint32_t side
+)
+{
+    uint32_t size = 0, run = 0;
+    uint8_t r = 0, g = 0, b = 0;
+    uint8_t pr = 0, pg = 0, pb = 0;
+
+    memcpy(buffer, "qoif", 4);
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        buffer[4 + i] = side >> (24 - 8 * i);
+        buffer[8 + i] = side >> (24 - 8 * i);
+    }
+    buffer[12] = 3;
+    buffer[13] = 0;
+    size = CANVASQOI_HEADER_SIZE;
+
+    for (uint32_t j = 0; j < side; j++)
+    {
+        for (uint32_t i = 0; i < side; i++)
+        {
+            r = (j / 16) * 40;
+            g = (j & 0x8) ? i : 0;
+            b = 0x80;
+            if ((r == pr) && (g == pg) && (b == pb) && (run < 62))
+            {
+                run++;
+                continue;
+            }
+            if (run)
+                buffer[size++] = 0xC0 | (run - 1);
+            run = 0;
+            if (((uint8_t)(r - pr + 2) < 4) && ((uint8_t)(g - pg + 2) < 4) && ((uint8_t)(b - pb + 2) < 4))
+            {
+                buffer[size++] = 0x40 | ((uint8_t)(r - pr + 2) << 4) |
+                    ((uint8_t)(g - pg + 2) << 2) | (uint8_t)(b - pb + 2);
+            }
+            else
+            {
+                buffer[size++] = 0xFE;
+                buffer[size++] = r;
+                buffer[size++] = g;
+                buffer[size++] = b;
+            }
+            pr = r;
+            pg = g;
+            pb = b;
+        }
+    }
+    if (run)
+        buffer[size++] = 0xC0 | (run - 1);
+    /* end marker */
+    memset(buffer + size, 0, 7);
+    buffer[size + 7] = 1;
+    return size + 8;
+}
+
+static void canvasbench_step(
+    struct fbscreen *fbscreen,
+    const struct canvasbench_case *bench,
+    const uint64_t iteration
+)
+{
+    uint32_t color = (uint32_t)iteration * 0x010203;
+    uint32_t pixel;
+
+    switch (bench->type)
+    {
+        case canvasbench_clear:
+            fbscreen_clear_screen(fbscreen, color);
+        break;
+        case canvasbench_rectangle:
+        {
+            struct cmd_rectangle rectangle = {
+                .xpos = bench->xpos,
+                .ypos = bench->ypos,
+                .color = color,
+                .in_centre = 0,
+                .width = bench->size,
+                .height = bench->size,
+            };
+            fbscreen_draw_rectangle(fbscreen, &rectangle);
+        }
+        break;
+        case canvasbench_circle:
+        {
+            struct cmd_circle circle = {
+                .xpos = bench->xpos,
+                .ypos = bench->ypos,
+                .color = color,
+                .in_centre = 1,
+                .radius = bench->size,
+            };
+            fbscreen_draw_circle(fbscreen, &circle);
+        }
+        break;
+        case canvasbench_get_pixel:
+            for (uint32_t i = 0; i < bench->size; i++)
+            {
+                fbscreen_get_pixel(
+                    fbscreen, i % fbscreen->var_info.xres, i % fbscreen->var_info.yres, &pixel
+                );
+            }
+        break;
+        case canvasbench_flush:
+            fbscreen_flush_drawing(fbscreen);
+        break;
+        case canvasbench_copy_area:
+        {
+            /* chart scrolled left by one pixel */
+            struct cmd_copy_area copy = {
+                .xsrc = bench->xpos + 1,
+                .ysrc = bench->ypos,
+                .width = bench->size - 1,
+                .height = 200,
+                .xdst = bench->xpos,
+                .ydst = bench->ypos,
+            };
+            fbscreen_copy_area(fbscreen, &copy);
+        }
+        break;
+        case canvasbench_chart:
+        {
+            int16_t samples[16];
+
+            for (uint32_t i = 0; i < bench->size; i++)
+                samples[i] = (int16_t)((iteration * 16 + i) * 37 % 1000);
+            fbscreen_chart_push(fbscreen, 0, samples, bench->size);
+        }
+        break;
+        case canvasbench_put_pixels:
+        {
+            /* image in 4096B chunks as it comes over the bus */
+            static uint8_t pixels[4096];
+            uint32_t bytes = fbscreen->var_info.bits_per_pixel >> 3;
+            struct cmd_put_pixels put = {
+                .xpos = bench->xpos,
+                .ypos = bench->ypos,
+                .width = bench->size,
+                .height = bench->size,
+            };
+
+            for (put.offset = 0; put.offset < bench->size * bench->size; put.offset += put.size / bytes)
+            {
+                put.size = (sizeof(pixels) - sizeof(put)) / bytes * bytes;
+                fbscreen_put_pixels(fbscreen, &put, pixels);
+            }
+        }
+        break;
+        case canvasbench_put_indexed:
+        {
+            /* 4bit image in 4096B chunks */
+            static uint8_t indices[4096];
+            struct cmd_put_indexed put = {
+                .xpos = bench->xpos,
+                .ypos = bench->ypos,
+                .width = bench->size,
+                .height = bench->size,
+                .depth = 4,
+                .size = sizeof(indices) - sizeof(put),
+            };
+
+            for (put.offset = 0; put.offset < bench->size * bench->size; put.offset += put.size * 2)
+                fbscreen_put_indexed(fbscreen, &put, indices);
+        }
+        break;
+        case canvasbench_put_image:
+        {
+            /* compressed image in 4096B chunks */
+            static uint8_t data[128 * 128 * 4 + 64];
+            static uint32_t size = 0;
+            struct cmd_put_image put = {
+                .xpos = bench->xpos,
+                .ypos = bench->ypos,
+                .flags = CANVAS_IMAGE_BEGIN,
+            };
+
+            if (0 == size)
+                size = canvasbench_qoi(data, bench->size);
+            for (uint32_t pos = 0; pos < size; pos += put.size, put.flags = 0)
+            {
+                put.size = size - pos < 4096 - sizeof(put) ? size - pos : 4096 - sizeof(put);
+                fbscreen_put_image(fbscreen, &put, data + pos);
+            }
+        }
+        break;
+        case canvasbench_asset:
+        {
+            struct cmd_draw_asset draw = {
+                .id = 1,
+                .xpos = bench->xpos,
+                .ypos = bench->ypos,
+            };
+            fbscreen_draw_asset(fbscreen, &draw);
+        }
+        break;
+        case canvasbench_scene:
+        {
+            /* one object of grid moves, both boxes are repainted */
+            int32_t values[2] = {
+                bench->xpos + (int32_t)(iteration % bench->size) * 20 + (int32_t)(iteration & 0x8),
+                (int32_t)color,
+            };
+            canvasscene_update(
+                fbscreen, iteration % bench->size, CANVAS_SCENE_XPOS | CANVAS_SCENE_COLOR, values
+            );
+            canvasscene_render(fbscreen);
+        }
+        break;
+        case canvasbench_rect_batch:
+        {
+            struct cmd_rect_batch batch = {
+                .color = color,
+                .in_centre = 0,
+                .width = 16,
+                .height = 8,
+                .count = bench->size,
+            };
+            fbscreen_rect_batch(fbscreen, &batch, canvasbench_positions);
+        }
+        break;
+        case canvasbench_circle_batch:
+        {
+            struct cmd_circle_batch batch = {
+                .color = color,
+                .in_centre = 1,
+                .radius = 4,
+                .count = bench->size,
+            };
+            fbscreen_circle_batch(fbscreen, &batch, canvasbench_positions);
+        }
+        break;
+        case canvasbench_rotate:
+            /* whole upright frame to panel */
+            fbscreen_damage_frame(fbscreen);
+            fbscreen_flush_drawing(fbscreen);
+        break;
+        case canvasbench_composite:
+        {
+            /* widget redrawn over opaque background, under keyed overlay */
+            struct cmd_rectangle rectangle = {
+                .xpos = bench->xpos,
+                .ypos = bench->ypos,
+                .color = color,
+                .in_centre = 0,
+                .width = bench->size,
+                .height = bench->size,
+            };
+            fbscreen_draw_rectangle(fbscreen, &rectangle);
+            fbscreen_flush_drawing(fbscreen);
+        }
+        break;
+    }
+}
+
+/* opaque background, content layer drawn to and keyed overlay */
+static int32_t canvasbench_setup_composite(
+    struct canvasbench_run *run,
+    const struct canvasbench_case *bench
+)
+{
+    struct fbscreen *fbscreen = run->fbscreen;
+
+    fbscreen_set_layer(fbscreen, CANVAS_LAYER_BACKGROUND, CANVAS_LAYER_ENABLE | CANVAS_LAYER_OPAQUE, CANVAS_COLOR_BLUE);
+    fbscreen_set_layer(fbscreen, CANVAS_LAYER_CONTENT, CANVAS_LAYER_ENABLE, CANVAS_COLOR_BLACK);
+    fbscreen_set_layer(fbscreen, CANVAS_LAYER_OVERLAY, CANVAS_LAYER_ENABLE, CANVAS_COLOR_BLACK);
+    fbscreen_select_layer(fbscreen, CANVAS_LAYER_CONTENT);
+    fbscreen_flush_drawing(fbscreen);
+    return 0;
+}
+
+static void canvasbench_teardown_composite(
+    struct canvasbench_run *run,
+    const struct canvasbench_case *bench
+)
+{
+    for (uint32_t i = 0; i < CANVAS_LAYER_COUNT; i++)
+        fbscreen_set_layer(run->fbscreen, i, 0, 0);
+}
+
+static int32_t canvasbench_setup_chart(
+    struct canvasbench_run *run,
+    const struct canvasbench_case *bench
+)
+{
+    struct cmd_chart_config chart = {
+        .chart = 0,
+        .xpos = bench->xpos,
+        .ypos = bench->ypos,
+        .width = 600,
+        .height = 200,
+        .min = 0,
+        .max = 999,
+        .color = CANVAS_COLOR_GREEN,
+        .background = CANVAS_COLOR_BLACK,
+        .style = CANVAS_CHART_LINE,
+    };
+
+    return fbscreen_chart_config(run->fbscreen, &chart);
+}
+
+/* pack of single keyed sprite, half of pixels transparent */
+static int32_t canvasbench_setup_asset(
+    struct canvasbench_run *run,
+    const struct canvasbench_case *bench
+)
+{
+    struct fbscreen *fbscreen = run->fbscreen;
+    uint32_t bytes = fbscreen->var_info.bits_per_pixel >> 3;
+    uint32_t size = bench->size * bench->size * bytes;
+    struct canvasasset_header *header;
+    struct canvasasset_entry *entry;
+    uint8_t *map = calloc(1, sizeof(*header) + sizeof(*entry) + size);
+
+    if (NULL == map)
+        return -1;
+    header = (struct canvasasset_header*)map;
+    entry = (struct canvasasset_entry*)(header + 1);
+    header->magic = CANVASASSET_MAGIC;
+    header->version = CANVASASSET_VERSION;
+    header->bits_per_pixel = fbscreen->var_info.bits_per_pixel;
+    header->count = 1;
+    entry->id = 1;
+    entry->type = CANVASASSET_SPRITE;
+    entry->width = bench->size;
+    entry->height = bench->size;
+    entry->flags = CANVASASSET_KEYED;
+    entry->offset = sizeof(*header) + sizeof(*entry);
+    entry->size = size;
+    for (uint32_t i = 0; i < size; i++)
+        map[entry->offset + i] = (i / bytes) & 0x1 ? 0x5A : 0;
+    run->assets.map = map;
+    run->assets.map_size = entry->offset + size;
+    run->assets.header = header;
+    run->assets.entries = entry;
+    fbscreen->assets = &run->assets;
+    return 0;
+}
+
+static void canvasbench_teardown_asset(
+    struct canvasbench_run *run,
+    const struct canvasbench_case *bench
+)
+{
+    free((void*)run->assets.map);
+    run->fbscreen->assets = NULL;
+}
+
+/* overlapping circles over row of rectangles */
+static int32_t canvasbench_setup_scene(
+    struct canvasbench_run *run,
+    const struct canvasbench_case *bench
+)
+{
+    struct cmd_scene_config config = {
+        .layer = CANVAS_LAYER_DIRECT,
+        .background = CANVAS_COLOR_BLACK,
+    };
+    struct cmd_scene_create create = {
+        .ypos = bench->ypos,
+        .width = 32,
+        .height = 32,
+        .color = CANVAS_COLOR_GREEN,
+        .flags = CANVAS_SCENE_VISIBLE,
+    };
+
+    canvasscene_config(run->fbscreen, &config);
+    for (uint32_t i = 0; i < bench->size; i++)
+    {
+        create.id = i;
+        create.type = i & 0x1 ? CANVAS_SCENE_CIRCLE : CANVAS_SCENE_RECT;
+        create.xpos = bench->xpos + i * 20;
+        create.ypos = bench->ypos + (i & 0x1) * 16;
+        canvasscene_create(run->fbscreen, &create);
+    }
+    return canvasscene_render(run->fbscreen);
+}
+
+static void canvasbench_teardown_scene(
+    struct canvasbench_run *run,
+    const struct canvasbench_case *bench
+)
+{
+    canvasscene_init(&run->fbscreen->scene);
+}
+
+/* rows of eight, given bottom first so they have to be sorted */
+static int32_t canvasbench_setup_batch(
+    struct canvasbench_run *run,
+    const struct canvasbench_case *bench
+)
+{
+    for (uint32_t i = 0; i < bench->size; i++)
+    {
+        canvasbench_positions[bench->size - 1 - i].xpos = bench->xpos + (i % 8) * 20;
+        canvasbench_positions[bench->size - 1 - i].ypos = bench->ypos + (i / 8) * 12;
+    }
+    return 0;
+}
+
+/* rotation is fixed at screen init, case gets screen of its own */
+static int32_t canvasbench_setup_rotate(
+    struct canvasbench_run *run,
+    const struct canvasbench_case *bench
+)
+{
+    const struct fb_var_screeninfo *var_info = &run->fbscreen->var_info;
+
+    memset(&run->rotated, 0, sizeof(run->rotated));
+    if ((0 > fbscreen_init_headless(&run->rotated, var_info->xres, var_info->yres, var_info->bits_per_pixel)) ||
+        (0 > fbscreen_init_rotation(&run->rotated, bench->size)))
+    {
+        fbscreen_deinit(&run->rotated);
+        return -1;
+    }
+    run->fbscreen = &run->rotated;
+    return 0;
+}
+
+static void canvasbench_teardown_rotate(
+    struct canvasbench_run *run,
+    const struct canvasbench_case *bench
+)
+{
+    fbscreen_deinit(&run->rotated);
+}
+
+/* run case until 'min_ms' elapsed, clock is read once per batch */
+static int32_t canvasbench_run_case(
+    struct fbscreen *fbscreen,
+    const struct canvasbench_case *bench,
+    const struct canvasbench_settings *settings
+)
+{
+    struct canvasbench_run run = { .fbscreen = fbscreen };
+    uint64_t min_ns = (uint64_t)settings->min_ms * 1000000;
+    uint64_t iterations = 0;
+    uint64_t batch = 1;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+
+    if ((NULL != bench->setup) && (0 > bench->setup(&run, bench)))
+        return -1;
+
+    start_ns = canvasstats_now_ns();
+    do
+    {
+        for (uint64_t i = 0; i < batch; i++)
+            canvasbench_step(run.fbscreen, bench, iterations + i);
+        iterations += batch;
+        elapsed_ns = canvasstats_now_ns() - start_ns;
+        if (batch < 1024)
+            batch <<= 1;
+    } while (elapsed_ns < min_ns);
+
+    canvasbench_report(bench->name, run.fbscreen->var_info.bits_per_pixel, iterations, elapsed_ns, 0);
+
+    if (NULL != bench->teardown)
+        bench->teardown(&run, bench);
+    return 0;
+}
+
+static int32_t canvasbench_stream_transfer(
+    const struct spidevice *spidevice,
+    const struct spi_ioc_transfer *message
+)
+{
+    struct canvasbench_stream *stream = spidevice->priv;
+    uint8_t *rx_buf = (uint8_t*)(uintptr_t)message->rx_buf;
+    uint32_t len = message->len;
+    uint32_t chunk;
+
+    /* acknowledges are dropped */
+    if (0 == message->rx_buf)
+        return 0;
+
+    while (len)
+    {
+        if (0 == stream->left)
+            return SPIDEVICE_EOF;
+        chunk = stream->size - stream->pos;
+        chunk = chunk < len ? chunk : len;
+        chunk = chunk < stream->left ? chunk : stream->left;
+        memcpy(rx_buf, stream->data + stream->pos, chunk);
+        stream->pos = (stream->pos + chunk) % stream->size;
+        stream->left -= chunk;
+        rx_buf += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+static const struct spidevice_ops canvasbench_stream_ops = {
+    .transfer = canvasbench_stream_transfer,
+};
+
+static uint32_t canvasbench_put(
+    uint8_t *buffer,
+    const uint8_t cmd_code,
+    const void *payload,
+    const uint32_t size
+)
+{
+    buffer[0] = cmd_code;
+    if (size)
+        memcpy(buffer + 1, payload, size);
+    return 1 + size;
+}
+
+/* decode 'commands' commands of 'data' through receive thread,
+ * queue and dispatcher, the same path daemon uses */
+static int32_t canvasbench_run_stream(
+    struct fbscreen *fbscreen,
+    const char *name,
+    const uint8_t *data,
+    const uint32_t size,
+    const uint32_t count,
+    const struct canvasbench_settings *settings
+)
+{
+    struct canvasbench_stream stream = { .data = data, .size = size };
+    struct spidevice spidevice = {0};
+    struct canvaslink link;
+    struct canvasqueue_entry *entry;
+    struct canvascmd_frame frame;
+    uint32_t repeat = (settings->stream_commands + count - 1) / count;
+    uint64_t commands = 0;
+    uint64_t start_ns;
+    int32_t result;
+
+    stream.left = (uint64_t)size * repeat;
+    spidevice_init_ops(&spidevice, &canvasbench_stream_ops, &stream);
+    if (0 > canvaslink_init(&link, &spidevice, NULL, NULL))
+        return -1;
+
+    start_ns = canvasstats_now_ns();
+    result = canvaslink_start(&link);
+    while (0 == result)
+    {
+        entry = canvasqueue_peek(&link.commands, -1);
+        if (NULL == entry)
+        {
+            if (canvasqueue_is_closed(&link.commands)) break;
+            continue;
+        }
+        canvaslink_frame(&link, entry, &frame);
+        result = canvascmd_exec(fbscreen, &frame);
+        canvasqueue_release(&link.commands, entry);
+        commands++;
+    }
+    if (0 > canvaslink_stop(&link))
+        result = -1;
+
+    if (0 == result && commands)
+    {
+        canvasbench_report(
+            name, fbscreen->var_info.bits_per_pixel, commands,
+            canvasstats_now_ns() - start_ns, (uint64_t)size * repeat
+        );
+    }
+    canvaslink_deinit(&link);
+    return result;
+}
+
+/* end-to-end cases, drawing heavy mix and decoding bound tiny primitives */
+static int32_t canvasbench_run_streams(
+    struct fbscreen *fbscreen,
+    const struct canvasbench_settings *settings
+)
+{
+    uint8_t data[1024];
+    uint32_t size = 0;
+    uint32_t count = 0;
+    uint32_t tag = 0;
+    int32_t result;
+
+    /* mixed drawing frame, untagged query stalls the link as real slave does */
+    for (int i = 0; i < 4; i++)
+    {
+        struct cmd_rectangle rectangle = { 10 * i, 10 * i, CANVAS_COLOR_RED, 0, 64, 32 };
+        struct cmd_circle circle = { 400, 240, CANVAS_COLOR_BLUE, 1, 16 + 4 * i };
+        size += canvasbench_put(data + size, CANVAS_CMD_RECTANGLE, &rectangle, sizeof(rectangle));
+        size += canvasbench_put(data + size, CANVAS_CMD_CIRCLE, &circle, sizeof(circle));
+        count += 2;
+    }
+    {
+        struct cmd_getcolor getcolor = { 20, 20 };
+        size += canvasbench_put(data + size, CANVAS_CMD_TAGGED, &tag, sizeof(tag));
+        size += canvasbench_put(data + size, CANVAS_CMD_GETCOLOR, &getcolor, sizeof(getcolor));
+        size += canvasbench_put(data + size, CANVAS_CMD_GETCOLOR, &getcolor, sizeof(getcolor));
+        size += canvasbench_put(data + size, CANVAS_CMD_FLUSH_DRAWING, NULL, 0);
+        count += 3;
+    }
+    result = canvasbench_run_stream(fbscreen, "stream_mixed", data, size, count, settings);
+    if (0 > result)
+        return result;
+
+    /* single pixel rectangles, time is spent in transport and decoding */
+    size = 0;
+    count = 0;
+    for (int i = 0; i < 32; i++)
+    {
+        struct cmd_rectangle rectangle = { i, i, CANVAS_COLOR_WHITE, 0, 1, 1 };
+        size += canvasbench_put(data + size, CANVAS_CMD_RECTANGLE, &rectangle, sizeof(rectangle));
+        count++;
+    }
+    return canvasbench_run_stream(fbscreen, "stream_decode", data, size, count, settings);
+}
+
+static int32_t canvasbench_print_help(void)
+{
+    printf("openrex_spi_canvas_bench -H 800x480 -m 200 -n 100000 \n");
+    printf("-H = size of headless screen WIDTHxHEIGHT \n");
+    printf("-m = minimal run time of each case in ms \n");
+    printf("-n = number of commands decoded by stream cases \n");
+    return 0;
+}
+
+static struct option canvasbench_options[] = {
+    { "headless", required_argument, 0, 'H' },
+    { "min-time", required_argument, 0, 'm' },
+    { "commands", required_argument, 0, 'n' },
+    { "help", no_argument, 0, 'h' },
+    { 0 },
+};
+
+int main(int argc, char **argv)
+{
+    struct canvasbench_settings settings = {
+        .xres = 800,
+        .yres = 480,
+        .min_ms = 200,
+        .stream_commands = 100000,
+    };
+    static const uint8_t depths[] = { 16, 24, 32 };
+    struct fbscreen fbscreen;
+    int long_index = 0;
+    int opt;
+    int32_t result = 0;
+
+    while ((opt = getopt_long(argc, argv, "H:m:n:h", canvasbench_options, &long_index)) != -1)
+    {
+        switch (opt)
+        {
+            case 'H':
+                sscanf(optarg, "%ux%u", &settings.xres, &settings.yres);
+            break;
+            case 'm':
+                settings.min_ms = atoi(optarg);
+            break;
+            case 'n':
+                settings.stream_commands = atoi(optarg);
+            break;
+            default:
+                settings.help = 1;
+            break;
+        }
+    }
+    if (settings.help || 0 == settings.xres || 0 == settings.yres || 0 == settings.stream_commands)
+    {
+        canvasbench_print_help();
+        return 0;
+    }
+
+    canvascmd_init(canvasbench_commands);
+
+    printf("{\"benchmark\": \"openrex_spi_canvas\", \"protocol_version\": %u, "
+        "\"xres\": %u, \"yres\": %u, \"min_ms\": %u, \"results\": [",
+        CANVAS_PROTOCOL_VERSION, settings.xres, settings.yres, settings.min_ms);
+
+    for (int i = 0; (0 == result) && (i < sizeof(depths)); i++)
+    {
+        result = fbscreen_init_headless(&fbscreen, settings.xres, settings.yres, depths[i]);
+        if (0 > result)
+            break;
+        for (int j = 0; NULL != canvasbench_cases[j].name; j++)
+            canvasbench_run_case(&fbscreen, &canvasbench_cases[j], &settings);
+        result = canvasbench_run_streams(&fbscreen, &settings);
+        fbscreen_deinit(&fbscreen);
+    }
+
+    printf("\n]}\n");
+    if (0 > result)
+        fprintf(stderr, "benchmark failed, error %d\n", result);
+    return result;
+}
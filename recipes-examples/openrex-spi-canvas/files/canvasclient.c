@@ -0,0 +1,238 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "config.h"
+#include "canvasclient.h"
+
+/* hello with descriptors of both queues */
+static int32_t canvasclient_receive_hello(
+    const int32_t fd,
+    int32_t *fds
+)
+{
+    struct canvasclient_hello hello;
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    union {
+        struct cmsghdr header;
+        uint8_t buffer[CMSG_SPACE(CANVASCLIENT_FDS * sizeof(int32_t))];
+    } control;
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+    struct cmsghdr *cmsg;
+
+    if (sizeof(hello) != recvmsg(fd, &message, MSG_CMSG_CLOEXEC))
+        return -1;
+    cmsg = CMSG_FIRSTHDR(&message);
+    if ((NULL == cmsg) || (SCM_RIGHTS != cmsg->cmsg_type) ||
+        (CMSG_LEN(CANVASCLIENT_FDS * sizeof(int32_t)) != cmsg->cmsg_len))
+    {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), CANVASCLIENT_FDS * sizeof(int32_t));
+    if ((CANVASCLIENT_MAGIC != hello.magic) || (CANVASCLIENT_VERSION != hello.version))
+    {
+        for (uint32_t i = 0; i < CANVASCLIENT_FDS; i++)
+            close(fds[i]);
+        return -2;
+    }
+    return 0;
+}
+
+int32_t canvasclient_connect(
+    struct canvasclient *client,
+    const char *path
+)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    int32_t fds[CANVASCLIENT_FDS];
+    int32_t result;
+
+    assert(!(NULL == client || NULL == path || strlen(path) >= sizeof(address.sun_path)));
+    if (NULL == client || NULL == path || strlen(path) >= sizeof(address.sun_path))
+        return -1;
+
+    memset(client, 0, sizeof(*client));
+    client->commands.data_fd = client->commands.space_fd = -1;
+    client->replies.data_fd = client->replies.space_fd = -1;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client->fd < 0)
+        return -1;
+    if (0 > connect(client->fd, (struct sockaddr*)&address, sizeof(address)))
+    {
+        canvasclient_disconnect(client);
+        return -1;
+    }
+    result = canvasclient_receive_hello(client->fd, fds);
+    if (0 > result)
+    {
+        canvasclient_disconnect(client);
+        return result;
+    }
+
+    /* memory is mapped, its descriptors are not needed any more */
+    result = canvasqueue_attach(&client->commands, fds[0], fds[1], fds[2]);
+    if (0 > result)
+    {
+        close(fds[1]);
+        close(fds[2]);
+    }
+    close(fds[0]);
+    if (0 > canvasqueue_attach(&client->replies, fds[3], fds[4], fds[5]))
+    {
+        close(fds[4]);
+        close(fds[5]);
+        result = -1;
+    }
+    close(fds[3]);
+    if (0 > result)
+    {
+        canvasclient_disconnect(client);
+        return -3;
+    }
+    return 0;
+}
+
+/* daemon executes what is already committed, then drops the connection */
+void canvasclient_disconnect(
+    struct canvasclient *client
+)
+{
+    if (NULL == client)
+        return;
+
+    if (NULL != client->commands.ring)
+        canvasqueue_close(&client->commands);
+    canvasqueue_deinit(&client->commands);
+    canvasqueue_deinit(&client->replies);
+    if (client->fd >= 0)
+        close(client->fd);
+    client->fd = -1;
+    client->entry = NULL;
+}
+
+/* attributes of next command, filled in place and published by
+ * canvasclient_commit. Blocks while daemon queue is full, NULL when
+ * daemon closed it */
+void *canvasclient_reserve(
+    struct canvasclient *client,
+    const uint8_t cmd_code,
+    const uint32_t size
+)
+{
+    assert(!(NULL == client || NULL != client->entry));
+    if (NULL == client || NULL != client->entry)
+        return NULL;
+
+    client->entry = canvasqueue_reserve(&client->commands, size);
+    if (NULL == client->entry)
+        return NULL;
+    client->entry->cmd_code = cmd_code;
+    return CANVASQUEUE_PAYLOAD(client->entry);
+}
+
+void canvasclient_commit(
+    struct canvasclient *client
+)
+{
+    assert(!(NULL == client || NULL == client->entry));
+    if (NULL == client || NULL == client->entry)
+        return;
+
+    canvasqueue_commit(&client->commands, client->entry);
+    client->entry = NULL;
+}
+
+/* command from ready attributes */
+int32_t canvasclient_send(
+    struct canvasclient *client,
+    const uint8_t cmd_code,
+    const void *attributes,
+    const uint32_t size
+)
+{
+    void *payload = canvasclient_reserve(client, cmd_code, size);
+
+    if (NULL == payload)
+        return -1;
+    memcpy(payload, attributes, size);
+    canvasclient_commit(client);
+    return 0;
+}
+
+/* answer comes as reply of the same 'tag' */
+int32_t canvasclient_query(
+    struct canvasclient *client,
+    const uint32_t tag,
+    const uint8_t cmd_code,
+    const void *attributes,
+    const uint32_t size
+)
+{
+    void *payload = canvasclient_reserve(client, cmd_code, size);
+
+    if (NULL == payload)
+        return -1;
+    memcpy(payload, attributes, size);
+    client->entry->tag = tag;
+    client->entry->flags = CANVASQUEUE_FLAG_TAGGED;
+    canvasclient_commit(client);
+    return 0;
+}
+
+/* oldest answer, 'cmd_code' is CANVAS_ACK_* and 'tag' of the query (or
+ * animation), waits up to 'timeout_ms' (negative forever) */
+const struct canvasqueue_entry *canvasclient_reply(
+    struct canvasclient *client,
+    const int32_t timeout_ms
+)
+{
+    assert(!(NULL == client));
+    if (NULL == client)
+        return NULL;
+
+    return canvasqueue_peek(&client->replies, timeout_ms);
+}
+
+void canvasclient_release(
+    struct canvasclient *client,
+    const struct canvasqueue_entry *entry
+)
+{
+    assert(!(NULL == client || NULL == entry));
+    if (NULL == client || NULL == entry)
+        return;
+
+    canvasqueue_release(&client->replies, (struct canvasqueue_entry*)entry);
+}
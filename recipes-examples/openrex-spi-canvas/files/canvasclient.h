@@ -0,0 +1,118 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Local client of running daemon, for processes on the board which draw
+ * status overlays next to the slave. Connection to display socket (-C)
+ * hands over two shared memory queues: commands are written straight
+ * into the daemon's queue, no copy and no system call unless daemon
+ * sleeps, answers (tagged) come back through the other one. Wakeups of
+ * both sides go through eventfd as within the daemon.
+ *
+ * Commands are the wire structs of canvas_common.h. Screen is shared
+ * with slave, each client has its own target (CANVAS_CMD_LAYER_SELECT),
+ * so overlay is usually drawn into own layer.
+ *
+ *  struct canvasclient client;
+ *  struct cmd_rectangle *rectangle;
+ *
+ *  canvasclient_connect(&client, "/run/openrex_spi_canvas.client");
+ *  rectangle = canvasclient_reserve(&client, CANVAS_CMD_RECTANGLE, sizeof(*rectangle));
+ *  rectangle->xpos = ...;
+ *  canvasclient_commit(&client);
+ */
+
+#ifndef __CANVASCLIENT_H__
+#define __CANVASCLIENT_H__
+
+#include <stdint.h>
+#include "canvas_common.h"
+#include "canvasqueue.h"
+
+#define CANVASCLIENT_MAGIC              (0x4C435643) /* "CVCL" */
+#define CANVASCLIENT_VERSION            (1)
+
+/* descriptors sent along with struct canvasclient_hello, memory,
+ * data and space eventfd of commands queue, then of replies queue */
+#define CANVASCLIENT_FDS                (6)
+
+/* first message of daemon on connection */
+struct canvasclient_hello {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct canvasclient {
+    int32_t fd;
+    /* written by client, read by daemon */
+    struct canvasqueue commands;
+    /* acknowledges of tagged queries, finished animations */
+    struct canvasqueue replies;
+    /* reserved and not committed yet */
+    struct canvasqueue_entry *entry;
+};
+
+int32_t canvasclient_connect(
+    struct canvasclient *client,
+    const char *path
+);
+
+void canvasclient_disconnect(
+    struct canvasclient *client
+);
+
+void *canvasclient_reserve(
+    struct canvasclient *client,
+    const uint8_t cmd_code,
+    const uint32_t size
+);
+
+void canvasclient_commit(
+    struct canvasclient *client
+);
+
+int32_t canvasclient_send(
+    struct canvasclient *client,
+    const uint8_t cmd_code,
+    const void *attributes,
+    const uint32_t size
+);
+
+int32_t canvasclient_query(
+    struct canvasclient *client,
+    const uint32_t tag,
+    const uint8_t cmd_code,
+    const void *attributes,
+    const uint32_t size
+);
+
+const struct canvasqueue_entry *canvasclient_reply(
+    struct canvasclient *client,
+    const int32_t timeout_ms
+);
+
+void canvasclient_release(
+    struct canvasclient *client,
+    const struct canvasqueue_entry *entry
+);
+
+#endif
@@ -20,19 +20,125 @@
  *  under the License.
  */
 
+#include <string.h>
+#include <assert.h>
+
 #include "config.h"
 #include "canvas_common.h"
-#include "spidevice.h"
 #include "fbscreen.h"
 #include "canvascmd.h"
+#include "canvaslink.h"
+#include "canvasstats.h"
+#include "canvastimeline.h"
 
-int32_t canvascmd_get_dimension(
+/* attributes are decoded in place, wire format is little endian */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#   error "in place decoding of canvas attributes requires little endian host"
+#endif
+
+/* direct dispatch table indexed by command code */
+static const struct canvascmd *canvascmd_table[256];
+
+/* build dispatch table from NULL terminated list of commands */
+int32_t canvascmd_init(
+    const struct canvascmd *commands
+)
+{
+    assert(!(NULL == commands));
+    if (NULL == commands)
+        return -1;
+
+    memset(canvascmd_table, 0, sizeof(canvascmd_table));
+    for (int i = 0; commands[i].cmd_code; i++)
+    {
+        assert(!(commands[i].payload_size > CANVASLINK_MAX_PAYLOAD));
+        if (commands[i].payload_size > CANVASLINK_MAX_PAYLOAD)
+            return -1;
+        assert(!(commands[i].payload_extra && (commands[i].payload_size > CANVASCMD_HEADER_MAX)));
+        if (commands[i].payload_extra && (commands[i].payload_size > CANVASCMD_HEADER_MAX))
+            return -1;
+        canvascmd_table[commands[i].cmd_code] = &commands[i];
+    }
+    return 0;
+}
+
+const struct canvascmd *canvascmd_lookup(
+    const uint8_t cmd_code
+)
+{
+    return canvascmd_table[cmd_code];
+}
+
+/* validate frame once and run its handler, attributes are
+ * accessed in place through the wire structs afterwards */
+int32_t canvascmd_exec(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
 )
 {
+    const struct canvascmd *command = canvascmd_table[frame->cmd_code];
+    uint64_t start_ns;
+    uint64_t size;
     int32_t result;
-    uint8_t ack = CANVAS_ACK_DIMENSION;
+
+    if (NULL == command)
+        return -1;
+
+    size = command->payload_size;
+    if ((NULL != command->payload_extra) && (frame->size >= size))
+        size += command->payload_extra(frame->payload);
+
+    /* every attribute is 32bit, receive buffer must keep that alignment */
+    assert(!(((uintptr_t)frame->payload & 0x3) || (frame->size != size)));
+    if (((uintptr_t)frame->payload & 0x3) || (frame->size != size))
+        return -1;
+
+    if (command->flags & CANVASCMD_FLAG_DRAW)
+        fbscreen->dirty = 1;
+    if (CANVASTIMELINE_ENABLED())
+    {
+        canvastimeline_command(
+            &fbscreen->timeline, frame->seq, frame->received_ns, command->flags & CANVASCMD_FLAG_DRAW
+        );
+    }
+
+    start_ns = canvasstats_now_ns();
+    result = command->cmd_exec(fbscreen, frame);
+    canvasstats_sample(&canvasstats.commands[frame->cmd_code], canvasstats_now_ns() - start_ns);
+    return result;
+}
+
+/* queue acknowledge, receive thread sends it to slave */
+int32_t canvascmd_reply(
+    const struct canvascmd_frame *frame,
+    const uint8_t ack_code,
+    const void *data,
+    const uint32_t size
+)
+{
+    struct canvasqueue_entry *entry;
+
+    assert(!(NULL == frame || NULL == frame->replies));
+    if (NULL == frame || NULL == frame->replies)
+        return -1;
+
+    entry = canvasqueue_reserve(frame->replies, size);
+    if (NULL == entry)
+        return -1;
+
+    entry->cmd_code = ack_code;
+    entry->tag = frame->tag;
+    entry->flags = frame->tagged ? CANVASQUEUE_FLAG_TAGGED : 0;
+    memcpy(CANVASQUEUE_PAYLOAD(entry), data, size);
+    canvasqueue_commit(frame->replies, entry);
+    return 0;
+}
+
+int32_t canvascmd_get_dimension(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
     struct ack_dimension dimension = { 0 };
 
     dimension.width = fbscreen->var_info.xres;
@@ -43,42 +149,24 @@ int32_t canvascmd_get_dimension(
     canvas_dbg("width: 0x%x\n", dimension.width);
     canvas_dbg("height: 0x%x\n", dimension.height);
 
-    if (0 > (result = spidevice_write(
-        spidevice, (uint8_t*)&ack, sizeof(ack)
-    )))
-    {
-        return result;
-    }
-
-    if (0 > (result = spidevice_write(
-        spidevice, (uint8_t*)&dimension, sizeof(dimension)
-    )))
-    {
-        return result;
-    }
-    return 0;
+    return canvascmd_reply(
+        frame, CANVAS_ACK_DIMENSION, &dimension, sizeof(dimension)
+    );
 }
 
 int32_t canvascmd_clear_screen(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
 )
 {
     int32_t result;
-    struct cmd_clearscreen cmd_screen;
+    const struct cmd_clearscreen *cmd_screen = (const void*)frame->payload;
 
-    if (0 > (result = spidevice_read(
-        spidevice, (uint8_t*)&cmd_screen, sizeof(cmd_screen)
-    )))
-    {
-        return result;
-    }
-
-    canvas_dbg("cmd clear screen: 0x%x\n", sizeof(cmd_screen));
-    canvas_dbg("color: 0x%x\n", cmd_screen.color);
+    canvas_dbg("cmd clear screen: 0x%x\n", sizeof(*cmd_screen));
+    canvas_dbg("color: 0x%x\n", cmd_screen->color);
 
     if (0 > (result = fbscreen_clear_screen(
-        fbscreen, cmd_screen.color
+        fbscreen, cmd_screen->color
     )))
     {
         return result;
@@ -88,36 +176,22 @@ int32_t canvascmd_clear_screen(
 
 int32_t canvascmd_draw_circle(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
 )
 {
     int32_t result;
-    struct cmd_circle cmd_circle = {0};
-    struct fbscreen_circle fb_circle = {0};
+    const struct cmd_circle *cmd_circle = (const void*)frame->payload;
 
-    if (0 > (result = spidevice_read(
-        spidevice, (uint8_t*)&cmd_circle, sizeof(cmd_circle)
-    )))
-    {
-        return result;
-    }
-
-    canvas_dbg("drawing circle: 0x%x\n", sizeof(cmd_circle));
-    canvas_dbg("xpos: 0x%x\n", cmd_circle.xpos);
-    canvas_dbg("ypos: 0x%x\n", cmd_circle.ypos);
-    canvas_dbg("color: 0x%x\n", cmd_circle.color);
-    canvas_dbg("in centre: 0x%x\n", cmd_circle.in_centre);
-    canvas_dbg("radius: 0x%x\n", cmd_circle.radius);
-
-    /* copy circle between 'command' and 'drawing' domain */
-    fb_circle.xpos = cmd_circle.xpos;
-    fb_circle.ypos = cmd_circle.ypos;
-    fb_circle.color = cmd_circle.color;
-    fb_circle.in_centre = cmd_circle.in_centre;
-    fb_circle.radius = cmd_circle.radius;
+    canvas_dbg("drawing circle: 0x%x\n", sizeof(*cmd_circle));
+    canvas_dbg("xpos: 0x%x\n", cmd_circle->xpos);
+    canvas_dbg("ypos: 0x%x\n", cmd_circle->ypos);
+    canvas_dbg("color: 0x%x\n", cmd_circle->color);
+    canvas_dbg("in centre: 0x%x\n", cmd_circle->in_centre);
+    canvas_dbg("radius: 0x%x\n", cmd_circle->radius);
 
+    /* drawing API consumes wire struct straight from receive buffer */
     if (0 > (result = fbscreen_draw_circle(
-        fbscreen, &fb_circle
+        fbscreen, cmd_circle
     )))
     {
         return result;
@@ -127,38 +201,23 @@ int32_t canvascmd_draw_circle(
 
 int32_t canvascmd_draw_rectangle(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
 )
 {
     int32_t result;
-    struct cmd_rectangle cmd_rectangle = {0};
-    struct fbscreen_rectangle fb_rectangle = {0};
+    const struct cmd_rectangle *cmd_rectangle = (const void*)frame->payload;
 
-    if (0 > (result = spidevice_read(
-        spidevice, (uint8_t*)&cmd_rectangle, sizeof(cmd_rectangle)
-    )))
-    {
-        return result;
-    }
-
-    canvas_dbg("cmd rectangle: 0x%x\n", sizeof(cmd_rectangle));
-    canvas_dbg("xpos: 0x%x\n", cmd_rectangle.xpos);
-    canvas_dbg("ypos: 0x%x\n", cmd_rectangle.ypos);
-    canvas_dbg("color: 0x%x\n", cmd_rectangle.color);
-    canvas_dbg("in centre: 0x%x\n", cmd_rectangle.in_centre);
-    canvas_dbg("width: 0x%x\n", cmd_rectangle.width);
-    canvas_dbg("height: 0x%x\n", cmd_rectangle.height);
-
-    /* copy rectangle between 'command' and 'drawing' domain */
-    fb_rectangle.xpos = cmd_rectangle.xpos;
-    fb_rectangle.ypos = cmd_rectangle.ypos;
-    fb_rectangle.color = cmd_rectangle.color;
-    fb_rectangle.in_centre = cmd_rectangle.in_centre;
-    fb_rectangle.width = cmd_rectangle.width;
-    fb_rectangle.height = cmd_rectangle.height;
+    canvas_dbg("cmd rectangle: 0x%x\n", sizeof(*cmd_rectangle));
+    canvas_dbg("xpos: 0x%x\n", cmd_rectangle->xpos);
+    canvas_dbg("ypos: 0x%x\n", cmd_rectangle->ypos);
+    canvas_dbg("color: 0x%x\n", cmd_rectangle->color);
+    canvas_dbg("in centre: 0x%x\n", cmd_rectangle->in_centre);
+    canvas_dbg("width: 0x%x\n", cmd_rectangle->width);
+    canvas_dbg("height: 0x%x\n", cmd_rectangle->height);
 
+    /* drawing API consumes wire struct straight from receive buffer */
     if (0 > (result = fbscreen_draw_rectangle(
-        fbscreen, &fb_rectangle
+        fbscreen, cmd_rectangle
     )))
     {
         return result;
@@ -169,66 +228,508 @@ int32_t canvascmd_draw_rectangle(
 
 int32_t canvascmd_get_color(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
 )
 {
-    int32_t result;
-    uint8_t ack = CANVAS_ACK_DIMENSION;
-    struct cmd_getcolor cmd_getcolor;
-    struct ack_getcolor ack_getcolor;
-
-    /* read requested xpos, ypos */
-    if (0 > (result = spidevice_read(
-        spidevice, (uint8_t*)&cmd_getcolor, sizeof(cmd_getcolor)
-    )))
-    {
-        return result;
-    }
+    const struct cmd_getcolor *cmd_getcolor = (const void*)frame->payload;
+    struct ack_getcolor ack_getcolor = {0};
 
-    canvas_dbg("cmd getcolor: 0x%x\n", sizeof(cmd_getcolor));
-    canvas_dbg("xpos: 0x%x\n", cmd_getcolor.xpos);
-    canvas_dbg("ypos: 0x%x\n", cmd_getcolor.ypos);
+    canvas_dbg("cmd getcolor: 0x%x\n", sizeof(*cmd_getcolor));
+    canvas_dbg("xpos: 0x%x\n", cmd_getcolor->xpos);
+    canvas_dbg("ypos: 0x%x\n", cmd_getcolor->ypos);
 
     /* get color from framebuffer */
     fbscreen_get_pixel(
-        fbscreen, cmd_getcolor.xpos, cmd_getcolor.ypos, &ack_getcolor.color
+        fbscreen, cmd_getcolor->xpos, cmd_getcolor->ypos, &ack_getcolor.color
     );
 
     canvas_dbg("ack getcolor: 0x%x\n", sizeof(ack_getcolor));
     canvas_dbg("color: 0x%x\n", ack_getcolor.color);
 
     /* send acknowledge */
-    if (0 > (result = spidevice_write(
-        spidevice, (uint8_t*)&ack, sizeof(ack)
-    )))
-    {
-        return result;
-    }
+    return canvascmd_reply(
+        frame, CANVAS_ACK_GETCOLOR, &ack_getcolor, sizeof(ack_getcolor)
+    );
+}
 
-    /* send acknowledge data */
-    if (0 > (result = spidevice_write(
-        spidevice, (uint8_t*)&ack_getcolor, sizeof(ack_getcolor)
-    )))
+int32_t canvascmd_get_caps(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    struct ack_caps caps = {0};
+
+    caps.protocol_version = CANVAS_PROTOCOL_VERSION;
+    caps.max_frame_size = sizeof(uint8_t) + CANVASLINK_MAX_PAYLOAD;
+    caps.pixel_formats = CANVAS_PIXFMT_RGB565 | CANVAS_PIXFMT_RGB888 | CANVAS_PIXFMT_XRGB8888;
+    caps.features = CANVAS_FEATURE_TAGGED;
+    if (NULL != canvascmd_table[CANVAS_CMD_LAYER_CONFIG])
+        caps.features |= CANVAS_FEATURE_LAYERS;
+    if ((NULL != canvascmd_table[CANVAS_CMD_DRAW_ASSET]) && (NULL != fbscreen->assets))
+        caps.features |= CANVAS_FEATURE_ASSETS;
+    for (int i = 0; i < 256; i++)
     {
-        return result;
+        if (NULL != canvascmd_table[i])
+            caps.commands[i >> 3] |= 1 << (i & 0x7);
     }
 
-    return 0;
+    canvas_dbg("ack caps: 0x%x\n", sizeof(caps));
+    canvas_dbg("max frame: 0x%x\n", caps.max_frame_size);
+
+    return canvascmd_reply(
+        frame, CANVAS_ACK_GETCAPS, &caps, sizeof(caps)
+    );
+}
+
+int32_t canvascmd_get_stats(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_getstats *cmd_getstats = (const void*)frame->payload;
+    struct ack_stats ack_stats;
+
+    canvas_dbg("cmd getstats: 0x%x\n", sizeof(*cmd_getstats));
+    canvas_dbg("id: 0x%x\n", cmd_getstats->id);
+
+    /* unknown id still gets answer with link totals */
+    canvasstats_fill(&canvasstats, cmd_getstats->id, &ack_stats);
+
+    return canvascmd_reply(
+        frame, CANVAS_ACK_GETSTATS, &ack_stats, sizeof(ack_stats)
+    );
 }
 
 int32_t canvascmd_flush_drawing(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
 )
 {
     canvas_dbg("flush drawing:\n");
+
+    /* nothing was drawn since last present */
+    if (!fbscreen->dirty)
+    {
+        CANVASSTATS_ADD(canvasstats.frames_skipped, 1);
+        if (CANVASTIMELINE_ENABLED())
+            canvastimeline_skip(&fbscreen->timeline);
+        return 0;
+    }
+
+    /* newer frame is already received and this one would not make it to
+     * a refresh of its own, keep drawing into the same memory instead of
+     * blocking on vsync. Once per refresh period frame is presented even
+     * under continuous burst, so display latency stays bounded */
+    if (frame->flushes_queued && !fbscreen_present_due(fbscreen))
+    {
+        CANVASSTATS_ADD(canvasstats.frames_merged, 1);
+        return 0;
+    }
+
+    /* scene regions changed by all merged frames are painted once */
+    canvasscene_animate(fbscreen, canvasstats_now_ns());
+    canvasscene_render(fbscreen);
     fbscreen_flush_drawing(fbscreen);
     return 0;
 }
 
+int32_t canvascmd_copy_area(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_copy_area *cmd_copy = (const void*)frame->payload;
+
+    canvas_dbg("cmd copy area: 0x%x\n", sizeof(*cmd_copy));
+    canvas_dbg("source: %d %d\n", cmd_copy->xsrc, cmd_copy->ysrc);
+    canvas_dbg("size: %u %u\n", cmd_copy->width, cmd_copy->height);
+    canvas_dbg("destination: %d %d\n", cmd_copy->xdst, cmd_copy->ydst);
+
+    return fbscreen_copy_area(fbscreen, cmd_copy);
+}
+
+int32_t canvascmd_layer_config(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_layer_config *cmd_layer = (const void*)frame->payload;
+
+    canvas_dbg("cmd layer config: 0x%x\n", sizeof(*cmd_layer));
+    canvas_dbg("layer: 0x%x\n", cmd_layer->layer);
+    canvas_dbg("flags: 0x%x\n", cmd_layer->flags);
+
+    /* unknown layer is ignored, slave bug must not stop the daemon */
+    if (cmd_layer->layer >= CANVAS_LAYER_COUNT)
+        return 0;
+
+    return fbscreen_set_layer(
+        fbscreen, cmd_layer->layer, cmd_layer->flags, cmd_layer->key_color
+    );
+}
+
+int32_t canvascmd_layer_select(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_layer_select *cmd_layer = (const void*)frame->payload;
+
+    canvas_dbg("cmd layer select: 0x%x\n", cmd_layer->layer);
+
+    /* disabled or unknown layer keeps previous target */
+    fbscreen_select_layer(fbscreen, cmd_layer->layer);
+    return 0;
+}
+
+/* instance positions following shared attributes, oversized batch is
+ * never framed */
+uint32_t canvascmd_rect_batch_extra(
+    const void *payload
+)
+{
+    const struct cmd_rect_batch *cmd_batch = payload;
+
+    if (cmd_batch->count > CANVAS_BATCH_MAX)
+        return UINT32_MAX;
+    return cmd_batch->count * sizeof(struct cmd_batch_position);
+}
+
+int32_t canvascmd_rect_batch(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_rect_batch *cmd_batch = (const void*)frame->payload;
+
+    canvas_dbg("cmd rect batch: 0x%x\n", frame->size);
+    canvas_dbg("size: %u %u count: %u\n", cmd_batch->width, cmd_batch->height, cmd_batch->count);
+
+    fbscreen_rect_batch(fbscreen, cmd_batch, (const struct cmd_batch_position*)(cmd_batch + 1));
+    return 0;
+}
+
+uint32_t canvascmd_circle_batch_extra(
+    const void *payload
+)
+{
+    const struct cmd_circle_batch *cmd_batch = payload;
+
+    if (cmd_batch->count > CANVAS_BATCH_MAX)
+        return UINT32_MAX;
+    return cmd_batch->count * sizeof(struct cmd_batch_position);
+}
+
+int32_t canvascmd_circle_batch(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_circle_batch *cmd_batch = (const void*)frame->payload;
+
+    canvas_dbg("cmd circle batch: 0x%x\n", frame->size);
+    canvas_dbg("radius: %u count: %u\n", cmd_batch->radius, cmd_batch->count);
+
+    /* radius longer than screen size is not drawn */
+    fbscreen_circle_batch(fbscreen, cmd_batch, (const struct cmd_batch_position*)(cmd_batch + 1));
+    return 0;
+}
+
+/* samples following push attributes, oversized push is never framed */
+uint32_t canvascmd_chart_push_extra(
+    const void *payload
+)
+{
+    const struct cmd_chart_push *cmd_push = payload;
+
+    if (cmd_push->count > CANVAS_CHART_MAX_SAMPLES)
+        return UINT32_MAX;
+    return cmd_push->count * sizeof(int16_t);
+}
+
+int32_t canvascmd_chart_config(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_chart_config *cmd_chart = (const void*)frame->payload;
+
+    canvas_dbg("cmd chart config: 0x%x\n", sizeof(*cmd_chart));
+    canvas_dbg("chart: 0x%x\n", cmd_chart->chart);
+    canvas_dbg("region: %d %d %u %u\n", cmd_chart->xpos, cmd_chart->ypos,
+        cmd_chart->width, cmd_chart->height);
+
+    /* unknown chart or invalid range is ignored */
+    fbscreen_chart_config(fbscreen, cmd_chart);
+    return 0;
+}
+
+int32_t canvascmd_chart_push(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_chart_push *cmd_push = (const void*)frame->payload;
+
+    canvas_dbg("cmd chart push: 0x%x\n", frame->size);
+    canvas_dbg("chart: 0x%x count: %u\n", cmd_push->chart, cmd_push->count);
+
+    /* samples are 16bit, aligned behind 32bit attributes */
+    fbscreen_chart_push(
+        fbscreen, cmd_push->chart, (const int16_t*)(cmd_push + 1), cmd_push->count
+    );
+    return 0;
+}
+
+/* pixel data following upload attributes */
+uint32_t canvascmd_put_pixels_extra(
+    const void *payload
+)
+{
+    const struct cmd_put_pixels *cmd_put = payload;
+
+    return cmd_put->size;
+}
+
+int32_t canvascmd_put_pixels(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_put_pixels *cmd_put = (const void*)frame->payload;
+
+    canvas_dbg("cmd put pixels: 0x%x\n", frame->size);
+    canvas_dbg("image: %d %d %u %u\n", cmd_put->xpos, cmd_put->ypos,
+        cmd_put->width, cmd_put->height);
+    canvas_dbg("chunk: %u %u\n", cmd_put->offset, cmd_put->size);
+
+    return fbscreen_put_pixels(fbscreen, cmd_put, (const uint8_t*)(cmd_put + 1));
+}
+
+/* colors following palette attributes */
+uint32_t canvascmd_set_palette_extra(
+    const void *payload
+)
+{
+    const struct cmd_set_palette *cmd_palette = payload;
+
+    if (cmd_palette->count > CANVAS_PALETTE_SIZE)
+        return UINT32_MAX;
+    return cmd_palette->count * sizeof(uint32_t);
+}
+
+int32_t canvascmd_set_palette(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_set_palette *cmd_palette = (const void*)frame->payload;
+
+    canvas_dbg("cmd set palette: 0x%x\n", frame->size);
+    canvas_dbg("first: %u count: %u\n", cmd_palette->first, cmd_palette->count);
+
+    return fbscreen_set_palette(
+        fbscreen, cmd_palette->first, (const uint32_t*)(cmd_palette + 1), cmd_palette->count
+    );
+}
+
+/* packed indices following upload attributes */
+uint32_t canvascmd_put_indexed_extra(
+    const void *payload
+)
+{
+    const struct cmd_put_indexed *cmd_put = payload;
+
+    return cmd_put->size;
+}
+
+int32_t canvascmd_put_indexed(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_put_indexed *cmd_put = (const void*)frame->payload;
+
+    canvas_dbg("cmd put indexed: 0x%x\n", frame->size);
+    canvas_dbg("image: %d %d %u %u\n", cmd_put->xpos, cmd_put->ypos,
+        cmd_put->width, cmd_put->height);
+    canvas_dbg("chunk: %u %u depth: %u\n", cmd_put->offset, cmd_put->size, cmd_put->depth);
+
+    /* unsupported depth is ignored */
+    fbscreen_put_indexed(fbscreen, cmd_put, (const uint8_t*)(cmd_put + 1));
+    return 0;
+}
+
+/* compressed data following image attributes */
+uint32_t canvascmd_put_image_extra(
+    const void *payload
+)
+{
+    const struct cmd_put_image *cmd_put = payload;
+
+    return cmd_put->size;
+}
+
+int32_t canvascmd_put_image(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_put_image *cmd_put = (const void*)frame->payload;
+
+    canvas_dbg("cmd put image: 0x%x\n", frame->size);
+    canvas_dbg("position: %d %d flags: 0x%x\n", cmd_put->xpos, cmd_put->ypos, cmd_put->flags);
+
+    /* broken stream drops the rest of image until next begin */
+    fbscreen_put_image(fbscreen, cmd_put, (const uint8_t*)(cmd_put + 1));
+    return 0;
+}
+
+int32_t canvascmd_draw_asset(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_draw_asset *cmd_draw = (const void*)frame->payload;
+
+    canvas_dbg("cmd draw asset: 0x%x\n", cmd_draw->id);
+    canvas_dbg("position: %d %d\n", cmd_draw->xpos, cmd_draw->ypos);
+
+    /* missing asset is not drawn, pack may be older than slave */
+    fbscreen_draw_asset(fbscreen, cmd_draw);
+    return 0;
+}
+
+int32_t canvascmd_asset_palette(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_asset_palette *cmd_palette = (const void*)frame->payload;
+
+    canvas_dbg("cmd asset palette: 0x%x\n", cmd_palette->id);
+
+    fbscreen_asset_palette(fbscreen, cmd_palette->id);
+    return 0;
+}
+
+int32_t canvascmd_scene_config(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_scene_config *cmd_config = (const void*)frame->payload;
+
+    canvas_dbg("cmd scene config: 0x%x\n", sizeof(*cmd_config));
+    canvas_dbg("layer: 0x%x background: 0x%x\n", cmd_config->layer, cmd_config->background);
+
+    /* unknown layer is ignored */
+    canvasscene_config(fbscreen, cmd_config);
+    return 0;
+}
+
+int32_t canvascmd_scene_create(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_scene_create *cmd_create = (const void*)frame->payload;
+
+    canvas_dbg("cmd scene create: 0x%x\n", cmd_create->id);
+    canvas_dbg("type: %u box: %d %d %u %u\n", cmd_create->type, cmd_create->xpos,
+        cmd_create->ypos, cmd_create->width, cmd_create->height);
+
+    /* unknown id or type is ignored */
+    canvasscene_create(fbscreen, cmd_create);
+    return 0;
+}
+
+/* one 32bit value per property in mask */
+uint32_t canvascmd_scene_update_extra(
+    const void *payload
+)
+{
+    const struct cmd_scene_update *cmd_update = payload;
+
+    return __builtin_popcount(cmd_update->mask) * sizeof(int32_t);
+}
+
+int32_t canvascmd_scene_update(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_scene_update *cmd_update = (const void*)frame->payload;
+
+    canvas_dbg("cmd scene update: 0x%x\n", cmd_update->id);
+    canvas_dbg("mask: 0x%x\n", cmd_update->mask);
+
+    /* update of object never created is ignored */
+    canvasscene_update(
+        fbscreen, cmd_update->id, cmd_update->mask, (const int32_t*)(cmd_update + 1)
+    );
+    return 0;
+}
+
+/* characters following text attributes, longer text is never framed */
+uint32_t canvascmd_scene_text_extra(
+    const void *payload
+)
+{
+    const struct cmd_scene_text *cmd_text = payload;
+
+    if (cmd_text->length > CANVAS_SCENE_TEXT_SIZE)
+        return UINT32_MAX;
+    return cmd_text->length;
+}
+
+int32_t canvascmd_scene_text(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_scene_text *cmd_text = (const void*)frame->payload;
+
+    canvas_dbg("cmd scene text: 0x%x\n", cmd_text->id);
+    canvas_dbg("length: %u\n", cmd_text->length);
+
+    canvasscene_text(fbscreen, cmd_text->id, (const char*)(cmd_text + 1), cmd_text->length);
+    return 0;
+}
+
+int32_t canvascmd_scene_delete(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_scene_delete *cmd_delete = (const void*)frame->payload;
+
+    canvas_dbg("cmd scene delete: 0x%x\n", cmd_delete->id);
+
+    canvasscene_delete(fbscreen, cmd_delete->id);
+    return 0;
+}
+
+int32_t canvascmd_animate(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+)
+{
+    const struct cmd_animate *cmd_animate = (const void*)frame->payload;
+
+    canvas_dbg("cmd animate: 0x%x\n", cmd_animate->id);
+    canvas_dbg("property: 0x%x values: %d %d\n", cmd_animate->property,
+        cmd_animate->start, cmd_animate->end);
+    canvas_dbg("duration: %u ms easing: %u\n", cmd_animate->duration_ms, cmd_animate->easing);
+
+    /* nothing is drawn until frame, unknown object or property is ignored */
+    canvasscene_start_animation(fbscreen, cmd_animate, frame->replies, canvasstats_now_ns());
+    return 0;
+}
+
 int32_t canvascmd_do_nothing(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
 )
 {
     canvas_dbg("cmd do nothing \n");
@@ -24,42 +24,241 @@
 #define __CANVASCMD_H__
 
 #include <stdint.h>
-#include "spidevice.h"
 #include "fbscreen.h"
+#include "canvasqueue.h"
+
+/* command answers the slave, legacy untagged query is answered
+ * synchronously before the bus is clocked again */
+#define CANVASCMD_FLAG_QUERY            (1 << 0)
+/* command modifies drawing memory, frame has to be presented */
+#define CANVASCMD_FLAG_DRAW             (1 << 1)
+
+/* largest fixed part of variable length command */
+#define CANVASCMD_HEADER_MAX            (64)
+
+/* received command as handed to 'cmd_exec' */
+struct canvascmd_frame {
+    uint8_t cmd_code;
+    uint8_t tagged;
+    uint32_t tag;
+    /* attributes in receive buffer */
+    const uint8_t *payload;
+    uint32_t size;
+    /* where acknowledges go */
+    struct canvasqueue *replies;
+    /* flushes received after this command and not executed yet */
+    uint32_t flushes_queued;
+    /* slave frame of the command and its receive time, while tracing */
+    uint32_t seq;
+    uint64_t received_ns;
+};
 
 struct canvascmd {
     uint8_t cmd_code;
-    int32_t (*cmd_exec)(struct fbscreen *fbscreen, struct spidevice *spidevice);
+    int32_t (*cmd_exec)(struct fbscreen *fbscreen, const struct canvascmd_frame *frame);
+    /* size of attributes following command code */
+    uint32_t payload_size;
+    uint32_t flags;
+    /* variable length command, bytes following 'payload_size'
+     * fixed attributes as told by them, UINT32_MAX when they
+     * cannot be told (count out of range) */
+    uint32_t (*payload_extra)(const void *payload);
 };
 
+int32_t canvascmd_init(
+    const struct canvascmd *commands
+);
+
+const struct canvascmd *canvascmd_lookup(
+    const uint8_t cmd_code
+);
+
+int32_t canvascmd_exec(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_reply(
+    const struct canvascmd_frame *frame,
+    const uint8_t ack_code,
+    const void *data,
+    const uint32_t size
+);
+
 int32_t canvascmd_draw_circle(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
 );
 
 int32_t canvascmd_draw_rectangle(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_copy_area(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+uint32_t canvascmd_chart_push_extra(
+    const void *payload
+);
+
+uint32_t canvascmd_rect_batch_extra(
+    const void *payload
+);
+
+int32_t canvascmd_rect_batch(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+uint32_t canvascmd_circle_batch_extra(
+    const void *payload
+);
+
+int32_t canvascmd_circle_batch(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_chart_config(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_chart_push(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+uint32_t canvascmd_put_pixels_extra(
+    const void *payload
+);
+
+int32_t canvascmd_put_pixels(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+uint32_t canvascmd_set_palette_extra(
+    const void *payload
+);
+
+int32_t canvascmd_set_palette(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+uint32_t canvascmd_put_indexed_extra(
+    const void *payload
+);
+
+int32_t canvascmd_put_indexed(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+uint32_t canvascmd_put_image_extra(
+    const void *payload
+);
+
+int32_t canvascmd_put_image(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_draw_asset(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_asset_palette(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_scene_config(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_scene_create(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+uint32_t canvascmd_scene_update_extra(
+    const void *payload
+);
+
+int32_t canvascmd_scene_update(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+uint32_t canvascmd_scene_text_extra(
+    const void *payload
+);
+
+int32_t canvascmd_scene_text(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_scene_delete(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_animate(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
 );
 
 int32_t canvascmd_get_dimension(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_get_color(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_get_caps(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_get_stats(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
 );
 
 int32_t canvascmd_clear_screen(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
 );
 
 int32_t canvascmd_flush_drawing(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_layer_config(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
+);
+
+int32_t canvascmd_layer_select(
+    struct fbscreen *fbscreen,
+    const struct canvascmd_frame *frame
 );
 
 int32_t canvascmd_do_nothing(
     struct fbscreen *fbscreen,
-    struct spidevice *spidevice
+    const struct canvascmd_frame *frame
 );
 
 #endif
@@ -0,0 +1,444 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "config.h"
+#include "canvasdisplay.h"
+#include "canvassnap.h"
+
+/* longest line of display config file */
+#define CANVASDISPLAY_LINE_SIZE     (1024)
+
+void canvasdisplay_config_init(
+    struct canvasdisplay_config *config
+)
+{
+    assert(!(NULL == config));
+    if (NULL == config)
+        return;
+
+    memset(config, 0, sizeof(*config));
+    config->ready_fd = -1;
+}
+
+/* one "key=value" or "flag" item of display spec */
+static int32_t canvasdisplay_parse_item(
+    struct canvasdisplay_config *config,
+    char *key,
+    const char *value
+)
+{
+    if (0 == strcmp(key, "single-buffer"))
+        config->single_buffer = 1;
+    else if (0 == strcmp(key, "warm"))
+        config->warm_start = 1;
+    else if (0 == strcmp(key, "fast"))
+        config->replay_fast = 1;
+    else if (0 == strcmp(key, "active-low"))
+        config->ready_active_low = 1;
+    /* all other items have value */
+    else if (NULL == value)
+        return -1;
+    else if (0 == strcmp(key, "fb"))
+        strncpy(config->fb_path, value, CANVASDISPLAY_PATH_SIZE);
+    else if (0 == strcmp(key, "headless"))
+    {
+        if (2 != sscanf(value, "%ux%u", &config->headless_xres, &config->headless_yres))
+            return -1;
+    }
+    else if (0 == strcmp(key, "refresh"))
+        config->refresh_hz = atoi(value);
+    else if (0 == strcmp(key, "rotate"))
+    {
+        config->rotation = atoi(value);
+        if ((config->rotation % 90) || (config->rotation >= 360))
+            return -1;
+    }
+    else if (0 == strcmp(key, "snapshot"))
+        strncpy(config->snapshot_path, value, CANVASDISPLAY_PATH_SIZE);
+    else if (0 == strcmp(key, "assets"))
+        strncpy(config->asset_path, value, CANVASDISPLAY_PATH_SIZE);
+    else if (0 == strcmp(key, "spi"))
+        strncpy(config->spidev_path, value, CANVASDISPLAY_PATH_SIZE);
+    else if (0 == strcmp(key, "baud"))
+        config->baudrate = atoi(value);
+    else if (0 == strcmp(key, "record"))
+        strncpy(config->record_path, value, CANVASDISPLAY_PATH_SIZE);
+    else if (0 == strcmp(key, "replay"))
+        strncpy(config->replay_path, value, CANVASDISPLAY_PATH_SIZE);
+    else if (0 == strcmp(key, "gpio"))
+    {
+        /* CHIP:LINE, e.g. /dev/gpiochip0:17 */
+        const char *separator = strrchr(value, ':');
+        size_t length;
+        if (NULL == separator)
+            return -1;
+        length = separator - value;
+        length = length > CANVASDISPLAY_PATH_SIZE ? CANVASDISPLAY_PATH_SIZE : length;
+        memcpy(config->ready_chip_path, value, length);
+        config->ready_chip_path[length] = '\0';
+        config->ready_line = atoi(separator + 1);
+    }
+    else if (0 == strcmp(key, "ready-fd"))
+        config->ready_fd = atoi(value);
+    else if (0 == strcmp(key, "idle"))
+        config->idle_ms = atoi(value);
+    else if (0 == strcmp(key, "local"))
+        strncpy(config->local_path, value, CANVASDISPLAY_PATH_SIZE);
+    else
+        return -1;
+    return 0;
+}
+
+/* comma separated items, e.g. "fb=/dev/fb1,spi=/dev/spidev1.0,baud=400000".
+ * Items set only fields they name, so spec can extend CLI defaults */
+int32_t canvasdisplay_parse(
+    struct canvasdisplay_config *config,
+    const char *spec
+)
+{
+    char buffer[CANVASDISPLAY_LINE_SIZE];
+    char *item, *value, *end, *saveptr;
+
+    assert(!(NULL == config || NULL == spec));
+    if (NULL == config || NULL == spec)
+        return -1;
+
+    if (strlen(spec) >= sizeof(buffer))
+        return -1;
+    strcpy(buffer, spec);
+
+    for (item = strtok_r(buffer, ",", &saveptr); NULL != item; item = strtok_r(NULL, ",", &saveptr))
+    {
+        while (isspace((unsigned char)*item))
+            item++;
+        end = item + strlen(item);
+        while ((end > item) && isspace((unsigned char)end[-1]))
+            *--end = '\0';
+        if ('\0' == *item)
+            continue;
+        value = strchr(item, '=');
+        if (NULL != value)
+            *value++ = '\0';
+        if (0 > canvasdisplay_parse_item(config, item, value))
+        {
+            fprintf(stderr, "unknown display item '%s'\n", item);
+            return -1;
+        }
+    }
+
+    /* display without screen cannot be driven */
+    if ('\0' == config->fb_path[0] && !(config->headless_xres && config->headless_yres))
+        return -1;
+    return 0;
+}
+
+/* config file, one display spec per line, '#' starts comment.
+ * Returns number of displays read */
+int32_t canvasdisplay_load(
+    const char *path,
+    struct canvasdisplay_config *configs,
+    const uint32_t max
+)
+{
+    char line[CANVASDISPLAY_LINE_SIZE];
+    uint32_t line_number = 0;
+    int32_t count = 0;
+    char *comment;
+    FILE *file;
+
+    assert(!(NULL == path || NULL == configs));
+    if (NULL == path || NULL == configs)
+        return -1;
+
+    file = fopen(path, "r");
+    if (NULL == file)
+        return -1;
+
+    while (NULL != fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        comment = strchr(line, '#');
+        if (NULL != comment)
+            *comment = '\0';
+        line[strcspn(line, "\r\n")] = '\0';
+        if ('\0' == line[strspn(line, " \t")])
+            continue;
+
+        if ((uint32_t)count >= max)
+        {
+            fprintf(stderr, "%s:%u: more than %u displays\n", path, line_number, max);
+            count = -1;
+            break;
+        }
+        canvasdisplay_config_init(&configs[count]);
+        if (0 > canvasdisplay_parse(&configs[count], line))
+        {
+            fprintf(stderr, "%s:%u: bad display spec\n", path, line_number);
+            count = -1;
+            break;
+        }
+        count++;
+    }
+
+    fclose(file);
+    return count;
+}
+
+/* screen of display, picture is restored from snapshot */
+static int32_t canvasdisplay_init_screen(
+    struct canvasdisplay *display
+)
+{
+    const struct canvasdisplay_config *config = &display->config;
+    int32_t result;
+
+    if (config->headless_xres && config->headless_yres)
+    {
+        result = fbscreen_init_headless(&display->fbscreen, config->headless_xres, config->headless_yres, 16);
+    }
+    else if (config->warm_start)
+    {
+        result = fbscreen_init_warm(&display->fbscreen, config->fb_path, 16);
+        display->warm_adopted = (1 == result);
+        printf("%s start\n", display->warm_adopted ? "warm" : "cold");
+    }
+    else
+    {
+        result = fbscreen_init(&display->fbscreen, config->fb_path, 16);
+    }
+    if (0 > result)
+    {
+        fprintf(stderr, "cannot initialize framebuffer '%s', error %d\n", config->fb_path, result);
+        return -1;
+    }
+
+    /* optional - portrait mounted panel, before anything is drawn */
+    if (config->rotation)
+    {
+        result = fbscreen_init_rotation(&display->fbscreen, config->rotation);
+        if (0 > result)
+        {
+            fprintf(stderr, "cannot rotate screen by %u, error %d\n", config->rotation, result);
+            return -1;
+        }
+    }
+
+    /* optional - artwork which slave does not have to send */
+    if ('\0' != config->asset_path[0])
+    {
+        result = canvasasset_open(&display->assets, config->asset_path);
+        if (0 > result)
+        {
+            fprintf(stderr, "cannot open asset pack '%s', error %d\n", config->asset_path, result);
+            return -1;
+        }
+        if (display->assets.header->bits_per_pixel != display->fbscreen.var_info.bits_per_pixel)
+        {
+            fprintf(stderr, "asset pack '%s' is for %u bpp screen\n",
+                config->asset_path, display->assets.header->bits_per_pixel);
+            return -1;
+        }
+        display->fbscreen.assets = &display->assets;
+        printf("%u assets in '%s'\n", display->assets.header->count, config->asset_path);
+    }
+
+    /* optional - restore what previous instance saved, framebuffer
+     * picture is already there when warm start adopted it */
+    if ('\0' != config->snapshot_path[0])
+    {
+        int32_t restored = canvassnap_restore(
+            config->snapshot_path, &display->fbscreen, display->warm_adopted ? CANVASSNAP_SKIP_SCREEN : 0
+        );
+        if (restored >= 0)
+            printf("restored %d sections of snapshot '%s'\n", restored, config->snapshot_path);
+    }
+    if (config->refresh_hz)
+    {
+        display->fbscreen.frame_period_ns = 1000000000ULL / config->refresh_hz;
+    }
+    if (config->single_buffer)
+    {
+        result = fbscreen_init_single_buffer(&display->fbscreen);
+        if (0 > result)
+        {
+            fprintf(stderr, "cannot enable single buffer mode, error %d\n", result);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* spidev (optionally recorded, with data-ready line) or replayed trace */
+static int32_t canvasdisplay_init_transport(
+    struct canvasdisplay *display
+)
+{
+    struct canvasdisplay_config *config = &display->config;
+    int32_t result;
+
+    if ('\0' != config->replay_path[0])
+    {
+        /* replay recorded command stream instead of spi device */
+        result = canvastrace_replay_init(&display->trace, config->replay_path, config->replay_fast);
+        if (0 > result)
+        {
+            fprintf(stderr, "cannot open trace '%s', error %d\n", config->replay_path, result);
+            return -1;
+        }
+        canvastrace_attach(&display->trace, &display->spidevice);
+        return canvaslink_init(&display->link, &display->spidevice, NULL, NULL);
+    }
+
+    /* initialize spi device */
+    result = spidevice_init(&display->spidevice, config->spidev_path, config->baudrate);
+    if (0 > result)
+    {
+        fprintf(stderr, "cannot initialize spi device '%s', error %d\n", config->spidev_path, result);
+        return -1;
+    }
+
+    /* optional - record what slave sends */
+    if ('\0' != config->record_path[0])
+    {
+        result = canvastrace_record_init(&display->trace, config->record_path);
+        if (0 > result)
+        {
+            fprintf(stderr, "cannot create trace '%s', error %d\n", config->record_path, result);
+            return -1;
+        }
+        canvastrace_attach(&display->trace, &display->spidevice);
+    }
+
+    /* optional - sleep until slave has data */
+    if ('\0' != config->ready_chip_path[0] || config->ready_fd >= 0)
+    {
+        if (0 == config->idle_ms)
+            config->idle_ms = DATAREADY_IDLE_MS_DEFAULT;
+        if ('\0' != config->ready_chip_path[0])
+        {
+            result = dataready_init_gpio(
+                &display->dataready, config->ready_chip_path, config->ready_line,
+                config->ready_active_low, config->idle_ms
+            );
+        }
+        else
+        {
+            result = dataready_init_fd(&display->dataready, config->ready_fd, config->idle_ms);
+        }
+        if (0 > result)
+        {
+            fprintf(stderr, "cannot initialize data-ready line '%s:%d', error %d\n",
+                config->ready_chip_path, config->ready_line, result);
+            return -1;
+        }
+    }
+    else
+    {
+        display->dataready.idle_ms = config->idle_ms;
+    }
+
+    return canvaslink_init(&display->link, &display->spidevice, &display->dataready,
+        '\0' != config->record_path[0] ? &display->trace : NULL);
+}
+
+/* bring up screen and transport, receive thread is started by
+ * canvaslink_start. On error display must be still deinitialized */
+int32_t canvasdisplay_init(
+    struct canvasdisplay *display,
+    const struct canvasdisplay_config *config
+)
+{
+    int32_t result;
+
+    assert(!(NULL == display || NULL == config));
+    if (NULL == display || NULL == config)
+        return -1;
+
+    /* everything owned is released by canvasdisplay_deinit */
+    memset(display, 0, sizeof(*display));
+    display->config = *config;
+    display->fbscreen.fb_fd = -1;
+    display->fbscreen.present_request_fd = -1;
+    display->fbscreen.present_done_fd = -1;
+    display->spidevice.fd = -1;
+    display->trace.fd = -1;
+    display->dataready.fd = -1;
+    display->local.fd = -1;
+
+    result = canvasdisplay_init_screen(display);
+    if (0 > result)
+        return -1;
+
+    result = canvasdisplay_init_transport(display);
+    if (0 > result)
+        return -1;
+    display->link_ready = 1;
+    display->link.timeline = &display->fbscreen.timeline;
+
+    if ('\0' != config->local_path[0])
+    {
+        if (0 > canvaslocal_start(&display->local, config->local_path, &display->fbscreen))
+        {
+            fprintf(stderr, "cannot listen for local clients on '%s'\n", config->local_path);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int32_t canvasdisplay_deinit(
+    struct canvasdisplay *display,
+    const uint32_t save_snapshot
+)
+{
+    int32_t result = 0;
+
+    if (NULL == display)
+        return -1;
+
+    /* last flip must land in memory saved */
+    fbscreen_deinit_presenter(&display->fbscreen);
+    if (save_snapshot && ('\0' != display->config.snapshot_path[0]) && (NULL != display->fbscreen.fb_mem))
+    {
+        result = canvassnap_save(display->config.snapshot_path, &display->fbscreen);
+        if (0 > result)
+            fprintf(stderr, "cannot save snapshot '%s'\n", display->config.snapshot_path);
+    }
+
+    canvaslocal_stop(&display->local);
+    if (display->link_ready)
+        canvaslink_deinit(&display->link);
+    display->link_ready = 0;
+    dataready_deinit(&display->dataready);
+    canvastrace_deinit(&display->trace);
+    spidevice_deinit(&display->spidevice);
+    fbscreen_deinit(&display->fbscreen);
+    canvasasset_close(&display->assets);
+    return result < 0 ? -1 : 0;
+}
@@ -0,0 +1,114 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+#ifndef __CANVASDISPLAY_H__
+#define __CANVASDISPLAY_H__
+
+#include <stdint.h>
+#include "fbscreen.h"
+#include "spidevice.h"
+#include "canvastrace.h"
+#include "dataready.h"
+#include "canvaslink.h"
+#include "canvascmd.h"
+#include "canvaslocal.h"
+
+#define CANVASDISPLAY_PATH_SIZE     (256)
+/* displays driven by one daemon */
+#define CANVASDISPLAY_MAX           (4)
+
+/* what one (transport, screen) pair is made of, either from CLI
+ * options or from "key=value,..." spec, see canvasdisplay_parse */
+struct canvasdisplay_config {
+    /* screen, framebuffer device or memory of WIDTHxHEIGHT */
+    char fb_path[CANVASDISPLAY_PATH_SIZE + 1];
+    uint32_t headless_xres;
+    uint32_t headless_yres;
+    uint32_t refresh_hz;
+    /* clockwise degrees panel is mounted at, slave draws upright */
+    uint32_t rotation;
+    uint32_t single_buffer;
+    uint32_t warm_start;
+    char snapshot_path[CANVASDISPLAY_PATH_SIZE + 1];
+    char asset_path[CANVASDISPLAY_PATH_SIZE + 1];
+    /* transport, spidev or replayed trace */
+    char spidev_path[CANVASDISPLAY_PATH_SIZE + 1];
+    uint32_t baudrate;
+    char record_path[CANVASDISPLAY_PATH_SIZE + 1];
+    char replay_path[CANVASDISPLAY_PATH_SIZE + 1];
+    uint32_t replay_fast;
+    /* slave data-ready line */
+    char ready_chip_path[CANVASDISPLAY_PATH_SIZE + 1];
+    uint32_t ready_line;
+    uint32_t ready_active_low;
+    int32_t ready_fd;
+    int32_t idle_ms;
+    /* socket of local clients drawing into this screen */
+    char local_path[CANVASDISPLAY_PATH_SIZE + 1];
+};
+
+/* independent screen, transport and receive thread, all displays
+ * are served by single render loop */
+struct canvasdisplay {
+    struct canvasdisplay_config config;
+    struct fbscreen fbscreen;
+    struct spidevice spidevice;
+    struct canvastrace trace;
+    struct dataready dataready;
+    struct canvaslink link;
+    struct canvascmd_frame frame;
+    struct canvasasset assets;
+    struct canvaslocal local;
+    /* framebuffer kept from previous instance */
+    uint32_t warm_adopted;
+    uint32_t link_ready;
+    /* queue still open or not drained, render loop state */
+    uint32_t active;
+    uint32_t waiting;
+};
+
+void canvasdisplay_config_init(
+    struct canvasdisplay_config *config
+);
+
+int32_t canvasdisplay_parse(
+    struct canvasdisplay_config *config,
+    const char *spec
+);
+
+int32_t canvasdisplay_load(
+    const char *path,
+    struct canvasdisplay_config *configs,
+    const uint32_t max
+);
+
+int32_t canvasdisplay_init(
+    struct canvasdisplay *display,
+    const struct canvasdisplay_config *config
+);
+
+int32_t canvasdisplay_deinit(
+    struct canvasdisplay *display,
+    const uint32_t save_snapshot
+);
+
+#endif
@@ -0,0 +1,452 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "canvas_common.h"
+#include "spidevice.h"
+#include "canvascmd.h"
+#include "canvaslink.h"
+#include "canvasstats.h"
+#include "canvasrt.h"
+
+#define CANVASLINK_RUNNING(link)        __atomic_load_n(&(link)->running, __ATOMIC_SEQ_CST)
+
+int32_t canvaslink_init(
+    struct canvaslink *link,
+    struct spidevice *spidevice,
+    struct dataready *dataready,
+    struct canvastrace *recorder
+)
+{
+    assert(!(NULL == link || NULL == spidevice));
+    if (NULL == link || NULL == spidevice)
+        return -1;
+
+    memset(link, 0, sizeof(*link));
+    link->spidevice = spidevice;
+    link->dataready = dataready;
+    link->recorder = recorder;
+
+    if (0 > canvasqueue_init(&link->commands, CANVASLINK_COMMANDS_SIZE, CANVASLINK_MAX_PAYLOAD))
+        return -1;
+    if (0 > canvasqueue_init(&link->replies, CANVASLINK_REPLIES_SIZE, CANVASLINK_MAX_PAYLOAD))
+    {
+        canvasqueue_deinit(&link->commands);
+        return -1;
+    }
+
+    link->tx_buffer = malloc(CANVASLINK_TX_SIZE);
+    link->tx_scratch = malloc(CANVASLINK_MAX_PAYLOAD);
+    if (NULL == link->tx_buffer || NULL == link->tx_scratch)
+    {
+        canvaslink_deinit(link);
+        return -1;
+    }
+    link->credits_advertised = canvasqueue_credit_limit(&link->commands);
+    return 0;
+}
+
+int32_t canvaslink_deinit(
+    struct canvaslink *link
+)
+{
+    if (NULL == link)
+        return -1;
+
+    canvasqueue_deinit(&link->commands);
+    canvasqueue_deinit(&link->replies);
+    free(link->tx_buffer);
+    free(link->tx_scratch);
+    link->tx_buffer = NULL;
+    link->tx_scratch = NULL;
+    return 0;
+}
+
+/* move next acknowledge (or credit update) into transmit buffer */
+static int32_t canvaslink_load_reply(
+    struct canvaslink *link,
+    const int32_t timeout_ms
+)
+{
+    struct canvasqueue_entry *entry;
+    uint32_t credits = canvasqueue_credit_limit(&link->commands);
+    int32_t tagged = 0;
+
+    link->tx_pos = 0;
+    link->tx_size = 0;
+
+    entry = canvasqueue_peek(&link->replies, timeout_ms);
+    if (NULL != entry)
+    {
+        if (entry->flags & CANVASQUEUE_FLAG_TAGGED)
+        {
+            struct ack_tagged ack_tagged = {
+                .tag = entry->tag,
+                .credits = credits,
+                .ack_code = entry->cmd_code,
+                .size = entry->size,
+            };
+            link->tx_buffer[link->tx_size++] = CANVAS_ACK_TAGGED;
+            memcpy(link->tx_buffer + link->tx_size, &ack_tagged, sizeof(ack_tagged));
+            link->tx_size += sizeof(ack_tagged);
+            link->credits_advertised = credits;
+            tagged = 1;
+        }
+        else
+        {
+            link->tx_buffer[link->tx_size++] = entry->cmd_code;
+        }
+        memcpy(link->tx_buffer + link->tx_size, CANVASQUEUE_PAYLOAD(entry), entry->size);
+        link->tx_size += entry->size;
+        canvasqueue_release(&link->replies, entry);
+        return tagged ? 2 : 1;
+    }
+
+    /* slave which uses flow control needs to learn about drained queue */
+    if (link->tagged_seen && (credits - link->credits_advertised >= CANVASLINK_CREDITS_STEP))
+    {
+        struct ack_credits ack_credits = { .credits = credits };
+        link->tx_buffer[link->tx_size++] = CANVAS_ACK_CREDITS;
+        memcpy(link->tx_buffer + link->tx_size, &ack_credits, sizeof(ack_credits));
+        link->tx_size += sizeof(ack_credits);
+        link->credits_advertised = credits;
+        return 2;
+    }
+    return 0;
+}
+
+/* read from slave, pending acknowledge is clocked out at the same time */
+static int32_t canvaslink_read(
+    struct canvaslink *link,
+    uint8_t *buffer,
+    const uint32_t size
+)
+{
+    struct spi_ioc_transfer message = {
+        .rx_buf = (uintptr_t)buffer,
+        .len = size,
+        .bits_per_word = 8,
+    };
+    uint32_t chunk;
+    int32_t result;
+
+    CANVASSTATS_ADD(canvasstats.rx_bytes, size);
+    if (link->tx_pos == link->tx_size)
+        canvaslink_load_reply(link, 0);
+    if (link->tx_pos == link->tx_size)
+        return spidevice_read(link->spidevice, buffer, size);
+
+    /* rest of the clocked bytes is idle 0xFF */
+    chunk = link->tx_size - link->tx_pos;
+    chunk = chunk < size ? chunk : size;
+    memcpy(link->tx_scratch, link->tx_buffer + link->tx_pos, chunk);
+    memset(link->tx_scratch + chunk, CANVAS_ACK_DUMMY, size - chunk);
+    message.tx_buf = (uintptr_t)link->tx_scratch;
+
+    if (0 > (result = spidevice_transfer(link->spidevice, &message)))
+        return result;
+    link->tx_pos += chunk;
+    return 0;
+}
+
+/* send what is left in transmit buffer, slave is not sending */
+static int32_t canvaslink_flush(
+    struct canvaslink *link
+)
+{
+    int32_t result = 0;
+
+    if (link->tx_pos < link->tx_size)
+    {
+        result = spidevice_write(
+            link->spidevice, link->tx_buffer + link->tx_pos, link->tx_size - link->tx_pos
+        );
+        link->tx_pos = link->tx_size;
+    }
+    return result;
+}
+
+/* legacy query, slave waits for answer before it clocks anything else */
+static int32_t canvaslink_answer(
+    struct canvaslink *link
+)
+{
+    int32_t result;
+
+    if (0 > (result = canvaslink_flush(link)))
+        return result;
+
+    /* tagged answers queued before the legacy one go first */
+    while (CANVASLINK_RUNNING(link))
+    {
+        result = canvaslink_load_reply(link, -1);
+        if (0 > canvaslink_flush(link))
+            return -1;
+        /* untagged answer is out */
+        if (1 == result)
+            return 0;
+        if ((0 == result) && canvasqueue_is_closed(&link->replies))
+            break;
+    }
+    return 0;
+}
+
+/* read and drop 'size' bytes of command which is not executed */
+static int32_t canvaslink_discard(
+    struct canvaslink *link,
+    uint64_t size
+)
+{
+    uint8_t buffer[256];
+    uint32_t chunk;
+    int32_t result;
+
+    while (size)
+    {
+        chunk = size < sizeof(buffer) ? size : sizeof(buffer);
+        if (0 > (result = canvaslink_read(link, buffer, chunk)))
+            return result;
+        size -= chunk;
+    }
+    return 0;
+}
+
+/* frame single command into 'commands' queue */
+static int32_t canvaslink_receive(
+    struct canvaslink *link,
+    uint8_t cmd_code
+)
+{
+    const struct canvascmd *command;
+    struct canvasqueue_entry *entry;
+    struct cmd_tagged cmd_tagged = {0};
+    uint32_t header[CANVASCMD_HEADER_MAX / sizeof(uint32_t)];
+    uint64_t extra = 0;
+    uint64_t received_ns = 0;
+    uint32_t seq;
+    uint8_t tagged = 0;
+    int32_t result;
+
+    /* first command of frame, stamped before the bus is clocked for it */
+    if (CANVASTIMELINE_ENABLED() && !link->frame_open)
+        received_ns = canvasstats_now_ns();
+
+    if (CANVAS_CMD_TAGGED == cmd_code)
+    {
+        if (0 > (result = canvaslink_read(link, (uint8_t*)&cmd_tagged, sizeof(cmd_tagged))))
+            return result;
+        if (0 > (result = canvaslink_read(link, &cmd_code, sizeof(cmd_code))))
+            return result;
+        link->tagged_seen = 1;
+        tagged = 1;
+    }
+
+    /* unknown command is skipped as single byte */
+    command = canvascmd_lookup(cmd_code);
+    if ((NULL == command) || (CANVAS_CMD_DUMMY == cmd_code))
+        return 0;
+
+    /* variable length command, fixed attributes tell the rest */
+    if (NULL != command->payload_extra)
+    {
+        result = canvaslink_read(link, (uint8_t*)header, command->payload_size);
+        if (0 > result)
+            return result;
+        extra = command->payload_extra(header);
+        /* length cannot be told, rest of the stream cannot be framed */
+        if (UINT32_MAX == extra)
+            return -1;
+        /* oversized one is read and dropped, stream stays framed */
+        if (command->payload_size + extra > CANVASLINK_MAX_PAYLOAD)
+            return canvaslink_discard(link, extra);
+    }
+
+    /* blocks while renderer is behind, bus stays idle meanwhile */
+    entry = canvasqueue_reserve(&link->commands, command->payload_size + extra);
+    if (NULL == entry)
+        return -1;
+
+    if (NULL != command->payload_extra)
+    {
+        memcpy(CANVASQUEUE_PAYLOAD(entry), header, command->payload_size);
+        if (extra)
+        {
+            result = canvaslink_read(
+                link, CANVASQUEUE_PAYLOAD(entry) + command->payload_size, extra
+            );
+            if (0 > result)
+                return result;
+        }
+    }
+    else if (command->payload_size)
+    {
+        result = canvaslink_read(link, CANVASQUEUE_PAYLOAD(entry), command->payload_size);
+        if (0 > result)
+            return result;
+    }
+    entry->cmd_code = cmd_code;
+    entry->tag = cmd_tagged.tag;
+    entry->flags = tagged ? CANVASQUEUE_FLAG_TAGGED : 0;
+    seq = link->flushes_received;
+    if (received_ns)
+    {
+        link->frames_received_ns[seq & (CANVASLINK_FRAMES - 1)] = received_ns;
+        link->frame_open = 1;
+    }
+    /* renderer learns about queued frames before it reaches them */
+    if (CANVAS_CMD_FLUSH_DRAWING == cmd_code)
+    {
+        __atomic_fetch_add(&link->flushes_received, 1, __ATOMIC_RELAXED);
+        link->frame_open = 0;
+    }
+    canvasqueue_commit(&link->commands, entry);
+    CANVASSTATS_ADD(canvasstats.rx_commands, 1);
+    if (received_ns && (NULL != link->timeline))
+        canvastimeline_mark(link->timeline->id, seq, CANVASTIMELINE_RECEIVED);
+
+    if (!tagged && (command->flags & CANVASCMD_FLAG_QUERY))
+        return canvaslink_answer(link);
+    return 0;
+}
+
+static void *canvaslink_thread(
+    void *arg
+)
+{
+    struct canvaslink *link = arg;
+    uint8_t cmd_code;
+    int32_t result = 0;
+
+    if (NULL != link->rt)
+        canvasrt_apply(link->rt, "receive");
+
+    canvas_dbg("receive thread started \n");
+    while (CANVASLINK_RUNNING(link))
+    {
+        result = canvaslink_read(link, &cmd_code, sizeof(cmd_code));
+        if (0 > result)
+            break;
+        canvas_dbg("command code: 0x%x \n", cmd_code);
+
+        if (CANVAS_CMD_DUMMY == cmd_code)
+        {
+            /* keep clocking while acknowledge is going out */
+            if ((link->tx_pos < link->tx_size) || (NULL == link->dataready))
+                continue;
+            /* slave has nothing to say, do not spin on the bus */
+            if (canvasqueue_wait_begin(&link->replies))
+            {
+                dataready_wait(link->dataready, link->replies.data_fd);
+                canvasqueue_wait_end(&link->replies);
+            }
+            continue;
+        }
+
+        if (NULL != link->recorder)
+            canvastrace_record_begin(link->recorder, cmd_code);
+        result = canvaslink_receive(link, cmd_code);
+        if (NULL != link->recorder)
+            canvastrace_record_end(link->recorder);
+        if (0 > result)
+            break;
+    }
+
+    /* renderer drains what was received and stops */
+    link->result = (SPIDEVICE_EOF == result) ? 0 : result;
+    canvasqueue_close(&link->commands);
+    return NULL;
+}
+
+/* start receive thread, signals are left to the caller thread */
+int32_t canvaslink_start(
+    struct canvaslink *link
+)
+{
+    sigset_t sigset, sigset_old;
+    int32_t result;
+
+    assert(!(NULL == link));
+    if (NULL == link)
+        return -1;
+
+    link->running = 1;
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_BLOCK, &sigset, &sigset_old);
+    result = pthread_create(&link->thread, NULL, canvaslink_thread, link);
+    pthread_sigmask(SIG_SETMASK, &sigset_old, NULL);
+    if (0 != result)
+    {
+        link->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+int32_t canvaslink_stop(
+    struct canvaslink *link
+)
+{
+    assert(!(NULL == link));
+    if (NULL == link)
+        return -1;
+
+    if (!link->running)
+        return 0;
+
+    __atomic_store_n(&link->running, 0, __ATOMIC_SEQ_CST);
+    canvasqueue_close(&link->commands);
+    canvasqueue_close(&link->replies);
+    pthread_join(link->thread, NULL);
+    return link->result;
+}
+
+/* describe queue entry for dispatcher, called by renderer */
+void canvaslink_frame(
+    struct canvaslink *link,
+    const struct canvasqueue_entry *entry,
+    struct canvascmd_frame *frame
+)
+{
+    frame->seq = link->flushes_taken;
+    frame->received_ns = 0;
+    if (CANVASTIMELINE_ENABLED())
+        frame->received_ns = link->frames_received_ns[frame->seq & (CANVASLINK_FRAMES - 1)];
+    if (CANVAS_CMD_FLUSH_DRAWING == entry->cmd_code)
+        link->flushes_taken++;
+
+    frame->cmd_code = entry->cmd_code;
+    frame->tagged = (entry->flags & CANVASQUEUE_FLAG_TAGGED) ? 1 : 0;
+    frame->tag = entry->tag;
+    frame->payload = CANVASQUEUE_PAYLOAD(entry);
+    frame->size = entry->size;
+    frame->replies = &link->replies;
+    frame->flushes_queued =
+        __atomic_load_n(&link->flushes_received, __ATOMIC_RELAXED) - link->flushes_taken;
+}
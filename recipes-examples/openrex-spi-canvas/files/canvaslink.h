@@ -0,0 +1,112 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Link between slave and renderer. Receive thread owns the bus: it frames
+ * commands straight into 'commands' queue and sends acknowledges queued
+ * by handlers into 'replies'. Pending acknowledges and credit updates are
+ * clocked out on MOSI while command bytes are read from MISO.
+ */
+
+#ifndef __CANVASLINK_H__
+#define __CANVASLINK_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include "spidevice.h"
+#include "dataready.h"
+#include "canvastrace.h"
+#include "canvasqueue.h"
+#include "canvastimeline.h"
+
+/* largest attributes of single command */
+#define CANVASLINK_MAX_PAYLOAD          (4096)
+/* queue sizes, power of two */
+#define CANVASLINK_COMMANDS_SIZE        (64 * 1024)
+#define CANVASLINK_REPLIES_SIZE         (16 * 1024)
+/* advertise credits when limit moved by this since last time */
+#define CANVASLINK_CREDITS_STEP         (CANVASLINK_COMMANDS_SIZE / 4)
+/* frames which can be queued, every flush takes at least one entry */
+#define CANVASLINK_FRAMES               (CANVASLINK_COMMANDS_SIZE / CANVAS_CREDITS_COST(0))
+/* ack code + struct ack_tagged + attributes */
+#define CANVASLINK_TX_SIZE              (1 + sizeof(struct ack_tagged) + CANVASLINK_MAX_PAYLOAD)
+
+struct canvasrt_thread;
+
+struct canvaslink {
+    struct spidevice *spidevice;
+    struct dataready *dataready;
+    struct canvastrace *recorder;
+    /* receive thread -> renderer */
+    struct canvasqueue commands;
+    /* renderer -> receive thread */
+    struct canvasqueue replies;
+    pthread_t thread;
+    uint32_t running;
+    int32_t result;
+    /* acknowledge being clocked out */
+    uint8_t *tx_buffer;
+    uint32_t tx_pos;
+    uint32_t tx_size;
+    uint8_t *tx_scratch;
+    /* flow control */
+    uint32_t tagged_seen;
+    uint32_t credits_advertised;
+    /* flush commands received (receive thread) and taken (renderer) */
+    uint32_t flushes_received;
+    uint32_t flushes_taken;
+    /* tracing, receive time of first command of queued frames */
+    const struct canvastimeline *timeline;
+    uint64_t frames_received_ns[CANVASLINK_FRAMES];
+    uint32_t frame_open;
+    /* optional real-time settings of receive thread */
+    const struct canvasrt_thread *rt;
+};
+
+int32_t canvaslink_init(
+    struct canvaslink *link,
+    struct spidevice *spidevice,
+    struct dataready *dataready,
+    struct canvastrace *recorder
+);
+
+int32_t canvaslink_deinit(
+    struct canvaslink *link
+);
+
+int32_t canvaslink_start(
+    struct canvaslink *link
+);
+
+int32_t canvaslink_stop(
+    struct canvaslink *link
+);
+
+struct canvascmd_frame;
+
+void canvaslink_frame(
+    struct canvaslink *link,
+    const struct canvasqueue_entry *entry,
+    struct canvascmd_frame *frame
+);
+
+#endif
@@ -0,0 +1,451 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/* accept4 */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#include "config.h"
+#include "canvaslocal.h"
+#include "canvasclient.h"
+#include "canvaslink.h"
+#include "canvasscene.h"
+
+static void canvaslocal_close(
+    struct canvaslocal *local,
+    struct canvaslocal_client *client
+)
+{
+    if (client->fd < 0)
+        return;
+
+    canvas_dbg("local client %d closed\n", client->fd);
+
+    /* animations started by client would report into freed queue */
+    canvasscene_forget_replies(&local->fbscreen->scene, &client->replies);
+    if (local->epoll_fd >= 0)
+    {
+        epoll_ctl(local->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+        epoll_ctl(local->epoll_fd, EPOLL_CTL_DEL, client->commands.data_fd, NULL);
+    }
+    /* client blocked on full queue gets NULL from reserve */
+    if (NULL != client->commands.ring)
+        canvasqueue_close(&client->commands);
+    if (NULL != client->replies.ring)
+        canvasqueue_close(&client->replies);
+    canvasqueue_deinit(&client->commands);
+    canvasqueue_deinit(&client->replies);
+    close(client->fd);
+    client->fd = -1;
+    client->waiting = 0;
+}
+
+/* sockets carry 'local' so loop knows to poll it, queues only wake it */
+static int32_t canvaslocal_register(
+    struct canvaslocal *local,
+    const int32_t fd,
+    void *ptr
+)
+{
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = ptr };
+
+    if (local->epoll_fd < 0)
+        return 0;
+    return epoll_ctl(local->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/* memory and eventfds of both queues go along with hello */
+static int32_t canvaslocal_send_hello(
+    struct canvaslocal_client *client,
+    const int32_t *fds
+)
+{
+    struct canvasclient_hello hello = {
+        .magic = CANVASCLIENT_MAGIC,
+        .version = CANVASCLIENT_VERSION,
+    };
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    union {
+        struct cmsghdr header;
+        uint8_t buffer[CMSG_SPACE(CANVASCLIENT_FDS * sizeof(int32_t))];
+    } control;
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+    struct cmsghdr *cmsg;
+
+    memset(control.buffer, 0, sizeof(control.buffer));
+    cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(CANVASCLIENT_FDS * sizeof(int32_t));
+    memcpy(CMSG_DATA(cmsg), fds, CANVASCLIENT_FDS * sizeof(int32_t));
+
+    if (sizeof(hello) != sendmsg(client->fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT))
+        return -1;
+    return 0;
+}
+
+static int32_t canvaslocal_open(
+    struct canvaslocal *local,
+    struct canvaslocal_client *client
+)
+{
+    int32_t commands_fd = -1;
+    int32_t replies_fd = -1;
+    int32_t result = -1;
+
+    if ((0 > canvasqueue_init_shared(
+            &client->commands, CANVASLOCAL_COMMANDS_SIZE, CANVASLINK_MAX_PAYLOAD, &commands_fd)) ||
+        (0 > canvasqueue_init_shared(
+            &client->replies, CANVASLOCAL_REPLIES_SIZE, CANVASLINK_MAX_PAYLOAD, &replies_fd)))
+    {
+        goto done;
+    }
+    /* daemon never waits for client to make room */
+    client->replies.no_wait = 1;
+    client->layer_target = CANVAS_LAYER_DIRECT;
+    client->waiting = 0;
+
+    {
+        const int32_t fds[CANVASCLIENT_FDS] = {
+            commands_fd, client->commands.data_fd, client->commands.space_fd,
+            replies_fd, client->replies.data_fd, client->replies.space_fd,
+        };
+        if (0 > canvaslocal_send_hello(client, fds))
+            goto done;
+    }
+    if ((0 > canvaslocal_register(local, client->fd, local)) ||
+        (0 > canvaslocal_register(local, client->commands.data_fd, NULL)))
+    {
+        goto done;
+    }
+    result = 0;
+
+    done:
+        /* client keeps its own mapping */
+        if (commands_fd >= 0)
+            close(commands_fd);
+        if (replies_fd >= 0)
+            close(replies_fd);
+        return result;
+}
+
+int32_t canvaslocal_start(
+    struct canvaslocal *local,
+    const char *path,
+    struct fbscreen *fbscreen
+)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+    assert(!(NULL == local || NULL == path || NULL == fbscreen ||
+        strlen(path) >= sizeof(address.sun_path)));
+    if (NULL == local || NULL == path || NULL == fbscreen ||
+        strlen(path) >= sizeof(address.sun_path))
+    {
+        return -1;
+    }
+
+    memset(local, 0, sizeof(*local));
+    local->epoll_fd = -1;
+    local->fbscreen = fbscreen;
+    for (uint32_t i = 0; i < CANVASLOCAL_CLIENTS; i++)
+    {
+        local->clients[i].fd = -1;
+        local->clients[i].commands.data_fd = local->clients[i].commands.space_fd = -1;
+        local->clients[i].replies.data_fd = local->clients[i].replies.space_fd = -1;
+    }
+    strncpy(local->path, path, sizeof(local->path) - 1);
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    local->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (local->fd < 0)
+        return -1;
+
+    /* socket left behind by previous run */
+    unlink(path);
+    if ((0 > bind(local->fd, (struct sockaddr*)&address, sizeof(address))) ||
+        (0 > chmod(path, 0660)) ||
+        (0 > listen(local->fd, CANVASLOCAL_CLIENTS)))
+    {
+        unlink(path);
+        close(local->fd);
+        local->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int32_t canvaslocal_stop(
+    struct canvaslocal *local
+)
+{
+    if (NULL == local || local->fd < 0)
+        return -1;
+
+    for (uint32_t i = 0; i < CANVASLOCAL_CLIENTS; i++)
+        canvaslocal_close(local, &local->clients[i]);
+    if (local->epoll_fd >= 0)
+        epoll_ctl(local->epoll_fd, EPOLL_CTL_DEL, local->fd, NULL);
+    close(local->fd);
+    unlink(local->path);
+    local->fd = -1;
+    local->epoll_fd = -1;
+    return 0;
+}
+
+/* connections and hangups are reported through render loop epoll, its
+ * events of 'local' carry it as data.ptr */
+int32_t canvaslocal_watch(
+    struct canvaslocal *local,
+    const int32_t epoll_fd
+)
+{
+    assert(!(NULL == local || local->fd < 0));
+    if (NULL == local || local->fd < 0)
+        return -1;
+
+    local->epoll_fd = epoll_fd;
+    return canvaslocal_register(local, local->fd, local);
+}
+
+/* accept pending connections and drop clients which hung up */
+int32_t canvaslocal_poll(
+    struct canvaslocal *local
+)
+{
+    struct canvaslocal_client *client;
+    uint8_t byte;
+    ssize_t result;
+    int32_t fd;
+
+    assert(!(NULL == local || local->fd < 0));
+    if (NULL == local || local->fd < 0)
+        return -1;
+
+    for (uint32_t i = 0; i < CANVASLOCAL_CLIENTS; i++)
+    {
+        client = &local->clients[i];
+        if (client->fd < 0)
+            continue;
+        /* client never writes to socket, it only hangs up. Data left
+         * unread would keep waking render loop, client is dropped */
+        result = recv(client->fd, &byte, 1, MSG_DONTWAIT | MSG_PEEK);
+        if ((result >= 0) || ((EAGAIN != errno) && (EWOULDBLOCK != errno)))
+            canvaslocal_close(local, client);
+    }
+
+    for (;;)
+    {
+        fd = accept4(local->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0)
+            break;
+
+        client = NULL;
+        for (uint32_t i = 0; (i < CANVASLOCAL_CLIENTS) && (NULL == client); i++)
+        {
+            if (local->clients[i].fd < 0)
+                client = &local->clients[i];
+        }
+        /* no free session, client sees connection closed */
+        if (NULL == client)
+        {
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        if (0 > canvaslocal_open(local, client))
+        {
+            canvaslocal_close(local, client);
+            continue;
+        }
+        canvas_dbg("local client %d connected\n", fd);
+    }
+    return 0;
+}
+
+/* take entry out of shared memory, what is checked and executed then
+ * cannot be changed by client meanwhile */
+static int32_t canvaslocal_copy(
+    struct canvaslocal *local,
+    const struct canvasqueue_entry *entry
+)
+{
+    memcpy(&local->entry, entry, sizeof(local->entry));
+    if (local->entry.size > sizeof(local->payload))
+        return -1;
+    memcpy(local->payload, CANVASQUEUE_PAYLOAD(entry), local->entry.size);
+    return 0;
+}
+
+/* copied entry decodes as command of the table, 'canvascmd_exec' would
+ * refuse it otherwise and that is fatal for slave stream */
+static int32_t canvaslocal_valid(
+    const struct canvaslocal *local
+)
+{
+    const struct canvascmd *command = canvascmd_lookup(local->entry.cmd_code);
+    uint64_t size;
+
+    if (NULL == command)
+        return 0;
+    size = command->payload_size;
+    if ((NULL != command->payload_extra) && (local->entry.size >= size))
+        size += command->payload_extra(local->payload);
+    return size == local->entry.size;
+}
+
+/* run copied command of client, on its own layer target */
+static int32_t canvaslocal_exec(
+    struct canvaslocal *local,
+    struct canvaslocal_client *client
+)
+{
+    struct fbscreen *fbscreen = local->fbscreen;
+    struct canvascmd_frame *frame = &local->frame;
+    uint32_t layer_target = fbscreen->layer_target;
+    int32_t result;
+
+    frame->cmd_code = local->entry.cmd_code;
+    frame->tagged = (local->entry.flags & CANVASQUEUE_FLAG_TAGGED) ? 1 : 0;
+    frame->tag = local->entry.tag;
+    frame->payload = local->payload;
+    frame->size = local->entry.size;
+    frame->replies = &client->replies;
+    frame->flushes_queued = 0;
+    /* client commands join slave frame in progress, they count
+     * as received when executed */
+    frame->seq = fbscreen->timeline.current.last;
+    frame->received_ns = 0;
+
+    /* layer disabled meanwhile, client draws into frame */
+    if (0 > fbscreen_select_layer(fbscreen, client->layer_target))
+        fbscreen->layer_target = CANVAS_LAYER_DIRECT;
+    result = canvascmd_exec(fbscreen, frame);
+    client->layer_target = fbscreen->layer_target;
+    if (0 > fbscreen_select_layer(fbscreen, layer_target))
+        fbscreen->layer_target = CANVAS_LAYER_DIRECT;
+    return result;
+}
+
+/* execute up to 'max' commands of all clients, returns number of
+ * executed commands. Client which sent broken entry or does not read
+ * replies is dropped */
+int32_t canvaslocal_serve(
+    struct canvaslocal *local,
+    const uint32_t max
+)
+{
+    struct canvaslocal_client *client;
+    struct canvasqueue_entry *entry;
+    uint32_t count = 0;
+    int32_t result;
+
+    if (NULL == local || local->fd < 0)
+        return 0;
+
+    for (uint32_t i = 0; i < CANVASLOCAL_CLIENTS; i++)
+    {
+        client = &local->clients[i];
+        while ((client->fd >= 0) && (count < max))
+        {
+            entry = canvasqueue_peek(&client->commands, 0);
+            if (NULL == entry)
+            {
+                /* disconnected (or broken) and drained */
+                if (canvasqueue_is_closed(&client->commands))
+                    canvaslocal_close(local, client);
+                break;
+            }
+            if ((0 > canvaslocal_copy(local, entry)) || !canvaslocal_valid(local))
+            {
+                canvas_dbg("local client %d: invalid command 0x%x\n", client->fd, local->entry.cmd_code);
+                canvaslocal_close(local, client);
+                break;
+            }
+            /* client may reuse room while command runs */
+            canvasqueue_release(&client->commands, entry);
+            result = canvaslocal_exec(local, client);
+            count++;
+            if (result < 0)
+                canvaslocal_close(local, client);
+
+            /* flip handed over to presenter thread */
+            if (local->fbscreen->present_pending)
+                return count;
+        }
+    }
+    return count;
+}
+
+/* announce render loop sleeps on queues of clients, returns 0 when
+ * some client has commands */
+uint32_t canvaslocal_wait_begin(
+    struct canvaslocal *local
+)
+{
+    struct canvaslocal_client *client;
+    uint32_t sleep = 1;
+
+    if (NULL == local || local->fd < 0)
+        return 1;
+
+    for (uint32_t i = 0; i < CANVASLOCAL_CLIENTS; i++)
+    {
+        client = &local->clients[i];
+        client->waiting = 0;
+        if (client->fd < 0)
+            continue;
+        client->waiting = canvasqueue_wait_begin(&client->commands);
+        if (!client->waiting)
+            sleep = 0;
+    }
+    return sleep;
+}
+
+void canvaslocal_wait_end(
+    struct canvaslocal *local
+)
+{
+    if (NULL == local || local->fd < 0)
+        return;
+
+    for (uint32_t i = 0; i < CANVASLOCAL_CLIENTS; i++)
+    {
+        if (local->clients[i].waiting)
+            canvasqueue_wait_end(&local->clients[i].commands);
+        local->clients[i].waiting = 0;
+    }
+}
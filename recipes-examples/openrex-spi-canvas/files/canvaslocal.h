@@ -0,0 +1,101 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Daemon side of local clients (canvasclient.h). Listening socket only
+ * hands over shared queues, commands are then executed from the queue
+ * by render loop together with commands of slave, replies are written
+ * without waiting, client which does not read them is dropped.
+ * Clients are trusted processes of the board, still every entry is
+ * copied out of shared memory and checked before it is decoded so
+ * broken client cannot take daemon down with it.
+ */
+
+#ifndef __CANVASLOCAL_H__
+#define __CANVASLOCAL_H__
+
+#include <stdint.h>
+#include "fbscreen.h"
+#include "canvasqueue.h"
+#include "canvascmd.h"
+#include "canvaslink.h"
+
+#define CANVASLOCAL_CLIENTS             (4)
+#define CANVASLOCAL_COMMANDS_SIZE       (64 * 1024)
+#define CANVASLOCAL_REPLIES_SIZE        (16 * 1024)
+
+struct canvaslocal_client {
+    int32_t fd;
+    struct canvasqueue commands;
+    struct canvasqueue replies;
+    /* layer selected by client, screen is shared with slave */
+    uint32_t layer_target;
+    uint32_t waiting;
+};
+
+struct canvaslocal {
+    int32_t fd;
+    char path[108];
+    /* screen of display, clients draw into it with slave */
+    struct fbscreen *fbscreen;
+    /* render loop epoll, sessions register their descriptors there */
+    int32_t epoll_fd;
+    struct canvaslocal_client clients[CANVASLOCAL_CLIENTS];
+    struct canvascmd_frame frame;
+    /* entry being executed, client may still write to queue memory */
+    struct canvasqueue_entry entry;
+    uint8_t payload[CANVASLINK_MAX_PAYLOAD];
+};
+
+int32_t canvaslocal_start(
+    struct canvaslocal *local,
+    const char *path,
+    struct fbscreen *fbscreen
+);
+
+int32_t canvaslocal_stop(
+    struct canvaslocal *local
+);
+
+int32_t canvaslocal_watch(
+    struct canvaslocal *local,
+    const int32_t epoll_fd
+);
+
+int32_t canvaslocal_poll(
+    struct canvaslocal *local
+);
+
+int32_t canvaslocal_serve(
+    struct canvaslocal *local,
+    const uint32_t max
+);
+
+uint32_t canvaslocal_wait_begin(
+    struct canvaslocal *local
+);
+
+void canvaslocal_wait_end(
+    struct canvaslocal *local
+);
+
+#endif
@@ -0,0 +1,221 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "canvasqoi.h"
+
+#define CANVASQOI_OP_INDEX              (0x00)
+#define CANVASQOI_OP_DIFF               (0x40)
+#define CANVASQOI_OP_LUMA               (0x80)
+#define CANVASQOI_OP_RUN                (0xC0)
+#define CANVASQOI_OP_RGB                (0xFE)
+#define CANVASQOI_OP_RGBA               (0xFF)
+#define CANVASQOI_MASK                  (0xC0)
+
+#define CANVASQOI_PIXEL(r, g, b, a) \
+    ((((uint32_t)(uint8_t)(a)) << 24) | (((uint32_t)(uint8_t)(r)) << 16) | \
+    (((uint32_t)(uint8_t)(g)) << 8) | ((uint32_t)(uint8_t)(b)))
+#define CANVASQOI_HASH(p) \
+    ((((p) >> 16 & 0xFF) * 3 + ((p) >> 8 & 0xFF) * 5 + ((p) & 0xFF) * 7 + ((p) >> 24) * 11) % 64)
+
+/* new image follows, header is expected */
+void canvasqoi_init(
+    struct canvasqoi *qoi
+)
+{
+    memset(qoi, 0, sizeof(*qoi));
+    qoi->pixel = CANVASQOI_PIXEL(0, 0, 0, 255);
+}
+
+/* bytes of operation (or header) starting with 'op' */
+static uint32_t canvasqoi_op_size(
+    const struct canvasqoi *qoi,
+    const uint8_t op
+)
+{
+    if (0 == qoi->width)
+        return CANVASQOI_HEADER_SIZE;
+    if (CANVASQOI_OP_RGBA == op)
+        return 5;
+    if (CANVASQOI_OP_RGB == op)
+        return 4;
+    if (CANVASQOI_OP_LUMA == (op & CANVASQOI_MASK))
+        return 2;
+    return 1;
+}
+
+static int32_t canvasqoi_header(
+    struct canvasqoi *qoi,
+    const uint8_t *op
+)
+{
+    uint32_t magic = ((uint32_t)op[0] << 24) | (op[1] << 16) | (op[2] << 8) | op[3];
+
+    qoi->width = ((uint32_t)op[4] << 24) | (op[5] << 16) | (op[6] << 8) | op[7];
+    qoi->height = ((uint32_t)op[8] << 24) | (op[9] << 16) | (op[10] << 8) | op[11];
+    if ((CANVASQOI_MAGIC != magic) || (0 == qoi->width) || (0 == qoi->height))
+    {
+        qoi->width = 0;
+        return -1;
+    }
+    qoi->left = (uint64_t)qoi->width * qoi->height;
+    return 0;
+}
+
+/* apply single complete operation to current pixel */
+static void canvasqoi_op(
+    struct canvasqoi *qoi,
+    const uint8_t *op
+)
+{
+    uint32_t p = qoi->pixel;
+    int32_t r = p >> 16 & 0xFF, g = p >> 8 & 0xFF, b = p & 0xFF, a = p >> 24;
+    int32_t dg;
+
+    if (CANVASQOI_OP_RGB == op[0])
+    {
+        r = op[1];
+        g = op[2];
+        b = op[3];
+    }
+    else if (CANVASQOI_OP_RGBA == op[0])
+    {
+        r = op[1];
+        g = op[2];
+        b = op[3];
+        a = op[4];
+    }
+    else
+    {
+        switch (op[0] & CANVASQOI_MASK)
+        {
+            case CANVASQOI_OP_INDEX:
+                qoi->pixel = qoi->index[op[0]];
+                qoi->run = 1;
+            return;
+            case CANVASQOI_OP_DIFF:
+                r += ((op[0] >> 4) & 0x3) - 2;
+                g += ((op[0] >> 2) & 0x3) - 2;
+                b += (op[0] & 0x3) - 2;
+            break;
+            case CANVASQOI_OP_LUMA:
+                dg = (op[0] & 0x3F) - 32;
+                r += dg + ((op[1] >> 4) & 0xF) - 8;
+                g += dg;
+                b += dg + (op[1] & 0xF) - 8;
+            break;
+            case CANVASQOI_OP_RUN:
+                qoi->run = (op[0] & 0x3F) + 1;
+            return;
+        }
+    }
+    qoi->pixel = CANVASQOI_PIXEL(r, g, b, a);
+    qoi->index[CANVASQOI_HASH(qoi->pixel)] = qoi->pixel;
+    qoi->run = 1;
+}
+
+/* decode from '*data' (advanced past consumed bytes) up to 'count'
+ * pixels, returns number of produced ones, 0 when more data is needed
+ * or image is complete, negative for invalid header */
+int32_t canvasqoi_decode(
+    struct canvasqoi *qoi,
+    const uint8_t **data,
+    uint32_t *size,
+    uint32_t *pixels,
+    const uint32_t count
+)
+{
+    uint32_t produced = 0;
+    uint32_t need, chunk;
+    const uint8_t *op;
+
+    assert(!(NULL == qoi || NULL == data || NULL == size || (count && (NULL == pixels))));
+    if (NULL == qoi || NULL == data || NULL == size || (count && (NULL == pixels)))
+        return -1;
+
+    while (produced < count)
+    {
+        if (qoi->run && qoi->left)
+        {
+            chunk = count - produced;
+            chunk = chunk < qoi->run ? chunk : qoi->run;
+            chunk = chunk < qoi->left ? chunk : (uint32_t)qoi->left;
+            for (uint32_t i = 0; i < chunk; i++)
+                pixels[produced + i] = qoi->pixel;
+            produced += chunk;
+            qoi->run -= chunk;
+            qoi->left -= chunk;
+            continue;
+        }
+        /* end marker and anything behind the image is dropped */
+        if (qoi->width && !qoi->left)
+        {
+            *data += *size;
+            *size = 0;
+            break;
+        }
+        if (0 == *size)
+            break;
+
+        /* operation completed from carried over bytes, or in place */
+        if (qoi->pending_size)
+        {
+            need = canvasqoi_op_size(qoi, qoi->pending[0]) - qoi->pending_size;
+            chunk = need < *size ? need : *size;
+            memcpy(qoi->pending + qoi->pending_size, *data, chunk);
+            qoi->pending_size += chunk;
+            *data += chunk;
+            *size -= chunk;
+            if (chunk < need)
+                break;
+            op = qoi->pending;
+            qoi->pending_size = 0;
+        }
+        else
+        {
+            need = canvasqoi_op_size(qoi, (*data)[0]);
+            if (need > *size)
+            {
+                memcpy(qoi->pending, *data, *size);
+                qoi->pending_size = *size;
+                *data += *size;
+                *size = 0;
+                break;
+            }
+            op = *data;
+            *data += need;
+            *size -= need;
+        }
+
+        if (0 == qoi->width)
+        {
+            if (0 > canvasqoi_header(qoi, op))
+                return -1;
+            continue;
+        }
+        canvasqoi_op(qoi, op);
+    }
+    return produced;
+}
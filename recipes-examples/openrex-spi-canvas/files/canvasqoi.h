@@ -0,0 +1,65 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Incremental QOI ("Quite OK Image") decoder. Stream is fed in chunks as
+ * they arrive, operation split between chunks is carried over in small
+ * buffer, so decoding needs no staging of the whole image. Pixels are
+ * produced in batches of caller size as 0xAARRGGBB.
+ */
+
+#ifndef __CANVASQOI_H__
+#define __CANVASQOI_H__
+
+#include <stdint.h>
+
+#define CANVASQOI_HEADER_SIZE           (14)
+#define CANVASQOI_MAGIC                 (0x716F6966) /* "qoif" */
+
+struct canvasqoi {
+    /* zero until header is decoded */
+    uint32_t width;
+    uint32_t height;
+    /* pixels not produced yet */
+    uint64_t left;
+    uint32_t pixel;
+    /* repeats of 'pixel' still to produce */
+    uint32_t run;
+    uint32_t index[64];
+    /* incomplete operation (or header) from previous chunk */
+    uint8_t pending[CANVASQOI_HEADER_SIZE];
+    uint32_t pending_size;
+};
+
+void canvasqoi_init(
+    struct canvasqoi *qoi
+);
+
+int32_t canvasqoi_decode(
+    struct canvasqoi *qoi,
+    const uint8_t **data,
+    uint32_t *size,
+    uint32_t *pixels,
+    const uint32_t count
+);
+
+#endif
@@ -0,0 +1,453 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+
+/* memfd_create */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <assert.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "canvasqueue.h"
+
+#define CANVASQUEUE_LOAD(ptr)           __atomic_load_n((ptr), __ATOMIC_SEQ_CST)
+#define CANVASQUEUE_STORE(ptr, val)     __atomic_store_n((ptr), (val), __ATOMIC_SEQ_CST)
+#define CANVASQUEUE_XCHG(ptr, val)      __atomic_exchange_n((ptr), (val), __ATOMIC_SEQ_CST)
+
+/* CANVAS_CREDITS_COST accounts exactly this header */
+typedef char canvasqueue_entry_size_check[(sizeof(struct canvasqueue_entry) == 16) ? 1 : -1];
+typedef char canvasqueue_ring_size_check[(sizeof(struct canvasqueue_ring) <= CANVASQUEUE_RING_SIZE) ? 1 : -1];
+
+/* entry near the end of shared memory read past 'capacity' by broken
+ * client stays in the mapping */
+#define CANVASQUEUE_MAP_SIZE(capacity, max_span) \
+    ((CANVASQUEUE_RING_SIZE + (capacity) + (max_span) + 4095) & ~4095)
+
+static void canvasqueue_notify(
+    int32_t fd
+)
+{
+    uint64_t one = 1;
+    ssize_t result;
+
+    result = write(fd, &one, sizeof(one));
+    (void)result;
+}
+
+static void canvasqueue_drain(
+    int32_t fd
+)
+{
+    uint64_t count;
+    ssize_t result;
+
+    result = read(fd, &count, sizeof(count));
+    (void)result;
+}
+
+/* sleep on descriptor, returns 0 when woken, negative on timeout or signal */
+static int32_t canvasqueue_sleep(
+    int32_t fd,
+    const int32_t timeout_ms
+)
+{
+    struct pollfd pollfd = { .fd = fd, .events = POLLIN };
+    int32_t result;
+
+    result = poll(&pollfd, 1, timeout_ms);
+    canvasqueue_drain(fd);
+    return result > 0 ? 0 : -1;
+}
+
+/* geometry of queue whose memory is already set */
+static int32_t canvasqueue_setup(
+    struct canvasqueue *queue,
+    void *mem,
+    const uint32_t capacity,
+    const uint32_t max_span
+)
+{
+    queue->ring = mem;
+    queue->data = (uint8_t*)mem + CANVASQUEUE_RING_SIZE;
+    queue->capacity = capacity;
+    queue->max_span = max_span;
+    queue->reserved_head = 0;
+    return 0;
+}
+
+static int32_t canvasqueue_check(
+    const uint32_t capacity,
+    const uint32_t max_span
+)
+{
+    /* largest entry plus possible wrap skip must fit */
+    if ((0 == capacity) || (capacity & (capacity - 1)) || (max_span > capacity / 2))
+        return -1;
+    return 0;
+}
+
+int32_t canvasqueue_init(
+    struct canvasqueue *queue,
+    const uint32_t capacity,
+    const uint32_t max_size
+)
+{
+    void *mem;
+
+    assert(!(NULL == queue || 0 > canvasqueue_check(capacity, CANVASQUEUE_SPAN(max_size))));
+    if (NULL == queue || 0 > canvasqueue_check(capacity, CANVASQUEUE_SPAN(max_size)))
+        return -1;
+
+    memset(queue, 0, sizeof(*queue));
+    queue->data_fd = -1;
+    queue->space_fd = -1;
+
+    if (0 != posix_memalign(&mem, 64, CANVASQUEUE_RING_SIZE + capacity))
+        return -1;
+    memset(mem, 0, CANVASQUEUE_RING_SIZE);
+    canvasqueue_setup(queue, mem, capacity, CANVASQUEUE_SPAN(max_size));
+
+    queue->data_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    queue->space_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((queue->data_fd < 0) || (queue->space_fd < 0))
+    {
+        canvasqueue_deinit(queue);
+        return -1;
+    }
+    return 0;
+}
+
+/* queue in memfd, descriptor of memory is returned for the other process */
+int32_t canvasqueue_init_shared(
+    struct canvasqueue *queue,
+    const uint32_t capacity,
+    const uint32_t max_size,
+    int32_t *mem_fd
+)
+{
+    uint32_t map_size = CANVASQUEUE_MAP_SIZE(capacity, CANVASQUEUE_SPAN(max_size));
+    void *mem;
+
+    assert(!(NULL == queue || NULL == mem_fd || 0 > canvasqueue_check(capacity, CANVASQUEUE_SPAN(max_size))));
+    if (NULL == queue || NULL == mem_fd || 0 > canvasqueue_check(capacity, CANVASQUEUE_SPAN(max_size)))
+        return -1;
+
+    memset(queue, 0, sizeof(*queue));
+    queue->data_fd = -1;
+    queue->space_fd = -1;
+
+    *mem_fd = memfd_create("canvasqueue", MFD_CLOEXEC);
+    if (*mem_fd < 0)
+        return -1;
+    mem = MAP_FAILED;
+    if (0 == ftruncate(*mem_fd, map_size))
+        mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, *mem_fd, 0);
+    if (MAP_FAILED == mem)
+    {
+        close(*mem_fd);
+        *mem_fd = -1;
+        return -1;
+    }
+    canvasqueue_setup(queue, mem, capacity, CANVASQUEUE_SPAN(max_size));
+    queue->map_size = map_size;
+    queue->ring->capacity = capacity;
+    queue->ring->max_span = queue->max_span;
+
+    queue->data_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    queue->space_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((queue->data_fd < 0) || (queue->space_fd < 0))
+    {
+        canvasqueue_deinit(queue);
+        close(*mem_fd);
+        *mem_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/* map queue created by other process, descriptors are taken over */
+int32_t canvasqueue_attach(
+    struct canvasqueue *queue,
+    const int32_t mem_fd,
+    const int32_t data_fd,
+    const int32_t space_fd
+)
+{
+    const struct canvasqueue_ring *ring;
+    struct stat stat;
+    void *mem;
+
+    assert(!(NULL == queue));
+    if (NULL == queue)
+        return -1;
+
+    memset(queue, 0, sizeof(*queue));
+    queue->data_fd = -1;
+    queue->space_fd = -1;
+
+    if ((0 != fstat(mem_fd, &stat)) || (stat.st_size < CANVASQUEUE_RING_SIZE) || (stat.st_size > UINT32_MAX))
+        return -1;
+    mem = mmap(NULL, stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+    if (MAP_FAILED == mem)
+        return -1;
+
+    ring = mem;
+    if ((0 > canvasqueue_check(ring->capacity, ring->max_span)) ||
+        (stat.st_size < CANVASQUEUE_MAP_SIZE(ring->capacity, ring->max_span)))
+    {
+        munmap(mem, stat.st_size);
+        return -1;
+    }
+    canvasqueue_setup(queue, mem, ring->capacity, ring->max_span);
+    queue->map_size = stat.st_size;
+    queue->reserved_head = ring->head;
+    queue->data_fd = data_fd;
+    queue->space_fd = space_fd;
+    return 0;
+}
+
+int32_t canvasqueue_deinit(
+    struct canvasqueue *queue
+)
+{
+    if (NULL == queue)
+        return -1;
+
+    if (queue->data_fd >= 0)
+        close(queue->data_fd);
+    if (queue->space_fd >= 0)
+        close(queue->space_fd);
+    if (queue->map_size)
+        munmap(queue->ring, queue->map_size);
+    else
+        free(queue->ring);
+    queue->ring = NULL;
+    queue->data = NULL;
+    queue->map_size = 0;
+    queue->data_fd = -1;
+    queue->space_fd = -1;
+    return 0;
+}
+
+/* get room for entry with 'size' bytes of attributes, blocks while full
+ * (unless 'no_wait'). Returns NULL when queue is closed, full without
+ * waiting or entry is too big */
+struct canvasqueue_entry *canvasqueue_reserve(
+    struct canvasqueue *queue,
+    const uint32_t size
+)
+{
+    struct canvasqueue_entry *entry;
+    uint32_t span = CANVASQUEUE_SPAN(size);
+    uint32_t head = queue->ring->head;
+    uint32_t contiguous, need;
+
+    if (span > queue->max_span)
+        return NULL;
+
+    for (;;)
+    {
+        contiguous = queue->capacity - (head & (queue->capacity - 1));
+        need = span > contiguous ? contiguous + span : span;
+        if (queue->capacity - (head - CANVASQUEUE_LOAD(&queue->ring->tail)) >= need)
+            break;
+        if (CANVASQUEUE_LOAD(&queue->ring->closed) || queue->no_wait)
+            return NULL;
+
+        /* announce sleep, then re-check to not miss the wakeup */
+        CANVASQUEUE_STORE(&queue->ring->producer_waiting, 1);
+        if ((queue->capacity - (head - CANVASQUEUE_LOAD(&queue->ring->tail)) >= need) ||
+            CANVASQUEUE_LOAD(&queue->ring->closed))
+        {
+            CANVASQUEUE_STORE(&queue->ring->producer_waiting, 0);
+            continue;
+        }
+        canvasqueue_sleep(queue->space_fd, -1);
+        CANVASQUEUE_STORE(&queue->ring->producer_waiting, 0);
+    }
+
+    /* attributes must stay contiguous, skip the tail of buffer */
+    if (span > contiguous)
+    {
+        entry = (struct canvasqueue_entry*)(queue->data + (head & (queue->capacity - 1)));
+        entry->span = contiguous;
+        entry->size = 0;
+        entry->flags = CANVASQUEUE_FLAG_SKIP;
+        head += contiguous;
+    }
+    queue->reserved_head = head;
+
+    entry = (struct canvasqueue_entry*)(queue->data + (head & (queue->capacity - 1)));
+    entry->span = span;
+    entry->size = size;
+    entry->tag = 0;
+    entry->cmd_code = 0;
+    entry->flags = 0;
+    return entry;
+}
+
+/* publish entry returned by canvasqueue_reserve */
+void canvasqueue_commit(
+    struct canvasqueue *queue,
+    struct canvasqueue_entry *entry
+)
+{
+    CANVASQUEUE_STORE(&queue->ring->head, queue->reserved_head + entry->span);
+    if (CANVASQUEUE_XCHG(&queue->ring->consumer_waiting, 0))
+        canvasqueue_notify(queue->data_fd);
+}
+
+static void canvasqueue_advance(
+    struct canvasqueue *queue,
+    const uint32_t span,
+    const uint32_t consumed
+)
+{
+    if (consumed)
+        CANVASQUEUE_STORE(&queue->ring->consumed, queue->ring->consumed + span);
+    CANVASQUEUE_STORE(&queue->ring->tail, queue->ring->tail + span);
+    if (CANVASQUEUE_XCHG(&queue->ring->producer_waiting, 0))
+        canvasqueue_notify(queue->space_fd);
+}
+
+/* announce consumer is going to sleep on 'data_fd'.
+ * Returns 0 when there is no reason to sleep */
+int32_t canvasqueue_wait_begin(
+    struct canvasqueue *queue
+)
+{
+    CANVASQUEUE_STORE(&queue->ring->consumer_waiting, 1);
+    if ((CANVASQUEUE_LOAD(&queue->ring->head) != queue->ring->tail) || CANVASQUEUE_LOAD(&queue->ring->closed))
+    {
+        CANVASQUEUE_STORE(&queue->ring->consumer_waiting, 0);
+        return 0;
+    }
+    return 1;
+}
+
+void canvasqueue_wait_end(
+    struct canvasqueue *queue
+)
+{
+    CANVASQUEUE_STORE(&queue->ring->consumer_waiting, 0);
+    canvasqueue_drain(queue->data_fd);
+}
+
+/* entry lies within queue, producer of local client is other process */
+static int32_t canvasqueue_entry_valid(
+    const struct canvasqueue *queue,
+    const struct canvasqueue_entry *entry,
+    const uint32_t offset
+)
+{
+    if ((entry->span < sizeof(*entry)) || (entry->span & (sizeof(*entry) - 1)) ||
+        (offset + entry->span > queue->capacity))
+    {
+        return 0;
+    }
+    if (entry->flags & CANVASQUEUE_FLAG_SKIP)
+        return 1;
+    return (entry->span <= queue->max_span) && (entry->size <= entry->span - sizeof(*entry));
+}
+
+/* oldest entry, waits up to 'timeout_ms' (negative forever) when empty.
+ * Returns NULL on timeout, signal or closed and drained queue */
+struct canvasqueue_entry *canvasqueue_peek(
+    struct canvasqueue *queue,
+    const int32_t timeout_ms
+)
+{
+    struct canvasqueue_entry *entry;
+
+    for (;;)
+    {
+        if (CANVASQUEUE_LOAD(&queue->ring->head) != queue->ring->tail)
+        {
+            entry = (struct canvasqueue_entry*)(queue->data + (queue->ring->tail & (queue->capacity - 1)));
+            /* broken producer, queue is not read any more */
+            if (!canvasqueue_entry_valid(queue, entry, queue->ring->tail & (queue->capacity - 1)))
+            {
+                CANVASQUEUE_STORE(&queue->ring->closed, 1);
+                return NULL;
+            }
+            if (entry->flags & CANVASQUEUE_FLAG_SKIP)
+            {
+                canvasqueue_advance(queue, entry->span, 0);
+                continue;
+            }
+            return entry;
+        }
+        if (CANVASQUEUE_LOAD(&queue->ring->closed) || (0 == timeout_ms))
+            return NULL;
+
+        if (canvasqueue_wait_begin(queue))
+        {
+            int32_t result = canvasqueue_sleep(queue->data_fd, timeout_ms);
+            CANVASQUEUE_STORE(&queue->ring->consumer_waiting, 0);
+            if (result < 0)
+                return NULL;
+        }
+    }
+}
+
+void canvasqueue_release(
+    struct canvasqueue *queue,
+    struct canvasqueue_entry *entry
+)
+{
+    canvasqueue_advance(queue, entry->span, 1);
+}
+
+/* wake up both sides, no more entries are accepted */
+void canvasqueue_close(
+    struct canvasqueue *queue
+)
+{
+    CANVASQUEUE_STORE(&queue->ring->closed, 1);
+    canvasqueue_notify(queue->data_fd);
+    canvasqueue_notify(queue->space_fd);
+}
+
+int32_t canvasqueue_is_closed(
+    const struct canvasqueue *queue
+)
+{
+    return CANVASQUEUE_LOAD(&queue->ring->closed) ? 1 : 0;
+}
+
+/* cumulative amount of entry spans producer may have committed so far
+ * without overrunning the queue, see CANVAS_ACK_CREDITS */
+uint32_t canvasqueue_credit_limit(
+    const struct canvasqueue *queue
+)
+{
+    return CANVASQUEUE_LOAD(&queue->ring->consumed) + queue->capacity - queue->max_span;
+}
@@ -0,0 +1,156 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Single producer, single consumer queue of variable sized entries.
+ * Entry attributes are always contiguous and 16B aligned, so they can be
+ * decoded in place. Positions are free running counters, the sleeping
+ * side is woken through eventfd only when it announced it is waiting.
+ * Queue of local client lives in memfd mapped by both processes, the
+ * descriptors are handed over on connect.
+ */
+
+#ifndef __CANVASQUEUE_H__
+#define __CANVASQUEUE_H__
+
+#include <stdint.h>
+#include "canvas_common.h"
+
+#define CANVASQUEUE_FLAG_SKIP           (1 << 0)
+#define CANVASQUEUE_FLAG_TAGGED         (1 << 1)
+
+/* header of each entry, attributes follow */
+struct canvasqueue_entry {
+    /* bytes occupied by entry including header and padding */
+    uint32_t span;
+    /* bytes of attributes */
+    uint32_t size;
+    uint32_t tag;
+    uint8_t cmd_code;
+    uint8_t flags;
+    uint16_t reserved;
+};
+
+#define CANVASQUEUE_PAYLOAD(entry)      ((uint8_t*)((struct canvasqueue_entry*)(entry) + 1))
+#define CANVASQUEUE_SPAN(size)          CANVAS_CREDITS_COST(size)
+
+/* positions and wakeup flags, first in memory of queue, entries follow
+ * at CANVASQUEUE_RING_SIZE. Memory of local client queue is shared with
+ * the client process, so it holds no pointers */
+struct canvasqueue_ring {
+    uint32_t capacity;
+    uint32_t max_span;
+    /* producer position, written by producer */
+    uint32_t head;
+    /* consumer position, written by consumer */
+    uint32_t tail;
+    /* sum of spans of released entries, skips excluded */
+    uint32_t consumed;
+    uint32_t consumer_waiting;
+    uint32_t producer_waiting;
+    uint32_t closed;
+};
+
+#define CANVASQUEUE_RING_SIZE           (64)
+
+/* queue as seen by one side, geometry is kept locally and ring values
+ * written by the other process are not trusted for it */
+struct canvasqueue {
+    struct canvasqueue_ring *ring;
+    uint8_t *data;
+    uint32_t capacity;
+    uint32_t max_span;
+    uint32_t reserved_head;
+    /* wakeup of sleeping side */
+    int32_t data_fd;
+    int32_t space_fd;
+    /* size of shared mapping, zero for private queue */
+    uint32_t map_size;
+    /* reserve gives up instead of sleeping while queue is full */
+    uint32_t no_wait;
+};
+
+int32_t canvasqueue_init(
+    struct canvasqueue *queue,
+    const uint32_t capacity,
+    const uint32_t max_size
+);
+
+int32_t canvasqueue_init_shared(
+    struct canvasqueue *queue,
+    const uint32_t capacity,
+    const uint32_t max_size,
+    int32_t *mem_fd
+);
+
+int32_t canvasqueue_attach(
+    struct canvasqueue *queue,
+    const int32_t mem_fd,
+    const int32_t data_fd,
+    const int32_t space_fd
+);
+
+int32_t canvasqueue_deinit(
+    struct canvasqueue *queue
+);
+
+struct canvasqueue_entry *canvasqueue_reserve(
+    struct canvasqueue *queue,
+    const uint32_t size
+);
+
+void canvasqueue_commit(
+    struct canvasqueue *queue,
+    struct canvasqueue_entry *entry
+);
+
+struct canvasqueue_entry *canvasqueue_peek(
+    struct canvasqueue *queue,
+    const int32_t timeout_ms
+);
+
+void canvasqueue_release(
+    struct canvasqueue *queue,
+    struct canvasqueue_entry *entry
+);
+
+int32_t canvasqueue_wait_begin(
+    struct canvasqueue *queue
+);
+
+void canvasqueue_wait_end(
+    struct canvasqueue *queue
+);
+
+void canvasqueue_close(
+    struct canvasqueue *queue
+);
+
+int32_t canvasqueue_is_closed(
+    const struct canvasqueue *queue
+);
+
+uint32_t canvasqueue_credit_limit(
+    const struct canvasqueue *queue
+);
+
+#endif
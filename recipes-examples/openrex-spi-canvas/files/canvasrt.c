@@ -0,0 +1,147 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/* pthread_setaffinity_np, CPU_SET */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "config.h"
+#include "canvasrt.h"
+
+/* PRIO[:CPU], e.g. 50:1 */
+int32_t canvasrt_parse(
+    struct canvasrt_thread *thread,
+    const char *text
+)
+{
+    const char *separator;
+
+    assert(!(NULL == thread || NULL == text));
+    if (NULL == thread || NULL == text)
+        return -1;
+
+    thread->priority = atoi(text);
+    thread->cpu = -1;
+    separator = strchr(text, ':');
+    if (NULL != separator)
+        thread->cpu = atoi(separator + 1);
+    return 0;
+}
+
+/* apply settings to calling thread and report what is in effect */
+int32_t canvasrt_apply(
+    const struct canvasrt_thread *thread,
+    const char *name
+)
+{
+    struct sched_param param = {0};
+    cpu_set_t cpuset;
+    int32_t policy;
+    int32_t result = 0;
+
+    assert(!(NULL == thread || NULL == name));
+    if (NULL == thread || NULL == name)
+        return -1;
+
+    /* threads inherit policy of creator, so it is always set */
+    param.sched_priority = thread->priority > 0 ? thread->priority : 0;
+    policy = thread->priority > 0 ? SCHED_FIFO : SCHED_OTHER;
+    if (0 != pthread_setschedparam(pthread_self(), policy, &param))
+    {
+        fprintf(stderr, "%s thread: cannot set SCHED_FIFO %d\n", name, thread->priority);
+        result = -1;
+    }
+    if (thread->cpu >= 0)
+    {
+        CPU_ZERO(&cpuset);
+        CPU_SET(thread->cpu, &cpuset);
+        if (0 != pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset))
+        {
+            fprintf(stderr, "%s thread: cannot pin to cpu %d\n", name, thread->cpu);
+            result = -1;
+        }
+    }
+
+    /* report effective settings, not the requested ones */
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    printf("%s thread: %s priority %d", name,
+        SCHED_FIFO == policy ? "SCHED_FIFO" : (SCHED_RR == policy ? "SCHED_RR" : "SCHED_OTHER"),
+        param.sched_priority);
+    if (0 == pthread_getaffinity_np(pthread_self(), sizeof(cpuset), &cpuset))
+    {
+        printf(", cpus");
+        for (int i = 0; i < CPU_SETSIZE; i++)
+        {
+            if (CPU_ISSET(i, &cpuset))
+                printf(" %d", i);
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+    return result;
+}
+
+/* keep current and future pages resident, populates anonymous memory */
+int32_t canvasrt_lock_memory(void)
+{
+    if (0 != mlockall(MCL_CURRENT | MCL_FUTURE))
+    {
+        fprintf(stderr, "cannot lock memory\n");
+        return -1;
+    }
+    printf("memory locked\n");
+    return 0;
+}
+
+/* touch every page of mapping, device mappings are not populated by
+ * mlockall and would fault on first draw otherwise */
+int32_t canvasrt_prefault(
+    void *mem,
+    const size_t size
+)
+{
+    volatile uint8_t *page = mem;
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t pages = 0;
+
+    assert(!(NULL == mem));
+    if (NULL == mem)
+        return -1;
+
+    /* same value is written back, visible picture does not change */
+    for (size_t offset = 0; offset < size; offset += page_size)
+    {
+        page[offset] = page[offset];
+        pages++;
+    }
+    printf("prefaulted %zu pages\n", pages);
+    return 0;
+}
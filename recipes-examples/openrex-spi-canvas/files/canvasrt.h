@@ -0,0 +1,59 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Real-time profile of daemon threads: SCHED_FIFO priority, CPU affinity,
+ * locked memory and pre-faulted framebuffer mapping, so that neither
+ * scheduling nor page faults land in the middle of a frame.
+ */
+
+#ifndef __CANVASRT_H__
+#define __CANVASRT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* SCHED_FIFO priority, 0 is SCHED_OTHER (not inherited from creator),
+ * cpu -1 keeps inherited affinity */
+struct canvasrt_thread {
+    int32_t priority;
+    int32_t cpu;
+};
+
+int32_t canvasrt_parse(
+    struct canvasrt_thread *thread,
+    const char *text
+);
+
+int32_t canvasrt_apply(
+    const struct canvasrt_thread *thread,
+    const char *name
+);
+
+int32_t canvasrt_lock_memory(void);
+
+int32_t canvasrt_prefault(
+    void *mem,
+    const size_t size
+);
+
+#endif
@@ -0,0 +1,645 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "config.h"
+#include "fbscreen.h"
+#include "canvasstats.h"
+#include "canvasqueue.h"
+#include "canvasscene.h"
+
+/* glyph grid of font sprite, ASCII 32 to 127 */
+#define CANVASSCENE_FONT_COLUMNS        (16)
+#define CANVASSCENE_FONT_ROWS           (6)
+#define CANVASSCENE_FONT_FIRST          (32)
+
+void canvasscene_init(
+    struct canvasscene *scene
+)
+{
+    memset(scene, 0, sizeof(*scene));
+    scene->config.layer = CANVAS_LAYER_DIRECT;
+}
+
+/* size of one glyph, zero when font is missing */
+static void canvasscene_glyph(
+    const struct fbscreen *fbscreen,
+    const uint32_t font,
+    uint32_t *width,
+    uint32_t *height
+)
+{
+    const struct canvasasset_entry *entry;
+
+    *width = 0;
+    *height = 0;
+    entry = canvasasset_find(fbscreen->assets, font);
+    if ((NULL == entry) || (CANVASASSET_SPRITE != entry->type))
+        return;
+    *width = entry->width / CANVASSCENE_FONT_COLUMNS;
+    *height = entry->height / CANVASSCENE_FONT_ROWS;
+}
+
+/* coordinate of object edge, saturated to range of rectangle */
+static int32_t canvasscene_coord(
+    const int64_t value
+)
+{
+    if (value > INT32_MAX)
+        return INT32_MAX;
+    if (value < INT32_MIN)
+        return INT32_MIN;
+    return value;
+}
+
+/* box covered by object, empty when it draws nothing */
+static struct fbscreen_rect canvasscene_bounds(
+    const struct fbscreen *fbscreen,
+    const struct canvasscene_object *object
+)
+{
+    struct fbscreen_rect rect = { 0, 0, -1, -1 };
+    const struct canvasasset_entry *entry;
+    uint32_t width = object->width, height = object->height;
+
+    if (!(object->flags & CANVAS_SCENE_VISIBLE))
+        return rect;
+
+    if (CANVAS_SCENE_TEXT == object->type)
+    {
+        canvasscene_glyph(fbscreen, object->asset, &width, &height);
+        width *= object->length;
+    }
+    else if (CANVAS_SCENE_SPRITE == object->type)
+    {
+        entry = canvasasset_find(fbscreen->assets, object->asset);
+        if ((NULL == entry) || (CANVASASSET_SPRITE != entry->type))
+            return rect;
+        width = (width && (width < entry->width)) ? width : entry->width;
+        height = (height && (height < entry->height)) ? height : entry->height;
+    }
+    if (!width || !height)
+        return rect;
+
+    /* far edge of huge object is past any screen, it just must not wrap */
+    rect.x0 = object->xpos;
+    rect.y0 = object->ypos;
+    rect.x1 = canvasscene_coord((int64_t)object->xpos + width - 1);
+    rect.y1 = canvasscene_coord((int64_t)object->ypos + height - 1);
+    return rect;
+}
+
+/* region has to be repainted at flush. Overlapping regions are merged,
+ * so none is painted twice, and when there are too many of them the
+ * bounding box of all is repainted instead */
+static void canvasscene_damage(
+    struct fbscreen *fbscreen,
+    struct fbscreen_rect rect
+)
+{
+    struct canvasscene *scene = &fbscreen->scene;
+    struct fbscreen_rect screen = {
+        0, 0, (int32_t)fbscreen->var_info.xres - 1, (int32_t)fbscreen->var_info.yres - 1
+    };
+    struct fbscreen_rect *other;
+    uint32_t i = 0;
+
+    if ((rect.x0 > rect.x1) || !fbscreen_rect_intersect(&rect, &screen))
+        return;
+
+    while (i < scene->damage_count)
+    {
+        other = &scene->damage[i];
+        if ((other->x0 > rect.x1) || (other->x1 < rect.x0) ||
+            (other->y0 > rect.y1) || (other->y1 < rect.y0))
+        {
+            i++;
+            continue;
+        }
+        /* grown region may overlap the ones already passed */
+        fbscreen_rect_add(&rect, other);
+        *other = scene->damage[--scene->damage_count];
+        i = 0;
+    }
+
+    if (CANVASSCENE_DAMAGE_MAX == scene->damage_count)
+    {
+        for (i = 0; i < scene->damage_count; i++)
+            fbscreen_rect_add(&rect, &scene->damage[i]);
+        scene->damage_count = 0;
+    }
+    scene->damage[scene->damage_count++] = rect;
+}
+
+/* animation of object is dropped with it */
+static void canvasscene_stop_animations(
+    struct canvasscene *scene,
+    const uint32_t id
+)
+{
+    uint32_t i = 0;
+
+    while (i < scene->animating)
+    {
+        if (scene->animations[i].animate.id == id)
+            scene->animations[i] = scene->animations[--scene->animating];
+        else
+            i++;
+    }
+}
+
+/* whole scene is repainted with new background, objects are dropped */
+int32_t canvasscene_config(
+    struct fbscreen *fbscreen,
+    const struct cmd_scene_config *config
+)
+{
+    struct fbscreen_rect screen = {
+        0, 0, (int32_t)fbscreen->var_info.xres - 1, (int32_t)fbscreen->var_info.yres - 1
+    };
+
+    assert(!(NULL == fbscreen || NULL == config));
+    if (NULL == fbscreen || NULL == config)
+        return -1;
+
+    if ((CANVAS_LAYER_DIRECT != config->layer) && (config->layer >= CANVAS_LAYER_COUNT))
+        return -2;
+
+    canvasscene_init(&fbscreen->scene);
+    fbscreen->scene.config = *config;
+    canvasscene_damage(fbscreen, screen);
+    return 0;
+}
+
+int32_t canvasscene_create(
+    struct fbscreen *fbscreen,
+    const struct cmd_scene_create *create
+)
+{
+    struct canvasscene_object *object;
+
+    assert(!(NULL == fbscreen || NULL == create));
+    if (NULL == fbscreen || NULL == create)
+        return -1;
+
+    if ((create->id >= CANVAS_SCENE_OBJECTS) ||
+        (create->type < CANVAS_SCENE_RECT) || (create->type > CANVAS_SCENE_SPRITE))
+    {
+        return -2;
+    }
+
+    object = &fbscreen->scene.objects[create->id];
+    canvasscene_damage(fbscreen, canvasscene_bounds(fbscreen, object));
+    object->type = create->type;
+    object->flags = create->flags;
+    object->xpos = create->xpos;
+    object->ypos = create->ypos;
+    object->width = create->width;
+    object->height = create->height;
+    object->color = create->color;
+    object->asset = create->asset;
+    object->length = 0;
+    canvasscene_damage(fbscreen, canvasscene_bounds(fbscreen, object));
+    return 0;
+}
+
+/* old and new box are repainted, moving object does not leave a trail */
+int32_t canvasscene_update(
+    struct fbscreen *fbscreen,
+    const uint32_t id,
+    const uint32_t mask,
+    const int32_t *values
+)
+{
+    struct canvasscene_object *object;
+
+    assert(!(NULL == fbscreen || NULL == values));
+    if (NULL == fbscreen || NULL == values)
+        return -1;
+
+    if ((id >= CANVAS_SCENE_OBJECTS) || !fbscreen->scene.objects[id].type)
+        return -2;
+
+    object = &fbscreen->scene.objects[id];
+    canvasscene_damage(fbscreen, canvasscene_bounds(fbscreen, object));
+    for (uint32_t bit = 1; bit; bit <<= 1)
+    {
+        if (!(mask & bit))
+            continue;
+        switch (bit)
+        {
+            case CANVAS_SCENE_XPOS: object->xpos = *values; break;
+            case CANVAS_SCENE_YPOS: object->ypos = *values; break;
+            case CANVAS_SCENE_WIDTH: object->width = *values; break;
+            case CANVAS_SCENE_HEIGHT: object->height = *values; break;
+            case CANVAS_SCENE_COLOR: object->color = *values; break;
+            case CANVAS_SCENE_FLAGS: object->flags = *values; break;
+            case CANVAS_SCENE_ASSET: object->asset = *values; break;
+            /* newer property */
+            default: break;
+        }
+        values++;
+    }
+    canvasscene_damage(fbscreen, canvasscene_bounds(fbscreen, object));
+    return 0;
+}
+
+int32_t canvasscene_text(
+    struct fbscreen *fbscreen,
+    const uint32_t id,
+    const char *text,
+    const uint32_t length
+)
+{
+    struct canvasscene_object *object;
+
+    assert(!(NULL == fbscreen || NULL == text));
+    if (NULL == fbscreen || NULL == text)
+        return -1;
+
+    if ((id >= CANVAS_SCENE_OBJECTS) || (CANVAS_SCENE_TEXT != fbscreen->scene.objects[id].type) ||
+        (length > CANVAS_SCENE_TEXT_SIZE))
+    {
+        return -2;
+    }
+
+    object = &fbscreen->scene.objects[id];
+    canvasscene_damage(fbscreen, canvasscene_bounds(fbscreen, object));
+    memcpy(object->text, text, length);
+    object->length = length;
+    canvasscene_damage(fbscreen, canvasscene_bounds(fbscreen, object));
+    return 0;
+}
+
+int32_t canvasscene_delete(
+    struct fbscreen *fbscreen,
+    const uint32_t id
+)
+{
+    struct canvasscene_object *object;
+
+    assert(!(NULL == fbscreen));
+    if (NULL == fbscreen)
+        return -1;
+
+    if (id >= CANVAS_SCENE_OBJECTS)
+        return -2;
+
+    object = &fbscreen->scene.objects[id];
+    canvasscene_damage(fbscreen, canvasscene_bounds(fbscreen, object));
+    memset(object, 0, sizeof(*object));
+    canvasscene_stop_animations(&fbscreen->scene, id);
+    return 0;
+}
+
+/* animation of the same property is replaced, it starts from 'start'
+ * at next frame */
+int32_t canvasscene_start_animation(
+    struct fbscreen *fbscreen,
+    const struct cmd_animate *animate,
+    struct canvasqueue *replies,
+    const uint64_t now_ns
+)
+{
+    struct canvasscene *scene;
+    struct canvasscene_animation *animation = NULL;
+
+    assert(!(NULL == fbscreen || NULL == animate));
+    if (NULL == fbscreen || NULL == animate)
+        return -1;
+
+    scene = &fbscreen->scene;
+    if ((animate->id >= CANVAS_SCENE_OBJECTS) || !scene->objects[animate->id].type ||
+        (animate->property < CANVAS_SCENE_XPOS) || (animate->property > CANVAS_SCENE_COLOR) ||
+        (animate->property & (animate->property - 1)) || (animate->easing > CANVAS_EASE_IN_OUT))
+    {
+        return -2;
+    }
+
+    for (uint32_t i = 0; i < scene->animating; i++)
+    {
+        if ((scene->animations[i].animate.id == animate->id) &&
+            (scene->animations[i].animate.property == animate->property))
+        {
+            animation = &scene->animations[i];
+            break;
+        }
+    }
+    if (NULL == animation)
+    {
+        if (CANVAS_SCENE_ANIMATIONS == scene->animating)
+            return -3;
+        animation = &scene->animations[scene->animating++];
+    }
+    animation->animate = *animate;
+    animation->start_ns = now_ns;
+    animation->replies = replies;
+    return 0;
+}
+
+/* eased progress, 't' in [0, 1] */
+static double canvasscene_ease(
+    const uint32_t easing,
+    const double t
+)
+{
+    switch (easing)
+    {
+        case CANVAS_EASE_IN: return t * t;
+        case CANVAS_EASE_OUT: return t * (2.0 - t);
+        case CANVAS_EASE_IN_OUT: return t < 0.5 ? 2.0 * t * t : -1.0 + (4.0 - 2.0 * t) * t;
+        default: return t;
+    }
+}
+
+static int32_t canvasscene_lerp(
+    const int32_t start,
+    const int32_t end,
+    const double progress
+)
+{
+    return start + (int32_t)lround(((double)end - start) * progress);
+}
+
+/* finished animation goes to slave as tagged acknowledge, it is not an
+ * answer of legacy query waited for by link */
+static void canvasscene_notify(
+    const struct canvasscene_animation *animation
+)
+{
+    struct ack_animate_done done = {
+        .id = animation->animate.id,
+        .property = animation->animate.property,
+    };
+    struct canvasqueue_entry *entry;
+
+    if (NULL == animation->replies)
+        return;
+    entry = canvasqueue_reserve(animation->replies, sizeof(done));
+    if (NULL == entry)
+        return;
+    entry->cmd_code = CANVAS_ACK_ANIMATE_DONE;
+    entry->tag = animation->animate.tag;
+    entry->flags = CANVASQUEUE_FLAG_TAGGED;
+    memcpy(CANVASQUEUE_PAYLOAD(entry), &done, sizeof(done));
+    canvasqueue_commit(animation->replies, entry);
+}
+
+/* owner of 'replies' is gone, its animations finish silently */
+void canvasscene_forget_replies(
+    struct canvasscene *scene,
+    const struct canvasqueue *replies
+)
+{
+    for (uint32_t i = 0; i < scene->animating; i++)
+    {
+        if (scene->animations[i].replies == replies)
+            scene->animations[i].replies = NULL;
+    }
+}
+
+/* set properties for frame presented at 'now_ns', returns number of
+ * animations still running */
+int32_t canvasscene_animate(
+    struct fbscreen *fbscreen,
+    const uint64_t now_ns
+)
+{
+    struct canvasscene *scene;
+    struct canvasscene_animation *animation;
+    const struct cmd_animate *animate;
+    uint64_t duration_ns, elapsed_ns;
+    double progress;
+    int32_t value;
+    uint32_t i = 0;
+
+    assert(!(NULL == fbscreen));
+    if (NULL == fbscreen)
+        return -1;
+
+    scene = &fbscreen->scene;
+    while (i < scene->animating)
+    {
+        animation = &scene->animations[i];
+        animate = &animation->animate;
+        duration_ns = (uint64_t)animate->duration_ms * 1000000;
+        elapsed_ns = now_ns > animation->start_ns ? now_ns - animation->start_ns : 0;
+        progress = elapsed_ns >= duration_ns ? 1.0 :
+            canvasscene_ease(animate->easing, (double)elapsed_ns / duration_ns);
+
+        if (CANVAS_SCENE_COLOR == animate->property)
+        {
+            value = CANVAS_RGBCOLOR(
+                canvasscene_lerp(CANVAS_RGBCOLOR_RED(animate->start), CANVAS_RGBCOLOR_RED(animate->end), progress),
+                canvasscene_lerp(CANVAS_RGBCOLOR_GREEN(animate->start), CANVAS_RGBCOLOR_GREEN(animate->end), progress),
+                canvasscene_lerp(CANVAS_RGBCOLOR_BLUE(animate->start), CANVAS_RGBCOLOR_BLUE(animate->end), progress)
+            );
+        }
+        else
+        {
+            value = canvasscene_lerp(animate->start, animate->end, progress);
+        }
+        canvasscene_update(fbscreen, animate->id, animate->property, &value);
+
+        if (elapsed_ns < duration_ns)
+        {
+            i++;
+            continue;
+        }
+        canvasscene_notify(animation);
+        *animation = scene->animations[--scene->animating];
+    }
+    return scene->animating;
+}
+
+static void canvasscene_fill(
+    struct fbscreen *fbscreen,
+    const struct fbscreen_rect *rect,
+    const uint32_t color
+)
+{
+    struct cmd_rectangle fill = {
+        .xpos = rect->x0,
+        .ypos = rect->y0,
+        .color = color,
+        .in_centre = 0,
+        .width = rect->x1 - rect->x0 + 1,
+        .height = rect->y1 - rect->y0 + 1,
+    };
+
+    fbscreen_draw_rectangle(fbscreen, &fill);
+}
+
+/* part of sprite at 'xsrc', 'ysrc' which lands in 'clip' */
+static void canvasscene_blit(
+    struct fbscreen *fbscreen,
+    const uint32_t asset,
+    const int32_t xpos,
+    const int32_t ypos,
+    const int32_t xsrc,
+    const int32_t ysrc,
+    struct fbscreen_rect box,
+    const struct fbscreen_rect *clip
+)
+{
+    struct cmd_draw_asset draw;
+
+    if (!fbscreen_rect_intersect(&box, clip))
+        return;
+
+    draw.id = asset;
+    draw.xpos = box.x0;
+    draw.ypos = box.y0;
+    draw.xsrc = xsrc + (box.x0 - xpos);
+    draw.ysrc = ysrc + (box.y0 - ypos);
+    draw.width = box.x1 - box.x0 + 1;
+    draw.height = box.y1 - box.y0 + 1;
+    fbscreen_draw_asset(fbscreen, &draw);
+}
+
+/* column spans of the same disc fbscreen_draw_circle draws */
+static void canvasscene_circle(
+    struct fbscreen *fbscreen,
+    const struct canvasscene_object *object,
+    const struct fbscreen_rect *clip
+)
+{
+    int64_t radius = (object->width < object->height ? object->width : object->height) / 2;
+    int64_t xcentre = (int64_t)object->xpos + radius, ycentre = (int64_t)object->ypos + radius;
+    /* only columns of clip are visited, radius may be far beyond screen */
+    int64_t first = 1 - radius > clip->x0 - xcentre ? 1 - radius : clip->x0 - xcentre;
+    int64_t last = radius - 1 < clip->x1 - xcentre ? radius - 1 : clip->x1 - xcentre;
+    struct fbscreen_rect span;
+    int64_t ylimit;
+
+    for (int64_t i = first; i <= last; i++)
+    {
+        ylimit = sqrt(radius * radius - i * i);
+        span.x0 = span.x1 = xcentre + i;
+        span.y0 = canvasscene_coord(ycentre - ylimit + 1);
+        span.y1 = canvasscene_coord(ycentre + ylimit - 1);
+        if (fbscreen_rect_intersect(&span, clip))
+            canvasscene_fill(fbscreen, &span, object->color);
+    }
+}
+
+static void canvasscene_draw(
+    struct fbscreen *fbscreen,
+    const struct canvasscene_object *object,
+    const struct fbscreen_rect *bounds,
+    const struct fbscreen_rect *clip
+)
+{
+    struct fbscreen_rect box = *bounds;
+    struct fbscreen_rect glyph;
+    uint32_t width, height, index;
+
+    switch (object->type)
+    {
+        case CANVAS_SCENE_RECT:
+            if (fbscreen_rect_intersect(&box, clip))
+                canvasscene_fill(fbscreen, &box, object->color);
+        break;
+        case CANVAS_SCENE_CIRCLE:
+            canvasscene_circle(fbscreen, object, clip);
+        break;
+        case CANVAS_SCENE_SPRITE:
+            canvasscene_blit(fbscreen, object->asset, box.x0, box.y0, 0, 0, box, clip);
+        break;
+        /* glyphs outside of the font are left blank */
+        case CANVAS_SCENE_TEXT:
+            canvasscene_glyph(fbscreen, object->asset, &width, &height);
+            for (uint32_t i = 0; i < object->length; i++)
+            {
+                index = (uint8_t)object->text[i] - CANVASSCENE_FONT_FIRST;
+                if (index >= CANVASSCENE_FONT_COLUMNS * CANVASSCENE_FONT_ROWS)
+                    continue;
+                glyph.x0 = box.x0 + i * width;
+                glyph.y0 = box.y0;
+                glyph.x1 = glyph.x0 + width - 1;
+                glyph.y1 = box.y1;
+                canvasscene_blit(
+                    fbscreen, object->asset, glyph.x0, glyph.y0,
+                    (index % CANVASSCENE_FONT_COLUMNS) * width,
+                    (index / CANVASSCENE_FONT_COLUMNS) * height, glyph, clip
+                );
+            }
+        break;
+        default:
+        break;
+    }
+}
+
+/* repaint damaged regions, called before frame is flushed. Regions are
+ * disjoint, every pixel is written by background and objects above it */
+int32_t canvasscene_render(
+    struct fbscreen *fbscreen
+)
+{
+    struct canvasscene *scene;
+    struct fbscreen_rect bounds[CANVAS_SCENE_OBJECTS];
+    struct fbscreen_rect area;
+    uint32_t layer_target;
+    uint64_t start_ns;
+
+    assert(!(NULL == fbscreen));
+    if (NULL == fbscreen)
+        return -1;
+
+    scene = &fbscreen->scene;
+    if (!scene->damage_count)
+        return 0;
+
+    start_ns = canvasstats_now_ns();
+
+    /* scene layer may be disabled since config, then nothing is shown */
+    layer_target = fbscreen->layer_target;
+    if (0 > fbscreen_select_layer(fbscreen, scene->config.layer))
+    {
+        scene->damage_count = 0;
+        return -2;
+    }
+
+    for (uint32_t i = 0; i < CANVAS_SCENE_OBJECTS; i++)
+        bounds[i] = canvasscene_bounds(fbscreen, &scene->objects[i]);
+
+    for (uint32_t d = 0; d < scene->damage_count; d++)
+    {
+        canvasscene_fill(fbscreen, &scene->damage[d], scene->config.background);
+        for (uint32_t i = 0; i < CANVAS_SCENE_OBJECTS; i++)
+        {
+            area = bounds[i];
+            if ((area.x0 > area.x1) || !fbscreen_rect_intersect(&area, &scene->damage[d]))
+                continue;
+            canvasscene_draw(fbscreen, &scene->objects[i], &bounds[i], &area);
+        }
+    }
+    scene->damage_count = 0;
+    fbscreen->layer_target = layer_target;
+
+    canvasstats_sample(&canvasstats.scene, canvasstats_now_ns() - start_ns);
+    return 0;
+}
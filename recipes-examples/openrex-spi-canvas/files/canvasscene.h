@@ -0,0 +1,129 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Retained scene. Slave creates objects once and then sends only changed
+ * properties, daemon keeps regions touched since previous flush and at
+ * flush repaints just them: background, then intersecting visible objects
+ * in order of id, each clipped to the region.
+ */
+
+#ifndef __CANVASSCENE_H__
+#define __CANVASSCENE_H__
+
+#include <stdint.h>
+#include "canvas_common.h"
+#include "fbrect.h"
+
+/* separate regions kept until flush, more are merged into one */
+#define CANVASSCENE_DAMAGE_MAX          (16)
+
+struct fbscreen;
+struct canvasqueue;
+
+/* 'type' is zero for free slot */
+struct canvasscene_object {
+    uint32_t type;
+    uint32_t flags;
+    int32_t xpos;
+    int32_t ypos;
+    uint32_t width;
+    uint32_t height;
+    uint32_t color;
+    uint32_t asset;
+    uint32_t length;
+    char text[CANVAS_SCENE_TEXT_SIZE];
+};
+
+/* running animation, 'replies' is queue of slave which started it */
+struct canvasscene_animation {
+    struct cmd_animate animate;
+    uint64_t start_ns;
+    struct canvasqueue *replies;
+};
+
+struct canvasscene {
+    struct cmd_scene_config config;
+    struct canvasscene_object objects[CANVAS_SCENE_OBJECTS];
+    /* first 'animating' entries are running */
+    struct canvasscene_animation animations[CANVAS_SCENE_ANIMATIONS];
+    uint32_t animating;
+    /* disjoint regions to repaint at flush */
+    struct fbscreen_rect damage[CANVASSCENE_DAMAGE_MAX];
+    uint32_t damage_count;
+};
+
+void canvasscene_init(
+    struct canvasscene *scene
+);
+
+int32_t canvasscene_config(
+    struct fbscreen *fbscreen,
+    const struct cmd_scene_config *config
+);
+
+int32_t canvasscene_create(
+    struct fbscreen *fbscreen,
+    const struct cmd_scene_create *create
+);
+
+int32_t canvasscene_update(
+    struct fbscreen *fbscreen,
+    const uint32_t id,
+    const uint32_t mask,
+    const int32_t *values
+);
+
+int32_t canvasscene_text(
+    struct fbscreen *fbscreen,
+    const uint32_t id,
+    const char *text,
+    const uint32_t length
+);
+
+int32_t canvasscene_delete(
+    struct fbscreen *fbscreen,
+    const uint32_t id
+);
+
+int32_t canvasscene_start_animation(
+    struct fbscreen *fbscreen,
+    const struct cmd_animate *animate,
+    struct canvasqueue *replies,
+    const uint64_t now_ns
+);
+
+void canvasscene_forget_replies(
+    struct canvasscene *scene,
+    const struct canvasqueue *replies
+);
+
+int32_t canvasscene_animate(
+    struct fbscreen *fbscreen,
+    const uint64_t now_ns
+);
+
+int32_t canvasscene_render(
+    struct fbscreen *fbscreen
+);
+
+#endif
@@ -0,0 +1,303 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "config.h"
+#include "fbscreen.h"
+#include "canvassnap.h"
+
+#define CANVASSNAP_PAD(size)            (((size) + 3) & ~3)
+
+/* picture currently scanned out, upright one for rotated panel */
+static const uint8_t *canvassnap_front(
+    const struct fbscreen *fbscreen
+)
+{
+    if (NULL != fbscreen->shadow_mem)
+        return fbscreen->shadow_mem;
+    if (fbscreen->single_buffer)
+        return fbscreen->drawing_mem;
+    return fbscreen->drawing_addrs[fbscreen->drawing_idx ^ 0x1];
+}
+
+static int32_t canvassnap_write_section(
+    FILE *file,
+    const uint32_t id,
+    const void *head,
+    const uint32_t head_size,
+    const void *data,
+    const uint32_t data_size
+)
+{
+    struct canvassnap_section section = {
+        .id = id,
+        .size = head_size + data_size,
+    };
+    static const uint8_t padding[4] = {0};
+
+    if ((1 != fwrite(&section, sizeof(section), 1, file)) ||
+        (1 != fwrite(head, head_size, 1, file)) ||
+        (data_size && (1 != fwrite(data, data_size, 1, file))))
+    {
+        return -1;
+    }
+    if (CANVASSNAP_PAD(section.size) != section.size)
+    {
+        if (1 != fwrite(padding, CANVASSNAP_PAD(section.size) - section.size, 1, file))
+            return -1;
+    }
+    return 0;
+}
+
+/* file is replaced atomically, crash while saving keeps old snapshot */
+int32_t canvassnap_save(
+    const char *path,
+    const struct fbscreen *fbscreen
+)
+{
+    struct canvassnap_header header = {
+        .magic = CANVASSNAP_MAGIC,
+        .version = CANVASSNAP_VERSION,
+        .sections = 2,
+    };
+    struct canvassnap_screen screen;
+    struct canvassnap_layer layer;
+    struct canvassnap_palette palette;
+    char tmp_path[512];
+    FILE *file;
+    int32_t result = 0;
+
+    assert(!(NULL == path || NULL == fbscreen));
+    if (NULL == path || NULL == fbscreen)
+        return -1;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    file = fopen(tmp_path, "wb");
+    if (NULL == file)
+        return -1;
+
+    screen.xres = fbscreen->var_info.xres;
+    screen.yres = fbscreen->var_info.yres;
+    screen.bits_per_pixel = fbscreen->var_info.bits_per_pixel;
+    palette.bits_per_pixel = screen.bits_per_pixel;
+    for (uint32_t i = 0; i < CANVAS_LAYER_COUNT; i++)
+    {
+        if (NULL != fbscreen->layers[i].mem)
+            header.sections++;
+    }
+
+    if ((1 != fwrite(&header, sizeof(header), 1, file)) ||
+        (0 > canvassnap_write_section(
+            file, CANVASSNAP_SECTION_SCREEN, &screen, sizeof(screen),
+            canvassnap_front(fbscreen), fbscreen->drawing_mem_size)) ||
+        (0 > canvassnap_write_section(
+            file, CANVASSNAP_SECTION_PALETTE, &palette, sizeof(palette),
+            fbscreen->palette, sizeof(fbscreen->palette))))
+    {
+        result = -1;
+    }
+
+    /* static layers are the point of keeping state, slave drew them once */
+    for (uint32_t i = 0; (i < CANVAS_LAYER_COUNT) && (0 == result); i++)
+    {
+        if (NULL == fbscreen->layers[i].mem)
+            continue;
+        layer.xres = screen.xres;
+        layer.yres = screen.yres;
+        layer.bits_per_pixel = screen.bits_per_pixel;
+        layer.layer = i;
+        layer.flags = fbscreen->layers[i].flags;
+        layer.key_pixel = fbscreen->layers[i].key_pixel;
+        if (0 > canvassnap_write_section(
+            file, CANVASSNAP_SECTION_LAYER, &layer, sizeof(layer),
+            fbscreen->layers[i].mem, fbscreen->drawing_mem_size))
+        {
+            result = -1;
+        }
+    }
+    if (0 != fclose(file))
+        result = -1;
+
+    if ((0 > result) || (0 != rename(tmp_path, path)))
+    {
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/* picture of different geometry is ignored */
+static int32_t canvassnap_restore_screen(
+    struct fbscreen *fbscreen,
+    FILE *file,
+    const uint32_t size
+)
+{
+    struct canvassnap_screen screen;
+
+    if ((size != sizeof(screen) + fbscreen->drawing_mem_size) ||
+        (1 != fread(&screen, sizeof(screen), 1, file)))
+    {
+        return 0;
+    }
+    if ((screen.xres != fbscreen->var_info.xres) ||
+        (screen.yres != fbscreen->var_info.yres) ||
+        (screen.bits_per_pixel != fbscreen->var_info.bits_per_pixel))
+    {
+        return 0;
+    }
+
+    /* rotated panel gets it at first flushes */
+    if (NULL != fbscreen->shadow_mem)
+    {
+        if (1 != fread(fbscreen->shadow_mem, fbscreen->drawing_mem_size, 1, file))
+            return -1;
+        fbscreen_damage_frame(fbscreen);
+        return 1;
+    }
+
+    /* both halves, it is shown right away and drawing continues from it */
+    if (1 != fread(fbscreen->drawing_addrs[0], fbscreen->drawing_mem_size, 1, file))
+        return -1;
+    memcpy(fbscreen->drawing_addrs[1], fbscreen->drawing_addrs[0], fbscreen->drawing_mem_size);
+    return 1;
+}
+
+/* layer of different geometry is ignored, it is composited at next flush */
+static int32_t canvassnap_restore_layer(
+    struct fbscreen *fbscreen,
+    FILE *file,
+    const uint32_t size
+)
+{
+    struct canvassnap_layer layer;
+
+    if ((size != sizeof(layer) + fbscreen->drawing_mem_size) ||
+        (1 != fread(&layer, sizeof(layer), 1, file)))
+    {
+        return 0;
+    }
+    if ((layer.xres != fbscreen->var_info.xres) ||
+        (layer.yres != fbscreen->var_info.yres) ||
+        (layer.bits_per_pixel != fbscreen->var_info.bits_per_pixel) ||
+        (layer.layer >= CANVAS_LAYER_COUNT) ||
+        !(layer.flags & CANVAS_LAYER_ENABLE))
+    {
+        return 0;
+    }
+
+    if (0 > fbscreen_set_layer(fbscreen, layer.layer, layer.flags, 0))
+        return -1;
+    fbscreen->layers[layer.layer].key_pixel = layer.key_pixel;
+    if (1 != fread(fbscreen->layers[layer.layer].mem, fbscreen->drawing_mem_size, 1, file))
+        return -1;
+    return 1;
+}
+
+/* entries are in pixel format, they are useless for other depth */
+static int32_t canvassnap_restore_palette(
+    struct fbscreen *fbscreen,
+    FILE *file,
+    const uint32_t size
+)
+{
+    struct canvassnap_palette palette;
+
+    if ((size != sizeof(palette) + sizeof(fbscreen->palette)) ||
+        (1 != fread(&palette, sizeof(palette), 1, file)) ||
+        (palette.bits_per_pixel != fbscreen->var_info.bits_per_pixel))
+    {
+        return 0;
+    }
+    if (1 != fread(fbscreen->palette, sizeof(fbscreen->palette), 1, file))
+        return -1;
+    return 1;
+}
+
+/* returns number of restored sections */
+int32_t canvassnap_restore(
+    const char *path,
+    struct fbscreen *fbscreen,
+    const uint32_t flags
+)
+{
+    struct canvassnap_header header;
+    struct canvassnap_section section;
+    long next;
+    FILE *file;
+    int32_t restored = 0;
+    int32_t result;
+
+    assert(!(NULL == path || NULL == fbscreen));
+    if (NULL == path || NULL == fbscreen)
+        return -1;
+
+    file = fopen(path, "rb");
+    if (NULL == file)
+        return -1;
+
+    if ((1 != fread(&header, sizeof(header), 1, file)) ||
+        (CANVASSNAP_MAGIC != header.magic) || (CANVASSNAP_VERSION != header.version))
+    {
+        fclose(file);
+        return -2;
+    }
+
+    for (uint32_t i = 0; i < header.sections; i++)
+    {
+        if (1 != fread(&section, sizeof(section), 1, file))
+            break;
+        next = ftell(file) + CANVASSNAP_PAD(section.size);
+
+        result = 0;
+        switch (section.id)
+        {
+            case CANVASSNAP_SECTION_SCREEN:
+                if (!(flags & CANVASSNAP_SKIP_SCREEN))
+                    result = canvassnap_restore_screen(fbscreen, file, section.size);
+            break;
+            case CANVASSNAP_SECTION_LAYER:
+                result = canvassnap_restore_layer(fbscreen, file, section.size);
+            break;
+            case CANVASSNAP_SECTION_PALETTE:
+                result = canvassnap_restore_palette(fbscreen, file, section.size);
+            break;
+            /* unknown section, newer snapshot */
+            default:
+            break;
+        }
+        if (0 > result)
+            break;
+        restored += result;
+
+        if (0 != fseek(file, next, SEEK_SET))
+            break;
+    }
+
+    fclose(file);
+    return restored;
+}
@@ -0,0 +1,95 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Snapshot of daemon state kept across restarts (upgrade). File is a
+ * list of sections, reader skips sections it does not know, so caches
+ * added later do not break older snapshots.
+ *
+ * File layout (little endian):
+ *  struct canvassnap_header
+ *  struct canvassnap_section + 'size' bytes of data, padded to 4B
+ *  ...
+ */
+
+#ifndef __CANVASSNAP_H__
+#define __CANVASSNAP_H__
+
+#include <stdint.h>
+#include "fbscreen.h"
+
+#define CANVASSNAP_MAGIC                (0x4E535643) /* "CVSN" */
+#define CANVASSNAP_VERSION              (1)
+
+/* section identifiers */
+#define CANVASSNAP_SECTION_SCREEN       (1)
+#define CANVASSNAP_SECTION_LAYER        (2)
+#define CANVASSNAP_SECTION_PALETTE      (3)
+
+/* restore flags */
+#define CANVASSNAP_SKIP_SCREEN          (1 << 0)
+
+struct canvassnap_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sections;
+};
+
+struct canvassnap_section {
+    uint32_t id;
+    uint32_t size;
+};
+
+/* CANVASSNAP_SECTION_SCREEN, followed by displayed picture */
+struct canvassnap_screen {
+    uint32_t xres;
+    uint32_t yres;
+    uint32_t bits_per_pixel;
+};
+
+/* CANVASSNAP_SECTION_LAYER, followed by layer memory */
+struct canvassnap_layer {
+    uint32_t xres;
+    uint32_t yres;
+    uint32_t bits_per_pixel;
+    uint32_t layer;
+    uint32_t flags;
+    uint32_t key_pixel;
+};
+
+/* CANVASSNAP_SECTION_PALETTE, followed by CANVAS_PALETTE_SIZE pixels */
+struct canvassnap_palette {
+    uint32_t bits_per_pixel;
+};
+
+int32_t canvassnap_save(
+    const char *path,
+    const struct fbscreen *fbscreen
+);
+
+int32_t canvassnap_restore(
+    const char *path,
+    struct fbscreen *fbscreen,
+    const uint32_t flags
+);
+
+#endif
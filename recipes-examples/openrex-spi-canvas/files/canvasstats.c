@@ -0,0 +1,277 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "config.h"
+#include "canvas_common.h"
+#include "canvasstats.h"
+
+struct canvasstats canvasstats;
+
+/* add latency sample, 'max_ns' is best effort with concurrent writers */
+void canvasstats_sample(
+    struct canvasstats_latency *latency,
+    const uint64_t ns
+)
+{
+    uint64_t us = ns / 1000;
+    uint32_t bucket = 0;
+
+    if (us)
+        bucket = us > UINT32_MAX ? 32 : 32 - __builtin_clz((uint32_t)us);
+    if (bucket >= CANVASSTATS_BUCKETS)
+        bucket = CANVASSTATS_BUCKETS - 1;
+
+    CANVASSTATS_ADD(latency->count, 1);
+    CANVASSTATS_ADD(latency->sum_ns, ns);
+    CANVASSTATS_ADD(latency->histogram[bucket], 1);
+    if (ns > CANVASSTATS_LOAD(latency->max_ns))
+        __atomic_store_n(&latency->max_ns, ns, __ATOMIC_RELAXED);
+}
+
+static const struct canvasstats_latency *canvasstats_select(
+    const struct canvasstats *stats,
+    const uint32_t id
+)
+{
+    if (id < 256)
+        return &stats->commands[id];
+    if (CANVAS_STATS_VSYNC == id)
+        return &stats->vsync_wait;
+    if (CANVAS_STATS_FLUSH == id)
+        return &stats->flush_copy;
+    if (CANVAS_STATS_COMPOSITE == id)
+        return &stats->composite;
+    if (CANVAS_STATS_SCENE == id)
+        return &stats->scene;
+    if (CANVAS_STATS_ROTATE == id)
+        return &stats->rotate;
+    if (CANVAS_STATS_VISIBLE == id)
+        return &stats->visible;
+    return NULL;
+}
+
+/* fill GET_STATS answer, totals are filled even for unknown 'id' */
+int32_t canvasstats_fill(
+    const struct canvasstats *stats,
+    const uint32_t id,
+    struct ack_stats *ack_stats
+)
+{
+    const struct canvasstats_latency *latency;
+    uint64_t count;
+
+    assert(!(NULL == stats || NULL == ack_stats));
+    if (NULL == stats || NULL == ack_stats)
+        return -1;
+
+    memset(ack_stats, 0, sizeof(*ack_stats));
+    ack_stats->id = id;
+    ack_stats->rx_bytes = CANVASSTATS_LOAD(stats->rx_bytes);
+    ack_stats->rx_commands = CANVASSTATS_LOAD(stats->rx_commands);
+    ack_stats->frames = CANVASSTATS_LOAD(stats->frames);
+    ack_stats->frames_merged = CANVASSTATS_LOAD(stats->frames_merged);
+    ack_stats->frames_skipped = CANVASSTATS_LOAD(stats->frames_skipped);
+
+    latency = canvasstats_select(stats, id);
+    if (NULL == latency)
+        return -1;
+
+    count = CANVASSTATS_LOAD(latency->count);
+    ack_stats->count = count;
+    ack_stats->avg_us = count ? CANVASSTATS_LOAD(latency->sum_ns) / count / 1000 : 0;
+    ack_stats->max_us = CANVASSTATS_LOAD(latency->max_ns) / 1000;
+    for (int i = 0; i < CANVASSTATS_BUCKETS; i++)
+        ack_stats->histogram[i] = CANVASSTATS_LOAD(latency->histogram[i]);
+    return 0;
+}
+
+static void canvasstats_dump_latency(
+    FILE *file,
+    const char *name,
+    const struct canvasstats_latency *latency
+)
+{
+    uint64_t count = CANVASSTATS_LOAD(latency->count);
+
+    fprintf(file, "%s count %llu avg_us %.1f max_us %.1f hist",
+        name, (unsigned long long)count,
+        count ? CANVASSTATS_LOAD(latency->sum_ns) / 1e3 / count : 0.0,
+        CANVASSTATS_LOAD(latency->max_ns) / 1e3);
+    for (int i = 0; i < CANVASSTATS_BUCKETS; i++)
+        fprintf(file, " %u", CANVASSTATS_LOAD(latency->histogram[i]));
+    fprintf(file, "\n");
+}
+
+/* text dump, one counter or latency per line */
+int32_t canvasstats_dump(
+    const struct canvasstats *stats,
+    FILE *file
+)
+{
+    char name[16];
+
+    assert(!(NULL == stats || NULL == file));
+    if (NULL == stats || NULL == file)
+        return -1;
+
+    fprintf(file, "rx_bytes %llu\n", (unsigned long long)CANVASSTATS_LOAD(stats->rx_bytes));
+    fprintf(file, "rx_commands %llu\n", (unsigned long long)CANVASSTATS_LOAD(stats->rx_commands));
+    fprintf(file, "frames %llu\n", (unsigned long long)CANVASSTATS_LOAD(stats->frames));
+    fprintf(file, "frames_merged %llu\n", (unsigned long long)CANVASSTATS_LOAD(stats->frames_merged));
+    fprintf(file, "frames_skipped %llu\n", (unsigned long long)CANVASSTATS_LOAD(stats->frames_skipped));
+    for (int i = 0; i < 256; i++)
+    {
+        if (0 == CANVASSTATS_LOAD(stats->commands[i].count))
+            continue;
+        snprintf(name, sizeof(name), "cmd_0x%02x", i);
+        canvasstats_dump_latency(file, name, &stats->commands[i]);
+    }
+    canvasstats_dump_latency(file, "vsync_wait", &stats->vsync_wait);
+    canvasstats_dump_latency(file, "flush_copy", &stats->flush_copy);
+    canvasstats_dump_latency(file, "composite", &stats->composite);
+    canvasstats_dump_latency(file, "scene", &stats->scene);
+    canvasstats_dump_latency(file, "rotate", &stats->rotate);
+    canvasstats_dump_latency(file, "visible", &stats->visible);
+    fflush(file);
+    return 0;
+}
+
+/* every client gets single dump and connection is closed */
+static void *canvasstats_server_thread(
+    void *arg
+)
+{
+    struct canvasstats_server *server = arg;
+    struct pollfd fds[2] = {
+        { .fd = server->fd, .events = POLLIN },
+        { .fd = server->wake_fd, .events = POLLIN },
+    };
+    int32_t client;
+    FILE *file;
+
+    while (1)
+    {
+        if (0 > poll(fds, 2, -1))
+            continue;
+        if (fds[1].revents)
+            break;
+        if (!fds[0].revents)
+            continue;
+
+        client = accept(server->fd, NULL, NULL);
+        if (client < 0)
+            continue;
+        file = fdopen(client, "w");
+        if (NULL == file)
+        {
+            close(client);
+            continue;
+        }
+        canvasstats_dump(&canvasstats, file);
+        fclose(file);
+    }
+    return NULL;
+}
+
+int32_t canvasstats_server_start(
+    struct canvasstats_server *server,
+    const char *path
+)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    sigset_t sigset, sigset_old;
+    int32_t result;
+
+    assert(!(NULL == server || NULL == path || strlen(path) >= sizeof(address.sun_path)));
+    if (NULL == server || NULL == path || strlen(path) >= sizeof(address.sun_path))
+        return -1;
+
+    memset(server, 0, sizeof(*server));
+    strncpy(server->path, path, sizeof(server->path) - 1);
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    server->wake_fd = eventfd(0, EFD_CLOEXEC);
+    server->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server->fd < 0 || server->wake_fd < 0)
+        goto error;
+
+    /* socket left behind by previous run */
+    unlink(path);
+    if ((0 > bind(server->fd, (struct sockaddr*)&address, sizeof(address))) ||
+        (0 > listen(server->fd, 4)))
+    {
+        goto error;
+    }
+
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_BLOCK, &sigset, &sigset_old);
+    result = pthread_create(&server->thread, NULL, canvasstats_server_thread, server);
+    pthread_sigmask(SIG_SETMASK, &sigset_old, NULL);
+    if (0 != result)
+    {
+        unlink(path);
+        goto error;
+    }
+    return 0;
+
+    error:
+        if (server->fd >= 0)
+            close(server->fd);
+        if (server->wake_fd >= 0)
+            close(server->wake_fd);
+        server->fd = -1;
+        server->wake_fd = -1;
+        return -1;
+}
+
+int32_t canvasstats_server_stop(
+    struct canvasstats_server *server
+)
+{
+    uint64_t value = 1;
+
+    if (NULL == server || server->fd < 0)
+        return -1;
+
+    if (sizeof(value) != write(server->wake_fd, &value, sizeof(value)))
+        return -1;
+    pthread_join(server->thread, NULL);
+    close(server->fd);
+    close(server->wake_fd);
+    unlink(server->path);
+    server->fd = -1;
+    server->wake_fd = -1;
+    return 0;
+}
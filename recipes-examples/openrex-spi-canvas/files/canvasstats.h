@@ -0,0 +1,119 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Performance counters of the daemon, summed over all displays. Counters
+ * are updated with relaxed atomic additions, so several receive or
+ * presenter threads may share one and hot path pays only for a clock read
+ * and a few additions, only maximum may miss a concurrent sample. Readers
+ * (GET_STATS, SIGUSR1 dump, stats socket) may see counters of a sample
+ * which is just being added, numbers are consistent enough for humans.
+ *
+ * Latencies are kept in log2 histograms of microseconds: bucket 0 counts
+ * samples below 1 us, bucket i counts samples in [2^(i-1), 2^i) us and
+ * the last bucket everything above.
+ */
+
+#ifndef __CANVASSTATS_H__
+#define __CANVASSTATS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "canvas_common.h"
+
+#define CANVASSTATS_BUCKETS             CANVAS_STATS_BUCKETS
+
+#define CANVASSTATS_ADD(counter, value) __atomic_fetch_add(&(counter), (value), __ATOMIC_RELAXED)
+#define CANVASSTATS_LOAD(counter)       __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+struct canvasstats_latency {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint32_t histogram[CANVASSTATS_BUCKETS];
+};
+
+struct canvasstats {
+    /* receive thread */
+    uint64_t rx_bytes;
+    uint64_t rx_commands;
+    /* renderer */
+    uint64_t frames;
+    uint64_t frames_merged;
+    uint64_t frames_skipped;
+    struct canvasstats_latency commands[256];
+    struct canvasstats_latency vsync_wait;
+    struct canvasstats_latency flush_copy;
+    struct canvasstats_latency composite;
+    struct canvasstats_latency scene;
+    struct canvasstats_latency rotate;
+    /* pipeline tracing */
+    struct canvasstats_latency visible;
+};
+
+/* local socket serving text dump of counters */
+struct canvasstats_server {
+    int32_t fd;
+    int32_t wake_fd;
+    pthread_t thread;
+    char path[108];
+};
+
+/* process wide counters */
+extern struct canvasstats canvasstats;
+
+static inline uint64_t canvasstats_now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void canvasstats_sample(
+    struct canvasstats_latency *latency,
+    const uint64_t ns
+);
+
+int32_t canvasstats_fill(
+    const struct canvasstats *stats,
+    const uint32_t id,
+    struct ack_stats *ack_stats
+);
+
+int32_t canvasstats_dump(
+    const struct canvasstats *stats,
+    FILE *file
+);
+
+int32_t canvasstats_server_start(
+    struct canvasstats_server *server,
+    const char *path
+);
+
+int32_t canvasstats_server_stop(
+    struct canvasstats_server *server
+);
+
+#endif
@@ -0,0 +1,228 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+
+#include "config.h"
+#include "canvas_common.h"
+#include "canvasstats.h"
+#include "canvastimeline.h"
+
+/* marker file of tracefs, older kernels mount it under debugfs */
+static const char *canvastimeline_marker_paths[] = {
+    "/sys/kernel/tracing/trace_marker",
+    "/sys/kernel/debug/tracing/trace_marker",
+};
+
+static const char *canvastimeline_names[CANVASTIMELINE_POINTS] = {
+    "received",
+    "decoded",
+    "raster_begin",
+    "raster_end",
+    "pan",
+    "vsync_wait",
+    "visible",
+};
+
+uint32_t canvastimeline_enabled;
+static int32_t canvastimeline_marker_fd = -1;
+
+/* start tracing, returns 1 when markers go to ftrace, 0 when
+ * only timeline is kept (tracefs missing or not writable) */
+int32_t canvastimeline_enable(void)
+{
+    uint32_t i;
+
+    for (i = 0; (canvastimeline_marker_fd < 0) && (i < 2); i++)
+        canvastimeline_marker_fd = open(canvastimeline_marker_paths[i], O_WRONLY | O_CLOEXEC);
+    canvastimeline_enabled = 1;
+    return canvastimeline_marker_fd >= 0 ? 1 : 0;
+}
+
+void canvastimeline_disable(void)
+{
+    canvastimeline_enabled = 0;
+    if (canvastimeline_marker_fd >= 0)
+        close(canvastimeline_marker_fd);
+    canvastimeline_marker_fd = -1;
+}
+
+/* single write is single ftrace event, threads do not interleave */
+static void canvastimeline_write(
+    const char *marker,
+    int32_t size
+)
+{
+    ssize_t result;
+
+    if ((canvastimeline_marker_fd < 0) || (size <= 0))
+        return;
+    result = write(canvastimeline_marker_fd, marker, size);
+    (void)result;
+}
+
+void canvastimeline_mark(
+    const uint32_t id,
+    const uint32_t frame,
+    const enum canvastimeline_point point
+)
+{
+    char marker[64];
+
+    if (canvastimeline_marker_fd < 0)
+        return;
+    canvastimeline_write(marker, snprintf(marker, sizeof(marker),
+        "canvas d=%u f=%u %s\n", id, frame, canvastimeline_names[point]));
+}
+
+/* command taken by renderer, first one opens the frame */
+void canvastimeline_command(
+    struct canvastimeline *timeline,
+    const uint32_t frame,
+    const uint64_t received_ns,
+    const uint32_t draw
+)
+{
+    struct canvastimeline_frame *current = &timeline->current;
+    uint64_t now_ns = canvasstats_now_ns();
+
+    if (0 == current->commands++)
+    {
+        current->first = frame;
+        current->ns[CANVASTIMELINE_RECEIVED] = received_ns ? received_ns : now_ns;
+        current->ns[CANVASTIMELINE_DECODED] = now_ns;
+        canvastimeline_mark(timeline->id, frame, CANVASTIMELINE_DECODED);
+    }
+    current->last = frame;
+    if (draw && !current->ns[CANVASTIMELINE_RASTER_BEGIN])
+    {
+        current->ns[CANVASTIMELINE_RASTER_BEGIN] = now_ns;
+        canvastimeline_mark(timeline->id, frame, CANVASTIMELINE_RASTER_BEGIN);
+    }
+}
+
+void canvastimeline_point(
+    struct canvastimeline *timeline,
+    const enum canvastimeline_point point
+)
+{
+    timeline->current.ns[point] = canvasstats_now_ns();
+    canvastimeline_mark(timeline->id, timeline->current.last, point);
+}
+
+/* next frame starts empty, frames without commands (animation) are
+ * reported with number of the last slave frame */
+static void canvastimeline_reset(
+    struct canvastimeline *timeline
+)
+{
+    struct canvastimeline_frame *current = &timeline->current;
+    uint32_t present = current->present;
+    uint32_t last = current->last;
+
+    memset(current, 0, sizeof(*current));
+    current->present = present;
+    current->first = last;
+    current->last = last;
+}
+
+/* frame is visible, it is moved to ring and next one starts */
+void canvastimeline_finish(
+    struct canvastimeline *timeline
+)
+{
+    struct canvastimeline_frame *current = &timeline->current;
+    uint64_t latency_ns = 0;
+    char marker[96];
+
+    current->ns[CANVASTIMELINE_VISIBLE] = canvasstats_now_ns();
+    if (current->ns[CANVASTIMELINE_RECEIVED])
+    {
+        latency_ns = current->ns[CANVASTIMELINE_VISIBLE] - current->ns[CANVASTIMELINE_RECEIVED];
+        canvasstats_sample(&canvasstats.visible, latency_ns);
+    }
+    if (canvastimeline_marker_fd >= 0)
+    {
+        canvastimeline_write(marker, snprintf(marker, sizeof(marker),
+            "canvas d=%u f=%u visible p=%u latency_us=%llu\n", timeline->id, current->last,
+            current->present, (unsigned long long)latency_ns / 1000));
+    }
+
+    /* dump may read the ring meanwhile, it sees finished frames only */
+    timeline->frames[timeline->head & (CANVASTIMELINE_FRAMES - 1)] = *current;
+    __atomic_store_n(&timeline->head, timeline->head + 1, __ATOMIC_RELEASE);
+    current->present++;
+    canvastimeline_reset(timeline);
+}
+
+/* flush with nothing drawn, commands so far are not shown by any frame */
+void canvastimeline_skip(
+    struct canvastimeline *timeline
+)
+{
+    canvastimeline_reset(timeline);
+}
+
+/* one frame per line, points in us since the first command was received,
+ * frame without commands counts from its composition */
+int32_t canvastimeline_dump(
+    const struct canvastimeline *timeline,
+    FILE *file
+)
+{
+    const struct canvastimeline_frame *frame;
+    uint32_t head;
+    uint32_t idx;
+    uint64_t base_ns;
+
+    assert(!(NULL == timeline || NULL == file));
+    if (NULL == timeline || NULL == file)
+        return -1;
+
+    head = __atomic_load_n(&timeline->head, __ATOMIC_ACQUIRE);
+    idx = head > CANVASTIMELINE_FRAMES ? head - CANVASTIMELINE_FRAMES : 0;
+    for (; idx != head; idx++)
+    {
+        frame = &timeline->frames[idx & (CANVASTIMELINE_FRAMES - 1)];
+        base_ns = frame->ns[CANVASTIMELINE_RECEIVED];
+        if (!base_ns)
+            base_ns = frame->ns[CANVASTIMELINE_RASTER_END];
+        fprintf(file, "display %u present %u frames %u-%u commands %u received_ns %llu",
+            timeline->id, frame->present, frame->first, frame->last, frame->commands,
+            (unsigned long long)frame->ns[CANVASTIMELINE_RECEIVED]);
+        for (int i = CANVASTIMELINE_DECODED; i < CANVASTIMELINE_POINTS; i++)
+        {
+            if (!base_ns || !frame->ns[i])
+                fprintf(file, " %s -", canvastimeline_names[i]);
+            else
+                fprintf(file, " %s %.1f", canvastimeline_names[i], (frame->ns[i] - base_ns) / 1e3);
+        }
+        fprintf(file, "\n");
+    }
+    fflush(file);
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Per frame pipeline timeline. While tracing is enabled (-T) every stage
+ * of a frame is timestamped: first command received by receive thread,
+ * decoded by renderer, first primitive drawn, frame composed, flip
+ * requested, vsync wait and the vsync after which the frame is scanned
+ * out. Stages are written as markers into ftrace buffer, next to events
+ * of SPI driver, and finished frames are kept in ring of each screen,
+ * dumped on SIGUSR2. Disabled tracing costs one predicted branch.
+ *
+ * Frames are numbered by the flush commands of slave ('f'), so markers of
+ * receive thread and renderer match. Frames merged into one present are
+ * reported as range, 'p' counts presented frames of the screen.
+ */
+
+#ifndef __CANVASTIMELINE_H__
+#define __CANVASTIMELINE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* finished frames kept per screen, power of two */
+#define CANVASTIMELINE_FRAMES           (64)
+
+#define CANVASTIMELINE_ENABLED()        __builtin_expect(canvastimeline_enabled, 0)
+#define CANVASTIMELINE_POINT(timeline, point) \
+    do { if (CANVASTIMELINE_ENABLED()) canvastimeline_point((timeline), (point)); } while (0)
+
+enum canvastimeline_point {
+    /* first command of frame framed by receive thread */
+    CANVASTIMELINE_RECEIVED = 0,
+    /* first command of frame validated by renderer */
+    CANVASTIMELINE_DECODED,
+    /* first drawing command */
+    CANVASTIMELINE_RASTER_BEGIN,
+    /* layers, scene and rotation composed into frame */
+    CANVASTIMELINE_RASTER_END,
+    /* flip requested */
+    CANVASTIMELINE_PAN,
+    /* waiting for vertical sync */
+    CANVASTIMELINE_VSYNC_WAIT,
+    /* vertical sync passed, frame is scanned out */
+    CANVASTIMELINE_VISIBLE,
+    CANVASTIMELINE_POINTS
+};
+
+struct canvastimeline_frame {
+    /* presented frame of screen */
+    uint32_t present;
+    /* slave frames merged into it */
+    uint32_t first;
+    uint32_t last;
+    uint32_t commands;
+    /* monotonic time of points, zero when not passed */
+    uint64_t ns[CANVASTIMELINE_POINTS];
+};
+
+/* timeline of one screen, 'current' is owned by renderer until flip is
+ * requested and by presenter thread until the frame is visible */
+struct canvastimeline {
+    /* display in markers */
+    uint32_t id;
+    struct canvastimeline_frame current;
+    struct canvastimeline_frame frames[CANVASTIMELINE_FRAMES];
+    /* frames finished, ring position */
+    uint32_t head;
+};
+
+/* set by canvastimeline_enable */
+extern uint32_t canvastimeline_enabled;
+
+int32_t canvastimeline_enable(void);
+
+void canvastimeline_disable(void);
+
+void canvastimeline_mark(
+    const uint32_t id,
+    const uint32_t frame,
+    const enum canvastimeline_point point
+);
+
+void canvastimeline_command(
+    struct canvastimeline *timeline,
+    const uint32_t frame,
+    const uint64_t received_ns,
+    const uint32_t draw
+);
+
+void canvastimeline_point(
+    struct canvastimeline *timeline,
+    const enum canvastimeline_point point
+);
+
+void canvastimeline_finish(
+    struct canvastimeline *timeline
+);
+
+void canvastimeline_skip(
+    struct canvastimeline *timeline
+);
+
+int32_t canvastimeline_dump(
+    const struct canvastimeline *timeline,
+    FILE *file
+);
+
+#endif
@@ -0,0 +1,373 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "config.h"
+#include "spidevice.h"
+#include "canvastrace.h"
+
+static uint64_t canvastrace_diff_ns(
+    const struct timespec *from,
+    const struct timespec *to
+)
+{
+    return ((int64_t)to->tv_sec - from->tv_sec) * 1000000000LL +
+        ((int64_t)to->tv_nsec - from->tv_nsec);
+}
+
+int32_t canvastrace_record_init(
+    struct canvastrace *trace,
+    const char *path
+)
+{
+    struct canvastrace_header header = {
+        .magic = CANVASTRACE_MAGIC,
+        .version = CANVASTRACE_VERSION,
+    };
+
+    assert(!(NULL == trace || NULL == path));
+    if (NULL == trace || NULL == path)
+        return -1;
+
+    memset(trace, 0, sizeof(*trace));
+    trace->fd = -1;
+
+    trace->record_data = malloc(CANVASTRACE_BUFFER_SIZE);
+    if (NULL == trace->record_data)
+        return -1;
+
+    trace->file = fopen(path, "wb");
+    if (NULL == trace->file)
+    {
+        free(trace->record_data);
+        trace->record_data = NULL;
+        return -1;
+    }
+
+    /* keep syscalls out of the command loop */
+    setvbuf(trace->file, NULL, _IOFBF, CANVASTRACE_BUFFER_SIZE);
+
+    if (1 != fwrite(&header, sizeof(header), 1, trace->file))
+    {
+        canvastrace_deinit(trace);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &trace->record_last);
+    return 0;
+}
+
+int32_t canvastrace_replay_init(
+    struct canvastrace *trace,
+    const char *path,
+    const uint32_t fast
+)
+{
+    struct stat st;
+    const struct canvastrace_header *header;
+
+    assert(!(NULL == trace || NULL == path));
+    if (NULL == trace || NULL == path)
+        return -1;
+
+    memset(trace, 0, sizeof(*trace));
+    trace->fast = fast;
+
+    trace->fd = open(path, O_RDONLY);
+    if (trace->fd < 0)
+        return -1;
+
+    if ((0 > fstat(trace->fd, &st)) || (st.st_size < sizeof(*header)))
+    {
+        canvastrace_deinit(trace);
+        return -1;
+    }
+
+    trace->map_size = st.st_size;
+    trace->map = mmap(NULL, trace->map_size, PROT_READ, MAP_PRIVATE, trace->fd, 0);
+    if (MAP_FAILED == trace->map)
+    {
+        trace->map = NULL;
+        canvastrace_deinit(trace);
+        return -1;
+    }
+    /* records are consumed strictly in order */
+    madvise((void*)trace->map, trace->map_size, MADV_SEQUENTIAL);
+
+    header = (const struct canvastrace_header*)trace->map;
+    if ((CANVASTRACE_MAGIC != header->magic) || (CANVASTRACE_VERSION != header->version))
+    {
+        canvastrace_deinit(trace);
+        return -2;
+    }
+    trace->map_pos = sizeof(*header);
+
+    return 0;
+}
+
+int32_t canvastrace_deinit(
+    struct canvastrace *trace
+)
+{
+    if (NULL == trace)
+        return -1;
+
+    if (NULL != trace->file)
+    {
+        fclose(trace->file);
+        trace->file = NULL;
+    }
+    free(trace->record_data);
+    trace->record_data = NULL;
+
+    if (NULL != trace->map)
+    {
+        munmap((void*)trace->map, trace->map_size);
+        trace->map = NULL;
+    }
+    if (trace->fd >= 0)
+    {
+        close(trace->fd);
+        trace->fd = -1;
+    }
+    return 0;
+}
+
+int32_t canvastrace_record_begin(
+    struct canvastrace *trace,
+    const uint8_t cmd_code
+)
+{
+    assert(!(NULL == trace || NULL == trace->file));
+    if (NULL == trace || NULL == trace->file)
+        return -1;
+
+    /* timestamp of command arrival */
+    clock_gettime(CLOCK_MONOTONIC, &trace->record_time);
+    trace->record_active = 1;
+    trace->record_size = 0;
+    canvastrace_record_append(trace, &cmd_code, sizeof(cmd_code));
+    return 0;
+}
+
+/* called for every received chunk, see 'spidevice.rx_hook' */
+void canvastrace_record_append(
+    void *priv,
+    const uint8_t *buffer,
+    const size_t size
+)
+{
+    struct canvastrace *trace = priv;
+
+    if (!trace->record_active)
+        return;
+
+    /* payload does not fit, record is dropped in canvastrace_record_end */
+    if (trace->record_size + size > CANVASTRACE_BUFFER_SIZE)
+    {
+        trace->record_size = CANVASTRACE_BUFFER_SIZE + 1;
+        return;
+    }
+    memcpy(trace->record_data + trace->record_size, buffer, size);
+    trace->record_size += size;
+}
+
+int32_t canvastrace_record_end(
+    struct canvastrace *trace
+)
+{
+    struct canvastrace_record record;
+    uint64_t delta_us;
+
+    assert(!(NULL == trace || NULL == trace->file));
+    if (NULL == trace || NULL == trace->file)
+        return -1;
+
+    trace->record_active = 0;
+    if (trace->record_size > CANVASTRACE_BUFFER_SIZE)
+        return -2;
+
+    delta_us = canvastrace_diff_ns(&trace->record_last, &trace->record_time) / 1000;
+    trace->record_last = trace->record_time;
+
+    record.delta_us = delta_us > UINT32_MAX ? UINT32_MAX : delta_us;
+    record.size = trace->record_size;
+
+    if ((1 != fwrite(&record, sizeof(record), 1, trace->file)) ||
+        (1 != fwrite(trace->record_data, record.size, 1, trace->file)))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/* move to the next record, sleep according recorded pacing */
+static int32_t canvastrace_replay_next(
+    struct canvastrace *trace
+)
+{
+    struct canvastrace_record record;
+    struct timespec now;
+    uint64_t elapsed_ns;
+
+    if (trace->map_pos + sizeof(record) > trace->map_size)
+        return SPIDEVICE_EOF;
+
+    /* trace is byte stream, records are not aligned */
+    memcpy(&record, trace->map + trace->map_pos, sizeof(record));
+    if (trace->map_pos + sizeof(record) + record.size > trace->map_size)
+        return SPIDEVICE_EOF;
+
+    trace->map_pos += sizeof(record);
+    trace->chunk_left = record.size;
+
+    if (0 == trace->commands++)
+    {
+        /* first record defines time zero */
+        clock_gettime(CLOCK_MONOTONIC, &trace->replay_start);
+        trace->sched_ns = 0;
+        return 0;
+    }
+    trace->sched_ns += (uint64_t)record.delta_us * 1000;
+
+    if (trace->fast)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed_ns = canvastrace_diff_ns(&trace->replay_start, &now);
+    if (elapsed_ns < trace->sched_ns)
+    {
+        struct timespec deadline = trace->replay_start;
+        deadline.tv_sec += trace->sched_ns / 1000000000ULL;
+        deadline.tv_nsec += trace->sched_ns % 1000000000ULL;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (0 != clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL));
+    }
+    else
+    {
+        /* we are behind the recorded pacing */
+        uint64_t lateness_ns = elapsed_ns - trace->sched_ns;
+        trace->lateness_sum_ns += lateness_ns;
+        if (lateness_ns > trace->lateness_max_ns)
+            trace->lateness_max_ns = lateness_ns;
+    }
+    return 0;
+}
+
+/* 'spidevice' transfer served from the mmap-ed trace */
+static int32_t canvastrace_replay_transfer(
+    const struct spidevice *spidevice,
+    const struct spi_ioc_transfer *message
+)
+{
+    struct canvastrace *trace = spidevice->priv;
+    uint8_t *rx_buf = (uint8_t*)(uintptr_t)message->rx_buf;
+    uint32_t len = message->len;
+    uint32_t chunk;
+    int32_t result;
+
+    /* acknowledges to slave are dropped */
+    if (0 == message->rx_buf)
+        return 0;
+
+    while (len)
+    {
+        if (0 == trace->chunk_left)
+        {
+            if (0 > (result = canvastrace_replay_next(trace)))
+                return result;
+            continue;
+        }
+        chunk = len < trace->chunk_left ? len : trace->chunk_left;
+        memcpy(rx_buf, trace->map + trace->map_pos, chunk);
+        trace->map_pos += chunk;
+        trace->chunk_left -= chunk;
+        trace->bytes += chunk;
+        rx_buf += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+static const struct spidevice_ops canvastrace_replay_ops = {
+    .transfer = canvastrace_replay_transfer,
+};
+
+/* connect trace with 'spidevice', record or replay according init */
+int32_t canvastrace_attach(
+    struct canvastrace *trace,
+    struct spidevice *spidevice
+)
+{
+    assert(!(NULL == trace || NULL == spidevice));
+    if (NULL == trace || NULL == spidevice)
+        return -1;
+
+    if (NULL != trace->map)
+    {
+        return spidevice_init_ops(spidevice, &canvastrace_replay_ops, trace);
+    }
+
+    spidevice->rx_hook = canvastrace_record_append;
+    spidevice->rx_hook_priv = trace;
+    return 0;
+}
+
+uint64_t canvastrace_elapsed_ns(
+    const struct canvastrace *trace
+)
+{
+    struct timespec now;
+
+    if (0 == trace->commands)
+        return 0;
+    if (trace->replay_done)
+        return canvastrace_diff_ns(&trace->replay_start, &trace->replay_end);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return canvastrace_diff_ns(&trace->replay_start, &now);
+}
+
+/* stop elapsed time, other displays may still run */
+void canvastrace_replay_done(
+    struct canvastrace *trace
+)
+{
+    if ((NULL == trace) || trace->replay_done)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &trace->replay_end);
+    trace->replay_done = 1;
+}
@@ -0,0 +1,130 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Command stream trace. In record mode every command received from the
+ * slave (command code + payload) is appended to a binary file together
+ * with a monotonic timestamp. In replay mode the file is mmap-ed and
+ * served through 'spidevice' ops, so the very same dispatcher consumes it.
+ *
+ * File layout (little endian, as the rest of the protocol):
+ *  struct canvastrace_header
+ *  struct canvastrace_record + 'size' bytes of data
+ *  struct canvastrace_record + 'size' bytes of data
+ *  ...
+ */
+
+#ifndef __CANVASTRACE_H__
+#define __CANVASTRACE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "spidevice.h"
+
+#define CANVASTRACE_MAGIC               (0x52545643) /* "CVTR" */
+#define CANVASTRACE_VERSION             (1)
+#define CANVASTRACE_BUFFER_SIZE         (64 * 1024)
+
+struct canvastrace_header {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct canvastrace_record {
+    /* microseconds since previous record */
+    uint32_t delta_us;
+    /* size of data following the record */
+    uint32_t size;
+};
+
+struct canvastrace {
+    /* record */
+    FILE *file;
+    uint8_t *record_data;
+    uint32_t record_size;
+    uint32_t record_active;
+    struct timespec record_time;
+    struct timespec record_last;
+    /* replay */
+    int32_t fd;
+    const uint8_t *map;
+    size_t map_size;
+    size_t map_pos;
+    uint32_t chunk_left;
+    uint32_t fast;
+    uint64_t sched_ns;
+    struct timespec replay_start;
+    /* set when whole stream was executed, elapsed time stops */
+    uint32_t replay_done;
+    struct timespec replay_end;
+    /* replay statistic */
+    uint64_t commands;
+    uint64_t bytes;
+    uint64_t lateness_sum_ns;
+    uint64_t lateness_max_ns;
+};
+
+int32_t canvastrace_record_init(
+    struct canvastrace *trace,
+    const char *path
+);
+
+int32_t canvastrace_replay_init(
+    struct canvastrace *trace,
+    const char *path,
+    const uint32_t fast
+);
+
+int32_t canvastrace_deinit(
+    struct canvastrace *trace
+);
+
+int32_t canvastrace_record_begin(
+    struct canvastrace *trace,
+    const uint8_t cmd_code
+);
+
+void canvastrace_record_append(
+    void *priv,
+    const uint8_t *buffer,
+    const size_t size
+);
+
+int32_t canvastrace_record_end(
+    struct canvastrace *trace
+);
+
+int32_t canvastrace_attach(
+    struct canvastrace *trace,
+    struct spidevice *spidevice
+);
+
+uint64_t canvastrace_elapsed_ns(
+    const struct canvastrace *trace
+);
+
+void canvastrace_replay_done(
+    struct canvastrace *trace
+);
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <assert.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+
+/* gpiochip character device exists since Linux 4.8 */
+#ifdef __has_include
+#   if __has_include(<linux/gpio.h>)
+#       include <linux/gpio.h>
+#   endif
+#endif
+
+#include "config.h"
+#include "dataready.h"
+
+int32_t dataready_init_gpio(
+    struct dataready *dataready,
+    const char *chip_path,
+    const uint32_t line,
+    const uint32_t active_low,
+    const int32_t idle_ms
+)
+{
+    assert(!(NULL == dataready || NULL == chip_path));
+    if (NULL == dataready || NULL == chip_path)
+        return -1;
+
+    dataready->type = dataready_type_none;
+    dataready->fd = -1;
+    dataready->idle_ms = idle_ms;
+
+#ifdef GPIO_GET_LINEEVENT_IOCTL
+    struct gpioevent_request request = {0};
+    int32_t chip_fd;
+    int32_t result;
+
+    chip_fd = open(chip_path, O_RDONLY);
+    if (chip_fd < 0)
+        return -1;
+
+    /* slave asserts line when it has something to send */
+    request.lineoffset = line;
+    request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    if (active_low)
+        request.handleflags |= GPIOHANDLE_REQUEST_ACTIVE_LOW;
+    request.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+    strncpy(request.consumer_label, "canvas-ready", sizeof(request.consumer_label) - 1);
+
+    result = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &request);
+    close(chip_fd);
+    if (result < 0)
+        return -1;
+
+    /* pending edges are drained without blocking */
+    fcntl(request.fd, F_SETFL, fcntl(request.fd, F_GETFL) | O_NONBLOCK);
+
+    dataready->type = dataready_type_gpio;
+    dataready->fd = request.fd;
+    return 0;
+#else
+    return -2;
+#endif
+}
+
+int32_t dataready_init_fd(
+    struct dataready *dataready,
+    const int32_t fd,
+    const int32_t idle_ms
+)
+{
+    assert(!(NULL == dataready || fd < 0));
+    if (NULL == dataready || fd < 0)
+        return -1;
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    dataready->type = dataready_type_fd;
+    dataready->fd = fd;
+    dataready->idle_ms = idle_ms;
+    return 0;
+}
+
+int32_t dataready_deinit(
+    struct dataready *dataready
+)
+{
+    if (NULL == dataready)
+        return -1;
+
+    if (dataready->fd >= 0)
+        close(dataready->fd);
+    dataready->fd = -1;
+    dataready->type = dataready_type_none;
+    return 0;
+}
+
+/* consume all pending notifications */
+static void dataready_drain(
+    struct dataready *dataready
+)
+{
+    uint8_t buffer[64];
+
+    while (read(dataready->fd, buffer, sizeof(buffer)) > 0);
+}
+
+/* current level of the line, 1 means slave has data */
+static int32_t dataready_level(
+    struct dataready *dataready
+)
+{
+#ifdef GPIO_GET_LINEEVENT_IOCTL
+    struct gpiohandle_data data = {0};
+
+    if (dataready_type_gpio != dataready->type)
+        return 0;
+    if (0 > ioctl(dataready->fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data))
+        return 0;
+    return data.values[0] ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+/* block until slave signals pending data, 'wake_fd' (optional) becomes
+ * readable or idle period expires. Returns 1 when signalled, 0 on timeout,
+ * negative on error */
+int32_t dataready_wait(
+    struct dataready *dataready,
+    const int32_t wake_fd
+)
+{
+    struct pollfd pollfds[2];
+    uint32_t count = 0;
+    int32_t result;
+
+    assert(!(NULL == dataready));
+    if (NULL == dataready)
+        return -1;
+
+    /* no line and no throttling, keep polling the bus */
+    if ((dataready_type_none == dataready->type) && (dataready->idle_ms <= 0))
+        return 0;
+
+    /* edge might be gone already, line level is what matters */
+    if (dataready_level(dataready))
+    {
+        dataready_drain(dataready);
+        return 1;
+    }
+
+    if (dataready_type_none != dataready->type)
+    {
+        pollfds[count].fd = dataready->fd;
+        pollfds[count].events = POLLIN;
+        pollfds[count].revents = 0;
+        count++;
+    }
+    if (wake_fd >= 0)
+    {
+        pollfds[count].fd = wake_fd;
+        pollfds[count].events = POLLIN;
+        pollfds[count].revents = 0;
+        count++;
+    }
+
+    /* without line this is just throttled bus polling */
+    result = poll(pollfds, count, dataready->idle_ms);
+    if (result < 0)
+        return (EINTR == errno) ? 0 : -1;
+    if (0 == result)
+        return 0;
+
+    if ((dataready_type_none != dataready->type) && (pollfds[0].revents & POLLIN))
+        dataready_drain(dataready);
+    return 1;
+}
@@ -0,0 +1,75 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Optional data-ready line from slave. When slave answers with
+ * CANVAS_CMD_DUMMY, the daemon stops clocking the bus and sleeps on the
+ * line (gpiochip character device) or on any pollable descriptor that
+ * becomes readable when data is pending (eventfd, pipe - for testing).
+ */
+
+#ifndef __DATAREADY_H__
+#define __DATAREADY_H__
+
+#include <stdint.h>
+
+/* bus is polled at least this often when line is configured */
+#define DATAREADY_IDLE_MS_DEFAULT       (100)
+
+enum dataready_type {
+    dataready_type_none = 0,
+    dataready_type_gpio,
+    dataready_type_fd,
+};
+
+struct dataready {
+    enum dataready_type type;
+    /* line event descriptor or stand-in descriptor */
+    int32_t fd;
+    /* fallback bus poll period, negative waits forever */
+    int32_t idle_ms;
+};
+
+int32_t dataready_init_gpio(
+    struct dataready *dataready,
+    const char *chip_path,
+    const uint32_t line,
+    const uint32_t active_low,
+    const int32_t idle_ms
+);
+
+int32_t dataready_init_fd(
+    struct dataready *dataready,
+    const int32_t fd,
+    const int32_t idle_ms
+);
+
+int32_t dataready_deinit(
+    struct dataready *dataready
+);
+
+int32_t dataready_wait(
+    struct dataready *dataready,
+    const int32_t wake_fd
+);
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ *  Copyright 2016 
+ *  Marian Cingel - cingel.marian@gmail.com
+ *
+ *  Licensed to the Apache Software Foundation (ASF) under one
+ *  or more contributor license agreements.  See the NOTICE file
+ *  distributed with this work for additional information
+ *  regarding copyright ownership.  The ASF licenses this file
+ *  to you under the Apache License, Version 2.0 (the
+ *  "License"); you may not use this file except in compliance
+ *  with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an
+ *  "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ *  KIND, either express or implied.  See the License for the
+ *  specific language governing permissions and limitations
+ *  under the License.
+ */
+
+/*
+ * Pixel regions shared by screen (layer, shadow damage) and retained
+ * scene, so damage is tracked by single type and single set of helpers.
+ */
+
+#ifndef __FBRECT_H__
+#define __FBRECT_H__
+
+#include <stdint.h>
+
+/* region in pixels, bounds included, empty when 'x0' > 'x1' */
+struct fbscreen_rect {
+    int32_t x0;
+    int32_t y0;
+    int32_t x1;
+    int32_t y1;
+};
+
+/* grow 'rect' to cover 'add' too */
+static inline void fbscreen_rect_add(
+    struct fbscreen_rect *rect,
+    const struct fbscreen_rect *add
+)
+{
+    if (add->x0 > add->x1)
+        return;
+    if (rect->x0 > rect->x1)
+    {
+        *rect = *add;
+        return;
+    }
+    rect->x0 = add->x0 < rect->x0 ? add->x0 : rect->x0;
+    rect->y0 = add->y0 < rect->y0 ? add->y0 : rect->y0;
+    rect->x1 = add->x1 > rect->x1 ? add->x1 : rect->x1;
+    rect->y1 = add->y1 > rect->y1 ? add->y1 : rect->y1;
+}
+
+/* 'rect' becomes intersection, returns zero when it is empty */
+static inline int32_t fbscreen_rect_intersect(
+    struct fbscreen_rect *rect,
+    const struct fbscreen_rect *clip
+)
+{
+    rect->x0 = rect->x0 > clip->x0 ? rect->x0 : clip->x0;
+    rect->y0 = rect->y0 > clip->y0 ? rect->y0 : clip->y0;
+    rect->x1 = rect->x1 < clip->x1 ? rect->x1 : clip->x1;
+    rect->y1 = rect->y1 < clip->y1 ? rect->y1 : clip->y1;
+    return (rect->x0 <= rect->x1) && (rect->y0 <= rect->y1);
+}
+
+#endif
@@ -29,32 +29,137 @@
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <assert.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/types.h>
+#include <sys/eventfd.h>
+/* hot pixel loops have NEON paths, elsewhere they are plain C loops and
+ * only as fast as the compiler makes them at distro optimisation */
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
 
 #include "config.h"
 #include "fbscreen.h"
+#include "canvasstats.h"
 #include "math.h"
 #include "string.h"
 
-/* transform generic R|G|B to display R|G|B according color info */
-#define FBSCREEN_COLOR2PIX(off, len, val) ((((1 << (len)) - 1) & (val)) << (off))
-#define FBSCREEN_PIX2COLOR(off, len, val) (((val) >> (off)) & ((1 << (len)) - 1))
+/* pixels decoded at once from compressed image */
+#define FBSCREEN_IMAGE_BATCH            (256)
 
+/* transform generic R|G|B to display R|G|B according color info,
+ * 8bit channel to its most significant 'len' bits and back */
+#define FBSCREEN_COLOR2PIX(off, len, val) (((((val) & 0xFF) >> (8 - (len))) & ((1 << (len)) - 1)) << (off))
+#define FBSCREEN_PIX2COLOR(off, len, val) ((((val) >> (off)) & ((1 << (len)) - 1)) << (8 - (len)))
+
+
+/* prepare offsets, addresses of both halves of framebuffer memory */
+static void fbscreen_init_drawing(
+    struct fbscreen *fbscreen
+)
+{
+    fbscreen->drawing_mem_size = fbscreen->var_info.yres * fbscreen->var_info.xres * (fbscreen->var_info.bits_per_pixel >> 3);
+    fbscreen->drawing_yoffsets[0] = 0;
+    fbscreen->drawing_yoffsets[1] = fbscreen->var_info.yres;
+    fbscreen->drawing_addrs[0] = fbscreen->fb_mem;
+    fbscreen->drawing_addrs[1] = fbscreen->fb_mem + fbscreen->drawing_mem_size;
+    fbscreen->drawing_idx = 1;
+    fbscreen->drawing_mem = fbscreen->drawing_addrs[fbscreen->drawing_idx];
+    fbscreen->dirty = 0;
+    fbscreen->present_ns = 0;
+    fbscreen->present_pending = 0;
+    fbscreen->single_buffer = 0;
+    fbscreen->vsync_running = 0;
+    memset(fbscreen->layers, 0, sizeof(fbscreen->layers));
+    fbscreen->layer_target = CANVAS_LAYER_DIRECT;
+    memset(fbscreen->charts, 0, sizeof(fbscreen->charts));
+    memset(fbscreen->palette, 0, sizeof(fbscreen->palette));
+    fbscreen->image.active = 0;
+    fbscreen->assets = NULL;
+    canvasscene_init(&fbscreen->scene);
+    fbscreen->rotation = 0;
+    fbscreen->shadow_mem = NULL;
+    fbscreen->panel_xres = fbscreen->var_info.xres;
+    fbscreen->panel_yres = fbscreen->var_info.yres;
+    fbscreen->shadow_damage.x0 = fbscreen->shadow_damage_prev.x0 = 0;
+    fbscreen->shadow_damage.x1 = fbscreen->shadow_damage_prev.x1 = -1;
+}
+
+/* color in framebuffer pixel format */
+static inline uint32_t fbscreen_color_pixel(
+    const struct fb_var_screeninfo *var_info,
+    const uint32_t color
+)
+{
+    return FBSCREEN_COLOR2PIX(var_info->red.offset, var_info->red.length, CANVAS_RGBCOLOR_RED(color)) |
+        FBSCREEN_COLOR2PIX(var_info->green.offset, var_info->green.length, CANVAS_RGBCOLOR_GREEN(color)) |
+        FBSCREEN_COLOR2PIX(var_info->blue.offset, var_info->blue.length, CANVAS_RGBCOLOR_BLUE(color));
+}
+
+/* memory primitives are drawn into */
+static inline uint8_t *fbscreen_target(
+    const struct fbscreen *fbscreen
+)
+{
+    if (fbscreen->layer_target < CANVAS_LAYER_COUNT)
+        return fbscreen->layers[fbscreen->layer_target].mem;
+    return fbscreen->drawing_mem;
+}
+
+/* refresh period from display timings, 'pixclock' is in picoseconds */
+static uint64_t fbscreen_frame_period(
+    const struct fb_var_screeninfo *var_info
+)
+{
+    uint64_t htotal = var_info->xres + var_info->left_margin + var_info->right_margin + var_info->hsync_len;
+    uint64_t vtotal = var_info->yres + var_info->upper_margin + var_info->lower_margin + var_info->vsync_len;
+    uint64_t period_ns = htotal * vtotal * var_info->pixclock / 1000;
+
+    /* unknown or nonsense timings */
+    if ((period_ns < 1000000000ULL / 240) || (period_ns > 1000000000ULL / 10))
+        period_ns = 1000000000ULL / FBSCREEN_REFRESH_HZ_DEFAULT;
+    return period_ns;
+}
+
+/* pan to 'var_info.yoffset', device is told its own (panel) geometry */
+static int32_t fbscreen_pan(
+    struct fbscreen *fbscreen
+)
+{
+    struct fb_var_screeninfo var_info = fbscreen->var_info;
+
+    var_info.xres = fbscreen->panel_xres;
+    var_info.yres = fbscreen->panel_yres;
+    var_info.xres_virtual = fbscreen->panel_xres;
+    return ioctl(fbscreen->fb_fd, FBIOPAN_DISPLAY, &var_info);
+}
 
 /* https://www.kernel.org/doc/Documentation/fb/fbuffer.txt
  * https://www.kernel.org/doc/Documentation/fb/api.txt */
 
-int32_t fbscreen_init(
+/* open framebuffer, 'warm' adopts mode and picture left by previous
+ * instance when they match, returns 1 in such case */
+static int32_t fbscreen_open(
     struct fbscreen *fbscreen,
     const char *fb_path,
-    const uint8_t color_depth
+    const uint8_t color_depth,
+    const uint32_t warm
 )
 {
+    const struct fb_var_screeninfo *var_info;
+    uint32_t adopt;
+    uint32_t front_idx;
     int32_t result = -1;
 
     assert(!((NULL == fbscreen) || (NULL == fb_path)));
     if ((NULL == fbscreen) || (NULL == fb_path))
         return -1;
+    var_info = &fbscreen->var_info;
+    fbscreen->present_request_fd = -1;
+    fbscreen->present_done_fd = -1;
+    fbscreen->present_running = 0;
 
     /* open framebuffer */
     fbscreen->fb_fd = open(fb_path, O_RDWR);
@@ -75,16 +180,27 @@ int32_t fbscreen_init(
     if ((color_depth != 16) && (color_depth != 24) && (color_depth != 32))
         return -1;
 
-    /* try to double 'virtual_yres' according visible 'yres' */
-    fbscreen->var_info.yres_virtual = fbscreen->var_info.yres * 2;
-    fbscreen->var_info.xres_virtual = fbscreen->var_info.xres;
-    fbscreen->var_info.xoffset = 0;
-    fbscreen->var_info.yoffset = 0;
-    fbscreen->var_info.bits_per_pixel = color_depth;
-    // fbscreen->var_info.activate = FB_ACTIVATE_VBL;
-    result = ioctl(fbscreen->fb_fd, FBIOPUT_VSCREENINFO, &fbscreen->var_info);
-    assert(!(result < 0));
-    if (result < 0) return -1;
+    /* double height mode is set and one of halves is displayed */
+    adopt = warm &&
+        (var_info->bits_per_pixel == color_depth) &&
+        (var_info->xres_virtual == var_info->xres) &&
+        (var_info->yres_virtual >= var_info->yres * 2) &&
+        (0 == var_info->xoffset) &&
+        ((0 == var_info->yoffset) || (var_info->yres == var_info->yoffset));
+
+    if (!adopt)
+    {
+        /* try to double 'virtual_yres' according visible 'yres' */
+        fbscreen->var_info.yres_virtual = fbscreen->var_info.yres * 2;
+        fbscreen->var_info.xres_virtual = fbscreen->var_info.xres;
+        fbscreen->var_info.xoffset = 0;
+        fbscreen->var_info.yoffset = 0;
+        fbscreen->var_info.bits_per_pixel = color_depth;
+        // fbscreen->var_info.activate = FB_ACTIVATE_VBL;
+        result = ioctl(fbscreen->fb_fd, FBIOPUT_VSCREENINFO, &fbscreen->var_info);
+        assert(!(result < 0));
+        if (result < 0) return -1;
+    }
 
     /* expected size of fb (virtual_yres * virtual_xres * depth) */
     fbscreen->fb_mem_size = fbscreen->var_info.yres_virtual * fbscreen->var_info.xres * (fbscreen->var_info.bits_per_pixel >> 3);
@@ -99,18 +215,176 @@ int32_t fbscreen_init(
         return -1;
     }
 
-    /* clear whole fb - set to black */
-    memset(fbscreen->fb_mem, 0, fbscreen->fb_mem_size);
+    fbscreen_init_drawing(fbscreen);
+    fbscreen->frame_period_ns = fbscreen_frame_period(&fbscreen->var_info);
 
-    /* prepare offsets, addresses */
-    fbscreen->drawing_mem_size = fbscreen->var_info.yres * fbscreen->var_info.xres * (fbscreen->var_info.bits_per_pixel >> 3);
-    fbscreen->drawing_yoffsets[0] = 0;
-    fbscreen->drawing_yoffsets[1] = fbscreen->var_info.yres;
-    fbscreen->drawing_addrs[0] = fbscreen->fb_mem;
-    fbscreen->drawing_addrs[1] = fbscreen->fb_mem + fbscreen->drawing_mem_size;
-    fbscreen->drawing_idx = 1;
+    if (!adopt)
+    {
+        /* clear whole fb - set to black */
+        memset(fbscreen->fb_mem, 0, fbscreen->fb_mem_size);
+        return 0;
+    }
+
+    /* displayed half stays front, drawing continues from its picture */
+    front_idx = var_info->yoffset ? 1 : 0;
+    fbscreen->drawing_idx = front_idx ^ 0x1;
     fbscreen->drawing_mem = fbscreen->drawing_addrs[fbscreen->drawing_idx];
+    memcpy(fbscreen->drawing_mem, fbscreen->drawing_addrs[front_idx], fbscreen->drawing_mem_size);
+    return 1;
+}
+
+int32_t fbscreen_init(
+    struct fbscreen *fbscreen,
+    const char *fb_path,
+    const uint8_t color_depth
+)
+{
+    return fbscreen_open(fbscreen, fb_path, color_depth, 0);
+}
+
+/* keep mode and displayed picture of previous instance if they match,
+ * returns 1 if they were adopted, 0 if screen was initialized as cold */
+int32_t fbscreen_init_warm(
+    struct fbscreen *fbscreen,
+    const char *fb_path,
+    const uint8_t color_depth
+)
+{
+    return fbscreen_open(fbscreen, fb_path, color_depth, 1);
+}
+
+/* memory only screen without any device, used by trace replay */
+int32_t fbscreen_init_headless(
+    struct fbscreen *fbscreen,
+    const uint32_t xres,
+    const uint32_t yres,
+    const uint8_t color_depth
+)
+{
+    assert(!(NULL == fbscreen || 0 == xres || 0 == yres));
+    if (NULL == fbscreen || 0 == xres || 0 == yres)
+        return -1;
+
+    assert(!((color_depth != 16) && (color_depth != 24) && (color_depth != 32)));
+    if ((color_depth != 16) && (color_depth != 24) && (color_depth != 32))
+        return -1;
+
+    fbscreen->present_request_fd = -1;
+    fbscreen->present_done_fd = -1;
+    fbscreen->present_running = 0;
+    memset(&fbscreen->var_info, 0, sizeof(fbscreen->var_info));
+    memset(&fbscreen->fix_info, 0, sizeof(fbscreen->fix_info));
+
+    /* same layout as double buffered device, RGB565 or RGB888 */
+    fbscreen->var_info.xres = xres;
+    fbscreen->var_info.yres = yres;
+    fbscreen->var_info.xres_virtual = xres;
+    fbscreen->var_info.yres_virtual = yres * 2;
+    fbscreen->var_info.bits_per_pixel = color_depth;
+    if (16 == color_depth)
+    {
+        fbscreen->var_info.red.offset = 11;
+        fbscreen->var_info.red.length = 5;
+        fbscreen->var_info.green.offset = 5;
+        fbscreen->var_info.green.length = 6;
+        fbscreen->var_info.blue.offset = 0;
+        fbscreen->var_info.blue.length = 5;
+    }
+    else
+    {
+        fbscreen->var_info.red.offset = 16;
+        fbscreen->var_info.red.length = 8;
+        fbscreen->var_info.green.offset = 8;
+        fbscreen->var_info.green.length = 8;
+        fbscreen->var_info.blue.offset = 0;
+        fbscreen->var_info.blue.length = 8;
+    }
+    fbscreen->fix_info.line_length = xres * (color_depth >> 3);
+    fbscreen->fix_info.smem_len = fbscreen->fix_info.line_length * yres * 2;
+
+    fbscreen->fb_fd = -1;
+    fbscreen->fb_mem_size = fbscreen->fix_info.smem_len;
+    fbscreen->fb_mem = calloc(1, fbscreen->fb_mem_size);
+    if (NULL == fbscreen->fb_mem)
+        return -1;
+
+    fbscreen_init_drawing(fbscreen);
+    fbscreen->frame_period_ns = 1000000000ULL / FBSCREEN_REFRESH_HZ_DEFAULT;
+
+    return 0;
+}
+
+/* timestamp every vertical sync, beam position is estimated from it */
+static void *fbscreen_vsync_thread(
+    void *arg
+)
+{
+    struct fbscreen *fbscreen = arg;
+    int32_t useless = 0;
+
+    while (__atomic_load_n(&fbscreen->vsync_running, __ATOMIC_RELAXED))
+    {
+        if (0 > ioctl(fbscreen->fb_fd, FBIO_WAITFORVSYNC, &useless))
+            break;
+        __atomic_store_n(&fbscreen->vsync_ns, canvasstats_now_ns(), __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/* draw into scanned out memory, opt-in low latency mode */
+int32_t fbscreen_init_single_buffer(
+    struct fbscreen *fbscreen
+)
+{
+    const struct fb_var_screeninfo *var_info;
+    uint32_t vtotal;
+    sigset_t sigset, sigset_old;
+    int32_t result;
+
+    assert(!(NULL == fbscreen || NULL == fbscreen->fb_mem));
+    if (NULL == fbscreen || NULL == fbscreen->fb_mem)
+        return -1;
+
+    /* first half is scanned out from now on, rotated frame is still
+     * drawn into shadow memory */
+    fbscreen->drawing_idx = 0;
+    if (NULL == fbscreen->shadow_mem)
+        fbscreen->drawing_mem = fbscreen->drawing_addrs[0];
+
+    /* line timing, without timings whole period is visible */
+    var_info = &fbscreen->var_info;
+    vtotal = fbscreen->panel_yres;
+    fbscreen->vblank_lines = 0;
+    if (var_info->pixclock)
+    {
+        vtotal += var_info->upper_margin + var_info->lower_margin + var_info->vsync_len;
+        /* vsync is reported at start of sync pulse, back porch follows */
+        fbscreen->vblank_lines = var_info->vsync_len + var_info->upper_margin;
+    }
+    fbscreen->line_ns = fbscreen->frame_period_ns / vtotal;
+    fbscreen->vsync_ns = canvasstats_now_ns();
+    fbscreen->single_buffer = 1;
+
+    /* headless screen, beam is simulated from the period */
+    if (fbscreen->fb_fd < 0)
+        return 0;
+
+    fbscreen->var_info.activate = FB_ACTIVATE_NOW;
+    fbscreen->var_info.yoffset = fbscreen->drawing_yoffsets[0];
+    result = fbscreen_pan(fbscreen);
+    assert(!(result < 0));
+    if (result < 0) return -1;
 
+    fbscreen->vsync_running = 1;
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_BLOCK, &sigset, &sigset_old);
+    result = pthread_create(&fbscreen->vsync_thread, NULL, fbscreen_vsync_thread, fbscreen);
+    pthread_sigmask(SIG_SETMASK, &sigset_old, NULL);
+    if (0 != result)
+    {
+        fbscreen->vsync_running = 0;
+        return -1;
+    }
     return 0;
 }
 
@@ -121,6 +395,28 @@ int32_t fbscreen_deinit(
     if (NULL == fbscreen)
         return -1;
 
+    /* thread notices within one refresh */
+    if (fbscreen->vsync_running)
+    {
+        __atomic_store_n(&fbscreen->vsync_running, 0, __ATOMIC_RELAXED);
+        pthread_join(fbscreen->vsync_thread, NULL);
+    }
+    fbscreen_deinit_presenter(fbscreen);
+    for (uint32_t i = 0; i < CANVAS_LAYER_COUNT; i++)
+    {
+        free(fbscreen->layers[i].mem);
+        fbscreen->layers[i].mem = NULL;
+    }
+    free(fbscreen->shadow_mem);
+    fbscreen->shadow_mem = NULL;
+
+    if (fbscreen->fb_fd < 0)
+    {
+        free(fbscreen->fb_mem);
+        fbscreen->fb_mem = NULL;
+        return 0;
+    }
+
     munmap(fbscreen->fb_mem, fbscreen->fb_mem_size);
     close(fbscreen->fb_fd);
 
@@ -154,22 +450,15 @@ int32_t fbscreen_set_pixel(
     uint32_t pixel_position = (ypos * var_info->xres * (var_info->bits_per_pixel >> 3)) + (xpos * (var_info->bits_per_pixel >> 3));
 
     /* calculate pixel base address */
-    color_addr = fbscreen->drawing_mem + pixel_position;
+    color_addr = fbscreen_target(fbscreen) + pixel_position;
 
     if (var_info->bits_per_pixel == 16)
     {
-        uint16_t tmp_pixel = \
-            FBSCREEN_COLOR2PIX(var_info->red.offset, var_info->red.length, CANVAS_RGBCOLOR_RED(color)) | \
-            FBSCREEN_COLOR2PIX(var_info->green.offset, var_info->green.length, CANVAS_RGBCOLOR_GREEN(color)) | \
-            FBSCREEN_COLOR2PIX(var_info->blue.offset, var_info->blue.length, CANVAS_RGBCOLOR_BLUE(color));
-        *((uint16_t*)color_addr) = tmp_pixel;
+        *((uint16_t*)color_addr) = fbscreen_color_pixel(var_info, color);
     }
     else if (var_info->bits_per_pixel == 24)
     {
-        uint32_t tmp_pixel = \
-            FBSCREEN_COLOR2PIX(var_info->red.offset, var_info->red.length, CANVAS_RGBCOLOR_RED(color)) | \
-            FBSCREEN_COLOR2PIX(var_info->green.offset, var_info->green.length, CANVAS_RGBCOLOR_GREEN(color)) | \
-            FBSCREEN_COLOR2PIX(var_info->blue.offset, var_info->blue.length, CANVAS_RGBCOLOR_BLUE(color));
+        uint32_t tmp_pixel = fbscreen_color_pixel(var_info, color);
         /* processor must use little endian mode, copy byte by byte */
         *(((uint8_t*)color_addr) + 0) = *(((uint8_t*)&tmp_pixel) + 0);
         *(((uint8_t*)color_addr) + 1) = *(((uint8_t*)&tmp_pixel) + 1);
@@ -177,11 +466,7 @@ int32_t fbscreen_set_pixel(
     }
     else if (var_info->bits_per_pixel == 32)
     {
-        uint32_t tmp_pixel = \
-            FBSCREEN_COLOR2PIX(var_info->red.offset, var_info->red.length, CANVAS_RGBCOLOR_RED(color)) | \
-            FBSCREEN_COLOR2PIX(var_info->green.offset, var_info->green.length, CANVAS_RGBCOLOR_GREEN(color)) | \
-            FBSCREEN_COLOR2PIX(var_info->blue.offset, var_info->blue.length, CANVAS_RGBCOLOR_BLUE(color));
-        *((uint32_t*)color_addr) = tmp_pixel;
+        *((uint32_t*)color_addr) = fbscreen_color_pixel(var_info, color);
     }
     else
     {
@@ -218,7 +503,7 @@ int32_t fbscreen_get_pixel(
     uint32_t pixel_position = (ypos * var_info->xres * (var_info->bits_per_pixel >> 3)) + (xpos * (var_info->bits_per_pixel >> 3));
 
     /* calculate pixel base address */
-    color_addr = fbscreen->drawing_mem + pixel_position;
+    color_addr = fbscreen_target(fbscreen) + pixel_position;
 
     if (var_info->bits_per_pixel == 16)
     {
@@ -231,7 +516,6 @@ int32_t fbscreen_get_pixel(
     }
     else if (var_info->bits_per_pixel == 24)
     {
-        /* not tested */
         uint32_t tmp_pixel = 0;
         /* processor must use little endian mode, copy byte by byte */
         *(((uint8_t*)&tmp_pixel) + 0) = *(((uint8_t*)color_addr) + 0);
@@ -245,8 +529,7 @@ int32_t fbscreen_get_pixel(
     }
     else if (var_info->bits_per_pixel == 32)
     {
-        /* not tested */
-        uint32_t tmp_pixel = 0;
+        uint32_t tmp_pixel = *((uint32_t*)color_addr);
         *color = CANVAS_RGBCOLOR(
             FBSCREEN_PIX2COLOR(var_info->red.offset, var_info->red.length, tmp_pixel),
             FBSCREEN_PIX2COLOR(var_info->green.offset, var_info->green.length, tmp_pixel),
@@ -261,143 +544,1914 @@ int32_t fbscreen_get_pixel(
     return 0;
 }
 
-int32_t fbscreen_clear_screen(
-    const struct fbscreen *fbscreen,
-    const uint32_t color
+/* primitive is going to touch region, layer remembers it for composite,
+ * drawing memory in single buffer mode waits for the beam to leave it
+ * and rotated one remembers it for flush */
+static void fbscreen_draw_begin(
+    struct fbscreen *fbscreen,
+    int32_t x0,
+    int32_t y0,
+    int32_t x1,
+    int32_t y1
 )
 {
-    /* get var/fix info */
-    const struct fb_var_screeninfo *var_info = &fbscreen->var_info;
+    struct fbscreen_rect region;
+
+    if ((fbscreen->layer_target >= CANVAS_LAYER_COUNT) && (NULL == fbscreen->shadow_mem))
+    {
+        fbscreen_beam_wait(fbscreen, y0, y1);
+        return;
+    }
+
+    region.x0 = x0 < 0 ? 0 : x0;
+    region.y0 = y0 < 0 ? 0 : y0;
+    region.x1 = x1 >= (int32_t)fbscreen->var_info.xres ? (int32_t)fbscreen->var_info.xres - 1 : x1;
+    region.y1 = y1 >= (int32_t)fbscreen->var_info.yres ? (int32_t)fbscreen->var_info.yres - 1 : y1;
+    if ((region.x0 > region.x1) || (region.y0 > region.y1))
+        return;
+
+    if (fbscreen->layer_target >= CANVAS_LAYER_COUNT)
+        fbscreen_rect_add(&fbscreen->shadow_damage, &region);
+    else
+        fbscreen_rect_add(&fbscreen->layers[fbscreen->layer_target].damage, &region);
+}
+
+/* clip one axis of copy to [0, limit) on both source and destination
+ * side, cut off part is removed from the other side as well */
+static void fbscreen_clip_copy(
+    int64_t *src,
+    int64_t *dst,
+    int64_t *length,
+    const int64_t limit
+)
+{
+    if (*src < 0)
+    {
+        *dst -= *src;
+        *length += *src;
+        *src = 0;
+    }
+    if (*dst < 0)
+    {
+        *src -= *dst;
+        *length += *dst;
+        *dst = 0;
+    }
+    if (*src + *length > limit)
+        *length = limit - *src;
+    if (*dst + *length > limit)
+        *length = limit - *dst;
+}
+
+/* blit within target, rows are moved by memmove in the order which does
+ * not overwrite rows still to be read, so scrolling is one pass */
+int32_t fbscreen_copy_area(
+    struct fbscreen *fbscreen,
+    const struct cmd_copy_area *copy
+)
+{
+    const struct fb_var_screeninfo *var_info;
+    uint32_t bytes, stride;
+    int64_t xsrc, ysrc, xdst, ydst, width, height;
+    uint8_t *mem;
 
-    for (int32_t i = 0; i < var_info->xres; i++)
+    assert(!(NULL == fbscreen || NULL == copy));
+    if (NULL == fbscreen || NULL == copy)
+        return -1;
+
+    var_info = &fbscreen->var_info;
+    xsrc = copy->xsrc;
+    ysrc = copy->ysrc;
+    xdst = copy->xdst;
+    ydst = copy->ydst;
+    width = copy->width;
+    height = copy->height;
+
+    fbscreen_clip_copy(&xsrc, &xdst, &width, var_info->xres);
+    fbscreen_clip_copy(&ysrc, &ydst, &height, var_info->yres);
+    if ((width <= 0) || (height <= 0))
+        return 0;
+
+    fbscreen_draw_begin(fbscreen, xdst, ydst, xdst + width - 1, ydst + height - 1);
+
+    bytes = var_info->bits_per_pixel >> 3;
+    stride = var_info->xres * bytes;
+    mem = fbscreen_target(fbscreen);
+    if (ydst > ysrc)
     {
-        for (int32_t j = 0; j < var_info->yres; j++)
+        /* moving down, start from the bottom row */
+        for (int64_t j = height - 1; j >= 0; j--)
         {
-            fbscreen_set_pixel(fbscreen, i, j, color);
+            memmove(mem + (ydst + j) * stride + xdst * bytes,
+                mem + (ysrc + j) * stride + xsrc * bytes, width * bytes);
+        }
+    }
+    else
+    {
+        for (int64_t j = 0; j < height; j++)
+        {
+            memmove(mem + (ydst + j) * stride + xdst * bytes,
+                mem + (ysrc + j) * stride + xsrc * bytes, width * bytes);
         }
     }
-
     return 0;
 }
 
-int32_t fbscreen_draw_rectangle(
-    const struct fbscreen *fbscreen,
-    const struct fbscreen_rectangle *rectangle
+/* whole frame has to be composited again */
+static void fbscreen_damage_layers(
+    struct fbscreen *fbscreen
 )
 {
-    assert(!(NULL == fbscreen || NULL == rectangle));
-    if (NULL == fbscreen || NULL == rectangle)
+    for (uint32_t i = 0; i < CANVAS_LAYER_COUNT; i++)
     {
-        return -1;
+        fbscreen->layers[i].damage.x0 = 0;
+        fbscreen->layers[i].damage.y0 = 0;
+        fbscreen->layers[i].damage.x1 = fbscreen->var_info.xres - 1;
+        fbscreen->layers[i].damage.y1 = fbscreen->var_info.yres - 1;
     }
+}
 
-    int32_t xpos = rectangle->xpos, ypos = rectangle->ypos;
-    if (rectangle->in_centre)
+/* enable (allocate) or disable (release) layer. Newly enabled layer is
+ * filled by 'key_color', enabled one keeps content and changes flags */
+int32_t fbscreen_set_layer(
+    struct fbscreen *fbscreen,
+    const uint32_t layer,
+    const uint32_t flags,
+    const uint32_t key_color
+)
+{
+    struct fbscreen_layer *target;
+    uint32_t bytes = fbscreen->var_info.bits_per_pixel >> 3;
+    uint32_t target_idx;
+    int32_t result;
+
+    assert(!(NULL == fbscreen || layer >= CANVAS_LAYER_COUNT));
+    if (NULL == fbscreen || layer >= CANVAS_LAYER_COUNT)
+        return -1;
+    target = &fbscreen->layers[layer];
+
+    /* what was below or above layer shows up again */
+    fbscreen_damage_layers(fbscreen);
+
+    if (!(flags & CANVAS_LAYER_ENABLE))
     {
-        xpos -= rectangle->width/2;
-        ypos -= rectangle->height/2;
+        free(target->mem);
+        target->mem = NULL;
+        target->flags = 0;
+        if (fbscreen->layer_target == layer)
+            fbscreen->layer_target = CANVAS_LAYER_DIRECT;
+        return 0;
     }
 
-    for (int32_t i = 0; i < rectangle->width; i++)
+    if (NULL == target->mem)
     {
-        for (int32_t j = 0; j < rectangle->height; j++)
+        if (0 != posix_memalign((void**)&target->mem, 64, fbscreen->drawing_mem_size))
         {
-            fbscreen_set_pixel(
-                fbscreen, xpos + i, ypos + j, rectangle->color
-            );
+            target->mem = NULL;
+            return -2;
         }
+        /* key pixel is whatever set_pixel makes of the color */
+        target_idx = fbscreen->layer_target;
+        fbscreen->layer_target = layer;
+        result = fbscreen_set_pixel(fbscreen, 0, 0, key_color);
+        fbscreen->layer_target = target_idx;
+        if (0 > result)
+            return result;
+        target->key_pixel = 0;
+        memcpy(&target->key_pixel, target->mem, bytes);
+        for (uint32_t offset = bytes; offset < fbscreen->drawing_mem_size; offset += bytes)
+            memcpy(target->mem + offset, &target->key_pixel, bytes);
     }
-
+    target->flags = flags;
     return 0;
 }
 
-int32_t fbscreen_draw_circle(
-    const struct fbscreen *fbscreen,
-    const struct fbscreen_circle *circle
+/* target of following primitives, layer has to be enabled */
+int32_t fbscreen_select_layer(
+    struct fbscreen *fbscreen,
+    const uint32_t layer
 )
 {
-    assert(!(NULL == fbscreen || NULL == circle));
-    if (NULL == fbscreen || NULL == circle)
-    {
+    assert(!(NULL == fbscreen));
+    if (NULL == fbscreen)
         return -1;
-    }
 
-    int32_t xpos = circle->xpos, ypos = circle->ypos;
-    if (!circle->in_centre)
+    if ((CANVAS_LAYER_DIRECT != layer) &&
+        ((layer >= CANVAS_LAYER_COUNT) || (NULL == fbscreen->layers[layer].mem)))
     {
-        xpos += circle->radius;
-        ypos += circle->radius;
+        return -2;
     }
+    fbscreen->layer_target = layer;
+    return 0;
+}
 
-    int32_t xlimit;
-    int32_t radius_sqr = circle->radius * circle->radius;
+/* copy pixels which are not 'key'. NEON compares and selects a vector
+ * of pixels at once, rest of row goes through select loops */
+static void fbscreen_copy_keyed(
+    uint8_t *dst,
+    const uint8_t *src,
+    const uint32_t count,
+    const uint32_t bytes,
+    const uint32_t key
+)
+{
+    uint32_t i = 0;
 
-    for (int32_t i = 0; i < circle->radius; i++)
+    if (2 == bytes)
     {
-        xlimit = sqrt(radius_sqr - (i * i));
-        for (int32_t j = 0; j < xlimit; j++)
+        uint16_t *dst16 = (uint16_t*)dst;
+        const uint16_t *src16 = (const uint16_t*)src;
+#ifdef __ARM_NEON
+        const uint16x8_t key16 = vdupq_n_u16(key);
+        uint16x8_t pixels;
+
+        for (; i + 8 <= count; i += 8)
         {
-            fbscreen_set_pixel(
-                fbscreen, xpos + i, ypos + j, circle->color
-            );
-            fbscreen_set_pixel(
-                fbscreen, xpos - i, ypos + j, circle->color
-            );
-            fbscreen_set_pixel(
-                fbscreen, xpos + i, ypos - j, circle->color
-            );
-            fbscreen_set_pixel(
-                fbscreen, xpos - i, ypos - j, circle->color
-            );
+            pixels = vld1q_u16(src16 + i);
+            vst1q_u16(dst16 + i, vbslq_u16(vceqq_u16(pixels, key16), vld1q_u16(dst16 + i), pixels));
         }
+#endif
+        for (; i < count; i++)
+            dst16[i] = (src16[i] == (uint16_t)key) ? dst16[i] : src16[i];
     }
+    else if (4 == bytes)
+    {
+        uint32_t *dst32 = (uint32_t*)dst;
+        const uint32_t *src32 = (const uint32_t*)src;
+#ifdef __ARM_NEON
+        const uint32x4_t key32 = vdupq_n_u32(key);
+        uint32x4_t pixels;
 
-    return 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            pixels = vld1q_u32(src32 + i);
+            vst1q_u32(dst32 + i, vbslq_u32(vceqq_u32(pixels, key32), vld1q_u32(dst32 + i), pixels));
+        }
+#endif
+        for (; i < count; i++)
+            dst32[i] = (src32[i] == key) ? dst32[i] : src32[i];
+    }
+    else
+    {
+        for (; i < count; i++, dst += bytes, src += bytes)
+        {
+            if (memcmp(src, &key, bytes))
+                memcpy(dst, src, bytes);
+        }
+    }
 }
 
-int32_t fbscreen_flush_drawing
-(
-    struct fbscreen *fbscreen
+/* blit sprite rows straight from mapped pack, keyed sprite goes through
+ * the same select loops as layer composite */
+int32_t fbscreen_draw_asset(
+    struct fbscreen *fbscreen,
+    const struct cmd_draw_asset *draw
 )
 {
-    int32_t result = 0;
-    int32_t useless = 0;
-
-    assert(!(NULL == fbscreen));
-    if (NULL == fbscreen) return -1;
+    const struct fb_var_screeninfo *var_info;
+    const struct canvasasset_entry *entry;
+    const uint8_t *src;
+    uint32_t bytes, stride;
+    int64_t xsrc, ysrc, xdst, ydst, width, height;
+    uint8_t *mem;
 
-    /* wait for sync */
-    result = ioctl(fbscreen->fb_fd, FBIO_WAITFORVSYNC, &useless);
-    assert(!(result < 0));
-    if (result < 0) return -1;
+    assert(!(NULL == fbscreen || NULL == draw));
+    if (NULL == fbscreen || NULL == draw)
+        return -1;
 
-    /* call ioctl to change/swap starting position on y-axis */
-    fbscreen->var_info.activate = FB_ACTIVATE_VBL;
-    fbscreen->var_info.yoffset = fbscreen->drawing_yoffsets[fbscreen->drawing_idx];
-    result = ioctl(fbscreen->fb_fd, FBIOPAN_DISPLAY, &fbscreen->var_info);
-    assert(!(result < 0));
-    if (result < 0) return -1;
+    entry = canvasasset_find(fbscreen->assets, draw->id);
+    if ((NULL == entry) || (CANVASASSET_SPRITE != entry->type))
+        return -2;
 
-    /* calculate which half of memory is 'drawing' one.
-     * calculate address of 'drawing' memory */
-    uint32_t active_idx = fbscreen->drawing_idx;
-    fbscreen->drawing_idx = (fbscreen->drawing_idx + 1) & 0x1;
-    fbscreen->drawing_mem = fbscreen->drawing_addrs[fbscreen->drawing_idx];
+    var_info = &fbscreen->var_info;
+    xsrc = draw->xsrc;
+    ysrc = draw->ysrc;
+    xdst = draw->xpos;
+    ydst = draw->ypos;
+    width = draw->width ? draw->width : entry->width;
+    height = draw->height ? draw->height : entry->height;
 
-    /* wait for sync */
+    /* part of sprite first, then screen */
+    width = xsrc + width > entry->width ? (int64_t)entry->width - xsrc : width;
+    height = ysrc + height > entry->height ? (int64_t)entry->height - ysrc : height;
+    if (xdst < 0)
+    {
+        xsrc -= xdst;
+        width += xdst;
+        xdst = 0;
+    }
+    if (ydst < 0)
+    {
+        ysrc -= ydst;
+        height += ydst;
+        ydst = 0;
+    }
+    width = xdst + width > var_info->xres ? (int64_t)var_info->xres - xdst : width;
+    height = ydst + height > var_info->yres ? (int64_t)var_info->yres - ydst : height;
+    if ((width <= 0) || (height <= 0))
+        return 0;
+
+    fbscreen_draw_begin(fbscreen, xdst, ydst, xdst + width - 1, ydst + height - 1);
+
+    bytes = var_info->bits_per_pixel >> 3;
+    stride = var_info->xres * bytes;
+    mem = fbscreen_target(fbscreen) + ydst * stride + xdst * bytes;
+    src = canvasasset_data(fbscreen->assets, entry) + (ysrc * entry->width + xsrc) * bytes;
+    for (int64_t j = 0; j < height; j++)
+    {
+        if (entry->flags & CANVASASSET_KEYED)
+            fbscreen_copy_keyed(mem, src, width, bytes, entry->key_pixel);
+        else
+            memcpy(mem, src, width * bytes);
+        mem += stride;
+        src += entry->width * bytes;
+    }
+    return 0;
+}
+
+/* pack palette is already in pixel format */
+int32_t fbscreen_asset_palette(
+    struct fbscreen *fbscreen,
+    const uint32_t id
+)
+{
+    const struct canvasasset_entry *entry;
+    uint32_t count;
+
+    assert(!(NULL == fbscreen));
+    if (NULL == fbscreen)
+        return -1;
+
+    entry = canvasasset_find(fbscreen->assets, id);
+    if ((NULL == entry) || (CANVASASSET_PALETTE != entry->type))
+        return -2;
+
+    count = entry->width < CANVAS_PALETTE_SIZE ? entry->width : CANVAS_PALETTE_SIZE;
+    memcpy(fbscreen->palette, canvasasset_data(fbscreen->assets, entry), count * sizeof(uint32_t));
+    return 0;
+}
+
+/* recomposite regions damaged in any layer, bottom to top. Layers under
+ * the topmost opaque one are hidden, opaque rows are plain memcpy */
+static void fbscreen_composite(
+    struct fbscreen *fbscreen
+)
+{
+    struct fbscreen_rect region = { 0, 0, -1, -1 };
+    const struct fbscreen_layer *layer;
+    uint32_t bytes = fbscreen->var_info.bits_per_pixel >> 3;
+    uint32_t bottom = 0;
+    uint32_t width, offset;
+    uint64_t start_ns;
+
+    for (uint32_t i = 0; i < CANVAS_LAYER_COUNT; i++)
+    {
+        layer = &fbscreen->layers[i];
+        if (NULL != layer->mem)
+            fbscreen_rect_add(&region, &layer->damage);
+    }
+    for (uint32_t i = 0; i < CANVAS_LAYER_COUNT; i++)
+    {
+        fbscreen->layers[i].damage.x0 = 0;
+        fbscreen->layers[i].damage.x1 = -1;
+        if ((NULL != fbscreen->layers[i].mem) && (fbscreen->layers[i].flags & CANVAS_LAYER_OPAQUE))
+            bottom = i;
+    }
+    if (region.x0 > region.x1)
+        return;
+
+    start_ns = canvasstats_now_ns();
+    if (NULL != fbscreen->shadow_mem)
+        fbscreen_rect_add(&fbscreen->shadow_damage, &region);
+    else
+        fbscreen_beam_wait(fbscreen, region.y0, region.y1);
+
+    width = region.x1 - region.x0 + 1;
+    for (int32_t y = region.y0; y <= region.y1; y++)
+    {
+        offset = (y * fbscreen->var_info.xres + region.x0) * bytes;
+        for (uint32_t i = bottom; i < CANVAS_LAYER_COUNT; i++)
+        {
+            layer = &fbscreen->layers[i];
+            if (NULL == layer->mem)
+                continue;
+            if (layer->flags & CANVAS_LAYER_OPAQUE)
+                memcpy(fbscreen->drawing_mem + offset, layer->mem + offset, width * bytes);
+            else
+                fbscreen_copy_keyed(fbscreen->drawing_mem + offset, layer->mem + offset, width, bytes, layer->key_pixel);
+        }
+    }
+    canvasstats_sample(&canvasstats.composite, canvasstats_now_ns() - start_ns);
+}
+
+int32_t fbscreen_clear_screen(
+    struct fbscreen *fbscreen,
+    const uint32_t color
+)
+{
+    /* get var/fix info */
+    const struct fb_var_screeninfo *var_info = &fbscreen->var_info;
+
+    fbscreen_draw_begin(fbscreen, 0, 0, var_info->xres - 1, var_info->yres - 1);
+
+    /* rows top to bottom, behind the beam in single buffer mode */
+    for (int32_t j = 0; j < var_info->yres; j++)
+    {
+        for (int32_t i = 0; i < var_info->xres; i++)
+        {
+            fbscreen_set_pixel(fbscreen, i, j, color);
+        }
+    }
+
+    return 0;
+}
+
+int32_t fbscreen_draw_rectangle(
+    struct fbscreen *fbscreen,
+    const struct cmd_rectangle *rectangle
+)
+{
+    assert(!(NULL == fbscreen || NULL == rectangle));
+    if (NULL == fbscreen || NULL == rectangle)
+    {
+        return -1;
+    }
+
+    int32_t xpos = rectangle->xpos, ypos = rectangle->ypos;
+    if (rectangle->in_centre)
+    {
+        xpos -= rectangle->width/2;
+        ypos -= rectangle->height/2;
+    }
+
+    fbscreen_draw_begin(
+        fbscreen, xpos, ypos,
+        xpos + (int32_t)rectangle->width - 1, ypos + (int32_t)rectangle->height - 1
+    );
+
+    for (int32_t j = 0; j < rectangle->height; j++)
+    {
+        for (int32_t i = 0; i < rectangle->width; i++)
+        {
+            fbscreen_set_pixel(
+                fbscreen, xpos + i, ypos + j, rectangle->color
+            );
+        }
+    }
+
+    return 0;
+}
+
+int32_t fbscreen_draw_circle(
+    struct fbscreen *fbscreen,
+    const struct cmd_circle *circle
+)
+{
+    assert(!(NULL == fbscreen || NULL == circle));
+    if (NULL == fbscreen || NULL == circle)
+    {
+        return -1;
+    }
+
+    int32_t xpos = circle->xpos, ypos = circle->ypos;
+    if (!circle->in_centre)
+    {
+        xpos += circle->radius;
+        ypos += circle->radius;
+    }
+
+    int32_t xlimit;
+    int32_t radius_sqr = circle->radius * circle->radius;
+
+    fbscreen_draw_begin(
+        fbscreen, xpos - (int32_t)circle->radius, ypos - (int32_t)circle->radius,
+        xpos + (int32_t)circle->radius, ypos + (int32_t)circle->radius
+    );
+
+    for (int32_t i = 0; i < circle->radius; i++)
+    {
+        xlimit = sqrt(radius_sqr - (i * i));
+        for (int32_t j = 0; j < xlimit; j++)
+        {
+            fbscreen_set_pixel(
+                fbscreen, xpos + i, ypos + j, circle->color
+            );
+            fbscreen_set_pixel(
+                fbscreen, xpos - i, ypos + j, circle->color
+            );
+            fbscreen_set_pixel(
+                fbscreen, xpos + i, ypos - j, circle->color
+            );
+            fbscreen_set_pixel(
+                fbscreen, xpos - i, ypos - j, circle->color
+            );
+        }
+    }
+
+    return 0;
+}
+
+/* run of equal pixels */
+static void fbscreen_fill_row(
+    uint8_t *mem,
+    const uint32_t pixel,
+    const uint32_t count,
+    const uint32_t bytes
+)
+{
+    if (2 == bytes)
+    {
+        uint16_t *mem16 = (uint16_t*)mem;
+        for (uint32_t i = 0; i < count; i++)
+            mem16[i] = pixel;
+    }
+    else if (4 == bytes)
+    {
+        uint32_t *mem32 = (uint32_t*)mem;
+        for (uint32_t i = 0; i < count; i++)
+            mem32[i] = pixel;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count; i++, mem += bytes)
+            memcpy(mem, &pixel, bytes);
+    }
+}
+
+static int fbscreen_batch_compare(
+    const void *a,
+    const void *b
+)
+{
+    uint32_t key_a = *(const uint32_t*)a, key_b = *(const uint32_t*)b;
+
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+/* instances of batch share color, so they are drawn in memory order
+ * (row major, top first) without changing the picture. Key keeps
+ * signed order of both coordinates */
+static void fbscreen_batch_sort(
+    uint32_t *keys,
+    const struct cmd_batch_position *positions,
+    const uint32_t count
+)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        keys[i] = ((uint32_t)((uint16_t)positions[i].ypos ^ 0x8000) << 16) |
+            ((uint16_t)positions[i].xpos ^ 0x8000);
+    }
+    qsort(keys, count, sizeof(*keys), fbscreen_batch_compare);
+}
+
+#define FBSCREEN_BATCH_XPOS(key)        ((int32_t)(int16_t)(((key) & 0xFFFF) ^ 0x8000))
+#define FBSCREEN_BATCH_YPOS(key)        ((int32_t)(int16_t)(((key) >> 16) ^ 0x8000))
+
+/* span of row clipped to the screen, returns zero when nothing is left */
+static int32_t fbscreen_clip_span(
+    const struct fb_var_screeninfo *var_info,
+    int64_t *x0,
+    int64_t *x1,
+    const int64_t y
+)
+{
+    if ((y < 0) || (y >= var_info->yres))
+        return 0;
+    *x0 = *x0 < 0 ? 0 : *x0;
+    *x1 = *x1 >= var_info->xres ? (int64_t)var_info->xres - 1 : *x1;
+    return *x0 <= *x1;
+}
+
+/* equal rectangles, color converted and region announced once, rows
+ * are filled directly */
+int32_t fbscreen_rect_batch(
+    struct fbscreen *fbscreen,
+    const struct cmd_rect_batch *batch,
+    const struct cmd_batch_position *positions
+)
+{
+    const struct fb_var_screeninfo *var_info;
+    uint32_t keys[CANVAS_BATCH_MAX];
+    uint32_t bytes, stride, pixel;
+    int64_t xpos, ypos, x0, x1;
+    uint8_t *mem;
+
+    assert(!(NULL == fbscreen || NULL == batch || NULL == positions));
+    if (NULL == fbscreen || NULL == batch || NULL == positions)
+        return -1;
+
+    if (batch->count > CANVAS_BATCH_MAX)
+        return -2;
+    if (!batch->count || !batch->width || !batch->height)
+        return 0;
+
+    var_info = &fbscreen->var_info;
+    bytes = var_info->bits_per_pixel >> 3;
+    stride = var_info->xres * bytes;
+    pixel = fbscreen_color_pixel(var_info, batch->color);
+    fbscreen_batch_sort(keys, positions, batch->count);
+
+    /* first and last key bound rows, columns are searched */
+    x0 = INT32_MAX;
+    x1 = INT32_MIN;
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        xpos = FBSCREEN_BATCH_XPOS(keys[i]);
+        x0 = xpos < x0 ? xpos : x0;
+        x1 = xpos > x1 ? xpos : x1;
+    }
+    xpos = batch->in_centre ? batch->width / 2 : 0;
+    ypos = batch->in_centre ? batch->height / 2 : 0;
+    fbscreen_draw_begin(
+        fbscreen, x0 - xpos, FBSCREEN_BATCH_YPOS(keys[0]) - ypos,
+        x1 - xpos + batch->width - 1, FBSCREEN_BATCH_YPOS(keys[batch->count - 1]) - ypos + batch->height - 1
+    );
+
+    mem = fbscreen_target(fbscreen);
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        x0 = FBSCREEN_BATCH_XPOS(keys[i]) - xpos;
+        x1 = x0 + batch->width - 1;
+        for (int64_t y = FBSCREEN_BATCH_YPOS(keys[i]) - ypos, j = 0; j < batch->height; j++, y++)
+        {
+            if (fbscreen_clip_span(var_info, &x0, &x1, y))
+                fbscreen_fill_row(mem + y * stride + x0 * bytes, pixel, x1 - x0 + 1, bytes);
+        }
+    }
+    return 0;
+}
+
+/* equal circles, same discs as fbscreen_draw_circle drawn by rows. Half
+ * width of each row is computed once for the whole batch: pixel at
+ * column offset 'i' is in row offset 'j' when sqrt(r^2 - i^2) > j.
+ * Radius is limited by xres + yres (longer than diagonal), so the row
+ * table stays small whatever slave sends */
+int32_t fbscreen_circle_batch(
+    struct fbscreen *fbscreen,
+    const struct cmd_circle_batch *batch,
+    const struct cmd_batch_position *positions
+)
+{
+    const struct fb_var_screeninfo *var_info;
+    uint32_t keys[CANVAS_BATCH_MAX];
+    uint32_t bytes, stride, pixel;
+    int64_t radius, centre, xpos, ypos, x0, x1;
+    int32_t *half;
+    uint8_t *mem;
+
+    assert(!(NULL == fbscreen || NULL == batch || NULL == positions));
+    if (NULL == fbscreen || NULL == batch || NULL == positions)
+        return -1;
+
+    if (batch->count > CANVAS_BATCH_MAX)
+        return -2;
+    if (!batch->count || !batch->radius)
+        return 0;
+    var_info = &fbscreen->var_info;
+    if (batch->radius > var_info->xres + var_info->yres)
+        return -2;
+
+    radius = batch->radius;
+    half = malloc(radius * sizeof(*half));
+    if (NULL == half)
+        return -1;
+    for (int64_t j = 0; j < radius; j++)
+        half[j] = sqrt(radius * radius - (j + 1) * (j + 1));
+
+    bytes = var_info->bits_per_pixel >> 3;
+    stride = var_info->xres * bytes;
+    pixel = fbscreen_color_pixel(var_info, batch->color);
+    fbscreen_batch_sort(keys, positions, batch->count);
+
+    x0 = INT32_MAX;
+    x1 = INT32_MIN;
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        xpos = FBSCREEN_BATCH_XPOS(keys[i]);
+        x0 = xpos < x0 ? xpos : x0;
+        x1 = xpos > x1 ? xpos : x1;
+    }
+    centre = batch->in_centre ? 0 : radius;
+    fbscreen_draw_begin(
+        fbscreen, x0 + centre - radius, FBSCREEN_BATCH_YPOS(keys[0]) + centre - radius,
+        x1 + centre + radius, FBSCREEN_BATCH_YPOS(keys[batch->count - 1]) + centre + radius
+    );
+
+    mem = fbscreen_target(fbscreen);
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        xpos = FBSCREEN_BATCH_XPOS(keys[i]) + centre;
+        ypos = FBSCREEN_BATCH_YPOS(keys[i]) + centre;
+        /* top row first */
+        for (int64_t j = 1 - radius; j < radius; j++)
+        {
+            x0 = xpos - half[j < 0 ? -j : j];
+            x1 = xpos + half[j < 0 ? -j : j];
+            if (fbscreen_clip_span(var_info, &x0, &x1, ypos + j))
+                fbscreen_fill_row(mem + (ypos + j) * stride + x0 * bytes, pixel, x1 - x0 + 1, bytes);
+        }
+    }
+    free(half);
+    return 0;
+}
+
+/* chunk of image in framebuffer format, copied row by row into target
+ * without conversion, clipped parts of rows are skipped */
+int32_t fbscreen_put_pixels(
+    struct fbscreen *fbscreen,
+    const struct cmd_put_pixels *put,
+    const uint8_t *pixels
+)
+{
+    const struct fb_var_screeninfo *var_info;
+    uint32_t bytes, stride;
+    uint64_t pos, count, total, run;
+    int64_t x0, x1, xs, xe, y;
+    uint8_t *mem;
+
+    assert(!(NULL == fbscreen || NULL == put || (put->size && (NULL == pixels))));
+    if (NULL == fbscreen || NULL == put || (put->size && (NULL == pixels)))
+        return -1;
+
+    var_info = &fbscreen->var_info;
+    bytes = var_info->bits_per_pixel >> 3;
+    stride = var_info->xres * bytes;
+    total = (uint64_t)put->width * put->height;
+    pos = put->offset;
+    count = put->size / bytes;
+    if ((0 == count) || (pos >= total))
+        return 0;
+    count = count < total - pos ? count : total - pos;
+
+    fbscreen_draw_begin(
+        fbscreen, put->xpos, put->ypos + (int64_t)(pos / put->width),
+        put->xpos + (int64_t)put->width - 1, put->ypos + (int64_t)((pos + count - 1) / put->width)
+    );
+
+    mem = fbscreen_target(fbscreen);
+    while (count)
+    {
+        run = put->width - pos % put->width;
+        run = run < count ? run : count;
+        y = put->ypos + (int64_t)(pos / put->width);
+        x0 = put->xpos + (int64_t)(pos % put->width);
+        x1 = x0 + run;
+        xs = x0 < 0 ? 0 : x0;
+        xe = x1 > var_info->xres ? var_info->xres : x1;
+        if ((y >= 0) && (y < var_info->yres) && (xs < xe))
+        {
+            memcpy(mem + y * stride + xs * bytes,
+                pixels + (xs - x0) * bytes, (xe - xs) * bytes);
+        }
+        pixels += run * bytes;
+        pos += run;
+        count -= run;
+    }
+    return 0;
+}
+
+/* convert palette entries once, expansion is a plain lookup then */
+int32_t fbscreen_set_palette(
+    struct fbscreen *fbscreen,
+    const uint32_t first,
+    const uint32_t *colors,
+    uint32_t count
+)
+{
+    assert(!(NULL == fbscreen || (count && (NULL == colors))));
+    if (NULL == fbscreen || (count && (NULL == colors)))
+        return -1;
+
+    if (first >= CANVAS_PALETTE_SIZE)
+        return 0;
+    count = count < CANVAS_PALETTE_SIZE - first ? count : CANVAS_PALETTE_SIZE - first;
+    for (uint32_t i = 0; i < count; i++)
+        fbscreen->palette[first + i] = fbscreen_color_pixel(&fbscreen->var_info, colors[i]);
+    return 0;
+}
+
+#ifdef __ARM_NEON
+/* eight indices below 16 looked up in byte planes of palette entries,
+ * planes are interleaved back into pixels when stored */
+static inline __attribute__((always_inline)) void fbscreen_lookup_neon(
+    uint8_t *dst,
+    const uint8x8x2_t *planes,
+    const uint8x8_t idx,
+    const uint32_t bytes
+)
+{
+    if (2 == bytes)
+    {
+        uint8x8x2_t pixels = {{ vtbl2_u8(planes[0], idx), vtbl2_u8(planes[1], idx) }};
+        vst2_u8(dst, pixels);
+    }
+    else if (3 == bytes)
+    {
+        uint8x8x3_t pixels = {{ vtbl2_u8(planes[0], idx), vtbl2_u8(planes[1], idx), vtbl2_u8(planes[2], idx) }};
+        vst3_u8(dst, pixels);
+    }
+    else
+    {
+        uint8x8x4_t pixels = {{
+            vtbl2_u8(planes[0], idx), vtbl2_u8(planes[1], idx),
+            vtbl2_u8(planes[2], idx), vtbl2_u8(planes[3], idx)
+        }};
+        vst4_u8(dst, pixels);
+    }
+}
+#endif
+
+/* expand 'count' indices starting at index 'k' of packed stream into
+ * row of pixels, inlined with constant depth and pixel size. With NEON
+ * 4 and 2 bit indices go through table lookup of 16 entries (vtbl), 8
+ * bytes of stream at once */
+static inline __attribute__((always_inline)) void fbscreen_expand_row(
+    uint8_t *restrict dst,
+    const uint32_t *restrict palette,
+    const uint8_t *restrict indices,
+    uint64_t k,
+    uint32_t count,
+    const uint32_t depth,
+    const uint32_t bytes
+)
+{
+    /* indices per byte */
+    const uint32_t per_byte = 8 / depth;
+    const uint32_t mask = (1 << depth) - 1;
+    uint32_t pixel;
+    uint32_t i = 0;
+
+#define FBSCREEN_INDEX(src, i) \
+    (((src)[(i) / per_byte] >> ((per_byte - 1 - (i) % per_byte) * depth)) & mask)
+
+    /* leading indices up to byte boundary of stream */
+    for (; count && (k % per_byte); count--, k++, dst += bytes)
+    {
+        pixel = palette[FBSCREEN_INDEX(indices, k)];
+        memcpy(dst, &pixel, bytes);
+    }
+    indices += k / per_byte;
+
+#ifdef __ARM_NEON
+    if (depth < 8)
+    {
+        /* byte 'b' of the first 16 entries in plane 'b' */
+        const uint8x16x4_t entries = vld4q_u8((const uint8_t*)palette);
+        const uint8x8_t low_mask = vdup_n_u8(depth == 4 ? 0xF : 0x3);
+        uint8x8x2_t planes[4];
+        uint8x8x2_t pairs, odd, even;
+        uint8x8_t packed;
+
+        for (uint32_t b = 0; b < 4; b++)
+        {
+            planes[b].val[0] = vget_low_u8(entries.val[b]);
+            planes[b].val[1] = vget_high_u8(entries.val[b]);
+        }
+        for (; i + 8 * per_byte <= count; i += 8 * per_byte)
+        {
+            packed = vld1_u8(indices + i / per_byte);
+            if (4 == depth)
+            {
+                /* high nibble is the first index */
+                pairs = vzip_u8(vshr_n_u8(packed, 4), vand_u8(packed, low_mask));
+                fbscreen_lookup_neon(dst + i * bytes, planes, pairs.val[0], bytes);
+                fbscreen_lookup_neon(dst + (i + 8) * bytes, planes, pairs.val[1], bytes);
+            }
+            else
+            {
+                /* fields 0 and 2, 1 and 3 of every byte, zipped again
+                 * into stream order */
+                even = vzip_u8(vshr_n_u8(packed, 6), vand_u8(vshr_n_u8(packed, 2), low_mask));
+                odd = vzip_u8(vand_u8(vshr_n_u8(packed, 4), low_mask), vand_u8(packed, low_mask));
+                pairs = vzip_u8(even.val[0], odd.val[0]);
+                fbscreen_lookup_neon(dst + i * bytes, planes, pairs.val[0], bytes);
+                fbscreen_lookup_neon(dst + (i + 8) * bytes, planes, pairs.val[1], bytes);
+                pairs = vzip_u8(even.val[1], odd.val[1]);
+                fbscreen_lookup_neon(dst + (i + 16) * bytes, planes, pairs.val[0], bytes);
+                fbscreen_lookup_neon(dst + (i + 24) * bytes, planes, pairs.val[1], bytes);
+            }
+        }
+    }
+#endif
+
+    if (2 == bytes)
+    {
+        uint16_t *restrict pixels = (uint16_t*)dst;
+        for (; i < count; i++)
+            pixels[i] = palette[FBSCREEN_INDEX(indices, i)];
+    }
+    else if (4 == bytes)
+    {
+        uint32_t *restrict pixels = (uint32_t*)dst;
+        for (; i < count; i++)
+            pixels[i] = palette[FBSCREEN_INDEX(indices, i)];
+    }
+    else
+    {
+        /* little endian, low three bytes */
+        for (; i < count; i++)
+        {
+            pixel = palette[FBSCREEN_INDEX(indices, i)];
+            memcpy(dst + i * 3, &pixel, 3);
+        }
+    }
+#undef FBSCREEN_INDEX
+}
+
+static void fbscreen_expand_indexed(
+    const struct fbscreen *fbscreen,
+    uint8_t *dst,
+    const uint8_t *indices,
+    const uint64_t k,
+    const uint32_t count,
+    const uint32_t depth
+)
+{
+    const uint32_t *palette = fbscreen->palette;
+
+#define FBSCREEN_EXPAND(depth) \
+    switch (fbscreen->var_info.bits_per_pixel) \
+    { \
+        case 16: fbscreen_expand_row(dst, palette, indices, k, count, depth, 2); break; \
+        case 24: fbscreen_expand_row(dst, palette, indices, k, count, depth, 3); break; \
+        case 32: fbscreen_expand_row(dst, palette, indices, k, count, depth, 4); break; \
+    }
+
+    switch (depth)
+    {
+        case 8: FBSCREEN_EXPAND(8); break;
+        case 4: FBSCREEN_EXPAND(4); break;
+        case 2: FBSCREEN_EXPAND(2); break;
+    }
+#undef FBSCREEN_EXPAND
+}
+
+/* chunk of indexed image expanded through palette into target, same
+ * streaming and clipping as fbscreen_put_pixels */
+int32_t fbscreen_put_indexed(
+    struct fbscreen *fbscreen,
+    const struct cmd_put_indexed *put,
+    const uint8_t *indices
+)
+{
+    const struct fb_var_screeninfo *var_info;
+    uint32_t bytes, stride;
+    uint64_t pos, count, total, run, k;
+    int64_t x0, x1, xs, xe, y;
+    uint8_t *mem;
+
+    assert(!(NULL == fbscreen || NULL == put || (put->size && (NULL == indices))));
+    if (NULL == fbscreen || NULL == put || (put->size && (NULL == indices)))
+        return -1;
+
+    if ((8 != put->depth) && (4 != put->depth) && (2 != put->depth))
+        return -2;
+
+    var_info = &fbscreen->var_info;
+    bytes = var_info->bits_per_pixel >> 3;
+    stride = var_info->xres * bytes;
+    total = (uint64_t)put->width * put->height;
+    pos = put->offset;
+    count = (uint64_t)put->size * 8 / put->depth;
+    if ((0 == count) || (pos >= total))
+        return 0;
+    count = count < total - pos ? count : total - pos;
+
+    fbscreen_draw_begin(
+        fbscreen, put->xpos, put->ypos + (int64_t)(pos / put->width),
+        put->xpos + (int64_t)put->width - 1, put->ypos + (int64_t)((pos + count - 1) / put->width)
+    );
+
+    mem = fbscreen_target(fbscreen);
+    /* index of current pixel within chunk */
+    k = 0;
+    while (count)
+    {
+        run = put->width - pos % put->width;
+        run = run < count ? run : count;
+        y = put->ypos + (int64_t)(pos / put->width);
+        x0 = put->xpos + (int64_t)(pos % put->width);
+        x1 = x0 + run;
+        xs = x0 < 0 ? 0 : x0;
+        xe = x1 > var_info->xres ? var_info->xres : x1;
+        if ((y >= 0) && (y < var_info->yres) && (xs < xe))
+        {
+            fbscreen_expand_indexed(
+                fbscreen, mem + y * stride + xs * bytes,
+                indices, k + (xs - x0), xe - xs, put->depth
+            );
+        }
+        k += run;
+        pos += run;
+        count -= run;
+    }
+    return 0;
+}
+
+/* decoded pixels, 'pos' is index of the first within image */
+static void fbscreen_store_image(
+    struct fbscreen *fbscreen,
+    uint64_t pos,
+    const uint32_t *pixels,
+    uint32_t count
+)
+{
+    const struct fb_var_screeninfo *var_info = &fbscreen->var_info;
+    const struct fbscreen_image *image = &fbscreen->image;
+    uint32_t bytes = var_info->bits_per_pixel >> 3;
+    uint32_t stride = var_info->xres * bytes;
+    uint32_t width = image->qoi.width;
+    uint8_t *mem = fbscreen_target(fbscreen);
+    uint8_t *dst;
+    uint32_t pixel;
+    uint64_t run;
+    int64_t x0, y;
+
+    fbscreen_draw_begin(
+        fbscreen, image->xpos, image->ypos + (int64_t)(pos / width),
+        image->xpos + (int64_t)width - 1, image->ypos + (int64_t)((pos + count - 1) / width)
+    );
+
+    while (count)
+    {
+        run = width - pos % width;
+        run = run < count ? run : count;
+        y = image->ypos + (int64_t)(pos / width);
+        x0 = image->xpos + (int64_t)(pos % width);
+        if ((y >= 0) && (y < var_info->yres))
+        {
+            for (uint32_t i = 0; i < run; i++)
+            {
+                if ((x0 + i < 0) || (x0 + i >= var_info->xres) || !(pixels[i] >> 24))
+                    continue;
+                dst = mem + y * stride + (x0 + i) * bytes;
+                pixel = fbscreen_color_pixel(var_info, pixels[i]);
+                memcpy(dst, &pixel, bytes);
+            }
+        }
+        pixels += run;
+        pos += run;
+        count -= run;
+    }
+}
+
+/* chunk of compressed image, decoded in batches straight into target */
+int32_t fbscreen_put_image(
+    struct fbscreen *fbscreen,
+    const struct cmd_put_image *put,
+    const uint8_t *data
+)
+{
+    struct fbscreen_image *image;
+    uint32_t pixels[FBSCREEN_IMAGE_BATCH];
+    uint32_t size;
+    uint64_t pos;
+    int32_t count;
+
+    assert(!(NULL == fbscreen || NULL == put || (put->size && (NULL == data))));
+    if (NULL == fbscreen || NULL == put || (put->size && (NULL == data)))
+        return -1;
+
+    image = &fbscreen->image;
+    if (put->flags & CANVAS_IMAGE_BEGIN)
+    {
+        canvasqoi_init(&image->qoi);
+        image->xpos = put->xpos;
+        image->ypos = put->ypos;
+        image->active = 1;
+    }
+    /* continuation of image which was not started or failed */
+    if (!image->active)
+        return -2;
+
+    size = put->size;
+    while (1)
+    {
+        pos = (uint64_t)image->qoi.width * image->qoi.height - image->qoi.left;
+        count = canvasqoi_decode(&image->qoi, &data, &size, pixels, FBSCREEN_IMAGE_BATCH);
+        if (0 > count)
+        {
+            image->active = 0;
+            return -2;
+        }
+        if (0 == count)
+            break;
+        fbscreen_store_image(fbscreen, pos, pixels, count);
+    }
+    return 0;
+}
+
+/* row of sample, values outside the range stick to the edge */
+static int32_t fbscreen_chart_row(
+    const struct cmd_chart_config *config,
+    int32_t value
+)
+{
+    value = value < config->min ? config->min : value;
+    value = value > config->max ? config->max : value;
+    return config->ypos + (int32_t)config->height - 1 - (int32_t)(
+        ((int64_t)value - config->min) * (config->height - 1) /
+        ((int64_t)config->max - config->min)
+    );
+}
+
+/* define chart and clear its region, zero width removes it */
+int32_t fbscreen_chart_config(
+    struct fbscreen *fbscreen,
+    const struct cmd_chart_config *config
+)
+{
+    struct fbscreen_chart *chart;
+    struct cmd_rectangle region = { 0 };
+
+    assert(!(NULL == fbscreen || NULL == config));
+    if (NULL == fbscreen || NULL == config)
+        return -1;
+
+    if (config->chart >= CANVAS_CHART_COUNT)
+        return -2;
+    chart = &fbscreen->charts[config->chart];
+
+    if (0 == config->width)
+    {
+        memset(chart, 0, sizeof(*chart));
+        return 0;
+    }
+    if ((0 == config->height) || (config->max <= config->min))
+        return -2;
+
+    chart->config = *config;
+    chart->has_last = 0;
+
+    region.xpos = config->xpos;
+    region.ypos = config->ypos;
+    region.width = config->width;
+    region.height = config->height;
+    region.color = config->background;
+    return fbscreen_draw_rectangle(fbscreen, &region);
+}
+
+/* append samples at the right edge, the rest of region is scrolled
+ * left by copy and only columns of new samples are drawn */
+int32_t fbscreen_chart_push(
+    struct fbscreen *fbscreen,
+    const uint32_t chart_idx,
+    const int16_t *samples,
+    uint32_t count
+)
+{
+    struct fbscreen_chart *chart;
+    const struct cmd_chart_config *config;
+    struct cmd_copy_area scroll;
+    struct cmd_rectangle column = { 0 };
+    int32_t y, top, bottom;
+
+    assert(!(NULL == fbscreen || (count && (NULL == samples))));
+    if (NULL == fbscreen || (count && (NULL == samples)))
+        return -1;
+
+    if (chart_idx >= CANVAS_CHART_COUNT)
+        return -2;
+    chart = &fbscreen->charts[chart_idx];
+    config = &chart->config;
+    if (0 == config->width)
+        return -2;
+    if (0 == count)
+        return 0;
+
+    /* samples scrolled out within this push are never drawn, line
+     * continues from the last one of them */
+    if (count > config->width)
+    {
+        chart->last_y = fbscreen_chart_row(config, samples[count - config->width - 1]);
+        chart->has_last = 1;
+        samples += count - config->width;
+        count = config->width;
+    }
+
+    if (count < config->width)
+    {
+        scroll.xsrc = config->xpos + (int32_t)count;
+        scroll.ysrc = config->ypos;
+        scroll.width = config->width - count;
+        scroll.height = config->height;
+        scroll.xdst = config->xpos;
+        scroll.ydst = config->ypos;
+        fbscreen_copy_area(fbscreen, &scroll);
+    }
+
+    /* background of all new columns at once */
+    column.xpos = config->xpos + (int32_t)(config->width - count);
+    column.ypos = config->ypos;
+    column.width = count;
+    column.height = config->height;
+    column.color = config->background;
+    fbscreen_draw_rectangle(fbscreen, &column);
+
+    column.width = 1;
+    column.color = config->color;
+    for (uint32_t i = 0; i < count; i++, column.xpos++)
+    {
+        y = fbscreen_chart_row(config, samples[i]);
+        top = bottom = y;
+        if (CANVAS_CHART_BARS == config->style)
+        {
+            bottom = config->ypos + (int32_t)config->height - 1;
+        }
+        else if ((CANVAS_CHART_LINE == config->style) && chart->has_last)
+        {
+            /* vertical run joins previous sample */
+            top = chart->last_y < y ? chart->last_y : y;
+            bottom = chart->last_y > y ? chart->last_y : y;
+        }
+        chart->last_y = y;
+        chart->has_last = 1;
+
+        column.ypos = top;
+        column.height = bottom - top + 1;
+        fbscreen_draw_rectangle(fbscreen, &column);
+    }
+    return 0;
+}
+
+#ifdef __ARM_NEON
+/* vector of pixels 'src', 'src' + 'step', ..., 'step' is 1 or -1 */
+static inline __attribute__((always_inline)) uint16x8_t fbscreen_load16_neon(
+    const uint16_t *src,
+    const int32_t step
+)
+{
+    uint16x8_t pixels;
+
+    if (1 == step)
+        return vld1q_u16(src);
+    pixels = vrev64q_u16(vld1q_u16(src - 7));
+    return vcombine_u16(vget_high_u16(pixels), vget_low_u16(pixels));
+}
+
+static inline __attribute__((always_inline)) uint32x4_t fbscreen_load32_neon(
+    const uint32_t *src,
+    const int32_t step
+)
+{
+    uint32x4_t pixels;
+
+    if (1 == step)
+        return vld1q_u32(src);
+    pixels = vrev64q_u32(vld1q_u32(src - 3));
+    return vcombine_u32(vget_high_u32(pixels), vget_low_u32(pixels));
+}
+
+/* 8x8 block of destination, pixel (x, y) is 'src' + x * 'step_x' +
+ * y * 'step_y'. Source lines along 'step_y' (1 or -1) are loaded as
+ * vectors and transposed in registers */
+static inline __attribute__((always_inline)) void fbscreen_transpose16_neon(
+    uint16_t *dst,
+    const uint32_t dst_xres,
+    const uint16_t *src,
+    const int32_t step_x,
+    const int32_t step_y
+)
+{
+    uint16x8_t lines[8];
+    uint16x8x2_t pairs[4];
+    uint32x4x2_t quads[4];
+
+    for (int32_t x = 0; x < 8; x++)
+        lines[x] = fbscreen_load16_neon(src + x * step_x, step_y);
+    for (int32_t i = 0; i < 4; i++)
+        pairs[i] = vtrnq_u16(lines[2 * i], lines[2 * i + 1]);
+    quads[0] = vtrnq_u32(vreinterpretq_u32_u16(pairs[0].val[0]), vreinterpretq_u32_u16(pairs[1].val[0]));
+    quads[1] = vtrnq_u32(vreinterpretq_u32_u16(pairs[0].val[1]), vreinterpretq_u32_u16(pairs[1].val[1]));
+    quads[2] = vtrnq_u32(vreinterpretq_u32_u16(pairs[2].val[0]), vreinterpretq_u32_u16(pairs[3].val[0]));
+    quads[3] = vtrnq_u32(vreinterpretq_u32_u16(pairs[2].val[1]), vreinterpretq_u32_u16(pairs[3].val[1]));
+    /* row 'y' is half of quads of lines 0-3 and 4-7 */
+    for (int32_t y = 0; y < 4; y++)
+    {
+        vst1q_u16(dst + y * dst_xres, vreinterpretq_u16_u32(vcombine_u32(
+            vget_low_u32(quads[y & 1].val[y >> 1]), vget_low_u32(quads[2 + (y & 1)].val[y >> 1]))));
+        vst1q_u16(dst + (y + 4) * dst_xres, vreinterpretq_u16_u32(vcombine_u32(
+            vget_high_u32(quads[y & 1].val[y >> 1]), vget_high_u32(quads[2 + (y & 1)].val[y >> 1]))));
+    }
+}
+
+/* 4x4 block of 32bit pixels, same as fbscreen_transpose16_neon */
+static inline __attribute__((always_inline)) void fbscreen_transpose32_neon(
+    uint32_t *dst,
+    const uint32_t dst_xres,
+    const uint32_t *src,
+    const int32_t step_x,
+    const int32_t step_y
+)
+{
+    uint32x4_t lines[4];
+    uint32x4x2_t pairs[2];
+
+    for (int32_t x = 0; x < 4; x++)
+        lines[x] = fbscreen_load32_neon(src + x * step_x, step_y);
+    pairs[0] = vtrnq_u32(lines[0], lines[1]);
+    pairs[1] = vtrnq_u32(lines[2], lines[3]);
+    for (int32_t y = 0; y < 2; y++)
+    {
+        vst1q_u32(dst + y * dst_xres, vcombine_u32(vget_low_u32(pairs[0].val[y]), vget_low_u32(pairs[1].val[y])));
+        vst1q_u32(dst + (y + 2) * dst_xres, vcombine_u32(vget_high_u32(pairs[0].val[y]), vget_high_u32(pairs[1].val[y])));
+    }
+}
+
+/* tile of 90 or 270 degrees in blocks transposed by NEON. Last block of
+ * row (column) of blocks is moved back over previous one, so any tile
+ * at least one block wide and high is covered. Returns 0 when tile is
+ * left to plain loop */
+static inline __attribute__((always_inline)) int32_t fbscreen_rotate_tile_neon(
+    uint8_t *dst,
+    const uint32_t dst_xres,
+    const uint8_t *src,
+    const int32_t origin,
+    const int32_t step_x,
+    const int32_t step_y,
+    const int32_t xtile,
+    const int32_t ytile,
+    const int32_t count,
+    const int32_t yend,
+    const uint32_t bytes
+)
+{
+    const int32_t lanes = 16 / bytes;
+    int32_t src_idx, dst_idx;
+
+    if (((2 != bytes) && (4 != bytes)) || ((1 != step_y) && (-1 != step_y)) ||
+        (count < lanes) || (yend - ytile + 1 < lanes))
+    {
+        return 0;
+    }
+
+    for (int32_t y = ytile; y <= yend; y += lanes)
+    {
+        if (y + lanes - 1 > yend)
+            y = yend - lanes + 1;
+        for (int32_t x = xtile; x < xtile + count; x += lanes)
+        {
+            if (x + lanes > xtile + count)
+                x = xtile + count - lanes;
+            dst_idx = y * dst_xres + x;
+            src_idx = origin + x * step_x + y * step_y;
+            if (2 == bytes)
+                fbscreen_transpose16_neon((uint16_t*)dst + dst_idx, dst_xres, (const uint16_t*)src + src_idx, step_x, step_y);
+            else
+                fbscreen_transpose32_neon((uint32_t*)dst + dst_idx, dst_xres, (const uint32_t*)src + src_idx, step_x, step_y);
+        }
+    }
+    return 1;
+}
+#endif
+
+/* rows of destination 'region' from source rotated clockwise, pixel
+ * (x, y) is read from source pixel 'origin' + x * 'step_x' + y * 'step_y'.
+ * Region is walked in square tiles, rows of destination are written
+ * sequentially and source lines of tile stay in cache. Pixel size and
+ * 'step_x' are constants of each caller. With NEON, rows of 180 degrees
+ * are reversed a vector at a time and tiles of 90 and 270 are transposed
+ * in blocks, otherwise they are plain strided loads */
+static inline __attribute__((always_inline)) void fbscreen_rotate_tiles(
+    uint8_t *dst,
+    const uint32_t dst_xres,
+    const uint8_t *src,
+    const int32_t origin,
+    const int32_t step_x,
+    const int32_t step_y,
+    const struct fbscreen_rect *region,
+    const uint32_t bytes
+)
+{
+    int32_t src_idx, dst_idx;
+    int32_t count, yend;
+
+    for (int32_t ytile = region->y0; ytile <= region->y1; ytile += FBSCREEN_ROTATE_TILE)
+    {
+        yend = ytile + FBSCREEN_ROTATE_TILE - 1 < region->y1 ? ytile + FBSCREEN_ROTATE_TILE - 1 : region->y1;
+        for (int32_t xtile = region->x0; xtile <= region->x1; xtile += FBSCREEN_ROTATE_TILE)
+        {
+            count = region->x1 - xtile + 1 < FBSCREEN_ROTATE_TILE ? region->x1 - xtile + 1 : FBSCREEN_ROTATE_TILE;
+#ifdef __ARM_NEON
+            if (fbscreen_rotate_tile_neon(dst, dst_xres, src, origin, step_x, step_y, xtile, ytile, count, yend, bytes))
+                continue;
+#endif
+            for (int32_t y = ytile; y <= yend; y++)
+            {
+                int32_t x = 0;
+
+                dst_idx = y * dst_xres + xtile;
+                src_idx = origin + xtile * step_x + y * step_y;
+                if (2 == bytes)
+                {
+                    uint16_t *dst_row = (uint16_t*)dst + dst_idx;
+                    const uint16_t *src_pixel = (const uint16_t*)src + src_idx;
+#ifdef __ARM_NEON
+                    if (-1 == step_x)
+                    {
+                        for (; x + 8 <= count; x += 8)
+                            vst1q_u16(dst_row + x, fbscreen_load16_neon(src_pixel - x, -1));
+                    }
+#endif
+                    for (; x < count; x++)
+                        dst_row[x] = src_pixel[x * step_x];
+                }
+                else if (4 == bytes)
+                {
+                    uint32_t *dst_row = (uint32_t*)dst + dst_idx;
+                    const uint32_t *src_pixel = (const uint32_t*)src + src_idx;
+#ifdef __ARM_NEON
+                    if (-1 == step_x)
+                    {
+                        for (; x + 4 <= count; x += 4)
+                            vst1q_u32(dst_row + x, fbscreen_load32_neon(src_pixel - x, -1));
+                    }
+#endif
+                    for (; x < count; x++)
+                        dst_row[x] = src_pixel[x * step_x];
+                }
+                else
+                {
+                    for (; x < count; x++)
+                        memcpy(dst + (dst_idx + x) * 3, src + (src_idx + x * step_x) * 3, 3);
+                }
+            }
+        }
+    }
+}
+
+/* rectangle of source ('xres' x 'yres') as it lands in the source
+ * rotated clockwise by 'rotation' */
+static struct fbscreen_rect fbscreen_rotate_rect(
+    const struct fbscreen_rect *rect,
+    const int32_t xres,
+    const int32_t yres,
+    const uint32_t rotation
+)
+{
+    struct fbscreen_rect rotated = *rect;
+
+    if (90 == rotation)
+    {
+        rotated.x0 = yres - 1 - rect->y1;
+        rotated.y0 = rect->x0;
+        rotated.x1 = yres - 1 - rect->y0;
+        rotated.y1 = rect->x1;
+    }
+    else if (180 == rotation)
+    {
+        rotated.x0 = xres - 1 - rect->x1;
+        rotated.y0 = yres - 1 - rect->y1;
+        rotated.x1 = xres - 1 - rect->x0;
+        rotated.y1 = yres - 1 - rect->y0;
+    }
+    else if (270 == rotation)
+    {
+        rotated.x0 = rect->y0;
+        rotated.y0 = xres - 1 - rect->x1;
+        rotated.x1 = rect->y1;
+        rotated.y1 = xres - 1 - rect->x0;
+    }
+    return rotated;
+}
+
+/* fill destination 'region' of 'src' ('xres' x 'yres') rotated clockwise
+ * by 'rotation', destination rows are 'yres' ('xres' for 180) pixels */
+static void fbscreen_rotate(
+    uint8_t *dst,
+    const uint8_t *src,
+    const int32_t xres,
+    const int32_t yres,
+    const uint32_t rotation,
+    const struct fbscreen_rect *region,
+    const uint32_t bytes
+)
+{
+    uint32_t dst_xres = (180 == rotation) ? xres : yres;
+    int32_t origin, step_x, step_y;
+
+    if (90 == rotation)
+    {
+        origin = (yres - 1) * xres;
+        step_x = -xres;
+        step_y = 1;
+    }
+    else if (180 == rotation)
+    {
+        origin = (yres - 1) * xres + xres - 1;
+        step_x = -1;
+        step_y = -xres;
+    }
+    else
+    {
+        origin = xres - 1;
+        step_x = xres;
+        step_y = -1;
+    }
+
+    /* constant pixel size and direction of source walk */
+    if ((180 == rotation) && (2 == bytes))
+        fbscreen_rotate_tiles(dst, dst_xres, src, origin, -1, step_y, region, 2);
+    else if ((180 == rotation) && (4 == bytes))
+        fbscreen_rotate_tiles(dst, dst_xres, src, origin, -1, step_y, region, 4);
+    else if (180 == rotation)
+        fbscreen_rotate_tiles(dst, dst_xres, src, origin, -1, step_y, region, 3);
+    else if (2 == bytes)
+        fbscreen_rotate_tiles(dst, dst_xres, src, origin, step_x, step_y, region, 2);
+    else if (4 == bytes)
+        fbscreen_rotate_tiles(dst, dst_xres, src, origin, step_x, step_y, region, 4);
+    else
+        fbscreen_rotate_tiles(dst, dst_xres, src, origin, step_x, step_y, region, 3);
+}
+
+/* bring region of upright frame changed since previous flush (and the
+ * one before, other half did not get it yet) into drawing half */
+static void fbscreen_rotate_damage(
+    struct fbscreen *fbscreen
+)
+{
+    struct fbscreen_rect region = fbscreen->shadow_damage;
+    struct fbscreen_rect panel_region;
+    uint64_t start_ns;
+
+    /* single buffer has one half only */
+    if (!fbscreen->single_buffer)
+        fbscreen_rect_add(&region, &fbscreen->shadow_damage_prev);
+    fbscreen->shadow_damage_prev = fbscreen->shadow_damage;
+    fbscreen->shadow_damage.x0 = 0;
+    fbscreen->shadow_damage.x1 = -1;
+    if (region.x0 > region.x1)
+        return;
+
+    start_ns = canvasstats_now_ns();
+    panel_region = fbscreen_rotate_rect(
+        &region, fbscreen->var_info.xres, fbscreen->var_info.yres, fbscreen->rotation
+    );
+    fbscreen_beam_wait(fbscreen, panel_region.y0, panel_region.y1);
+    fbscreen_rotate(
+        fbscreen->drawing_addrs[fbscreen->drawing_idx], fbscreen->shadow_mem,
+        fbscreen->var_info.xres, fbscreen->var_info.yres, fbscreen->rotation,
+        &panel_region, fbscreen->var_info.bits_per_pixel >> 3
+    );
+    canvasstats_sample(&canvasstats.rotate, canvasstats_now_ns() - start_ns);
+}
+
+/* panel is mounted rotated by 'rotation' degrees clockwise (0, 90, 180,
+ * 270), slave draws upright. Called right after screen init, picture
+ * already in framebuffer (warm start) is kept */
+int32_t fbscreen_init_rotation(
+    struct fbscreen *fbscreen,
+    const uint32_t rotation
+)
+{
+    struct fbscreen_rect region;
+    uint32_t xres;
+
+    assert(!(NULL == fbscreen || NULL == fbscreen->fb_mem || fbscreen->single_buffer ||
+        fbscreen->rotation || (rotation % 90) || (rotation >= 360)));
+    if (NULL == fbscreen || NULL == fbscreen->fb_mem || fbscreen->single_buffer ||
+        fbscreen->rotation || (rotation % 90) || (rotation >= 360))
+    {
+        return -1;
+    }
+    if (0 == rotation)
+        return 0;
+
+    if (0 != posix_memalign((void**)&fbscreen->shadow_mem, 64, fbscreen->drawing_mem_size))
+    {
+        fbscreen->shadow_mem = NULL;
+        return -1;
+    }
+    fbscreen->rotation = rotation;
+    if (180 != rotation)
+    {
+        xres = fbscreen->var_info.xres;
+        fbscreen->var_info.xres = fbscreen->var_info.yres;
+        fbscreen->var_info.yres = xres;
+    }
+
+    /* panel picture rotated back */
+    region.x0 = 0;
+    region.y0 = 0;
+    region.x1 = fbscreen->var_info.xres - 1;
+    region.y1 = fbscreen->var_info.yres - 1;
+    fbscreen_rotate(
+        fbscreen->shadow_mem, fbscreen->drawing_mem, fbscreen->panel_xres, fbscreen->panel_yres,
+        360 - rotation, &region, fbscreen->var_info.bits_per_pixel >> 3
+    );
+    fbscreen->drawing_mem = fbscreen->shadow_mem;
+    fbscreen->shadow_damage.x0 = fbscreen->shadow_damage_prev.x0 = 0;
+    fbscreen->shadow_damage.x1 = fbscreen->shadow_damage_prev.x1 = -1;
+    return 0;
+}
+
+/* frame was replaced outside primitives (snapshot), rotated frame gets
+ * it into both halves at next flushes */
+int32_t fbscreen_damage_frame(
+    struct fbscreen *fbscreen
+)
+{
+    assert(!(NULL == fbscreen));
+    if (NULL == fbscreen)
+        return -1;
+
+    fbscreen->shadow_damage.x0 = 0;
+    fbscreen->shadow_damage.y0 = 0;
+    fbscreen->shadow_damage.x1 = fbscreen->var_info.xres - 1;
+    fbscreen->shadow_damage.y1 = fbscreen->var_info.yres - 1;
+    fbscreen->shadow_damage_prev = fbscreen->shadow_damage;
+    return 0;
+}
+
+/* flip to drawn half at vertical blank and make it drawing base again */
+static int32_t fbscreen_present(
+    struct fbscreen *fbscreen
+)
+{
+    int32_t result = 0;
+    int32_t useless = 0;
+    uint64_t start_ns;
+
+    /* pan is latched at vertical blank (FB_ACTIVATE_VBL), so single
+     * wait below is enough, frame is presented once per refresh */
+
+    /* call ioctl to change/swap starting position on y-axis */
+    fbscreen->var_info.activate = FB_ACTIVATE_VBL;
+    fbscreen->var_info.yoffset = fbscreen->drawing_yoffsets[fbscreen->drawing_idx];
+    result = fbscreen_pan(fbscreen);
+    assert(!(result < 0));
+    if (result < 0) return -1;
+    CANVASTIMELINE_POINT(&fbscreen->timeline, CANVASTIMELINE_PAN);
+
+    /* calculate which half of memory is 'drawing' one.
+     * calculate address of 'drawing' memory */
+    uint32_t active_idx = fbscreen->drawing_idx;
+    fbscreen->drawing_idx = (fbscreen->drawing_idx + 1) & 0x1;
+    if (NULL == fbscreen->shadow_mem)
+        fbscreen->drawing_mem = fbscreen->drawing_addrs[fbscreen->drawing_idx];
+
+    /* wait for sync, old 'active' memory is not scanned anymore */
+    CANVASTIMELINE_POINT(&fbscreen->timeline, CANVASTIMELINE_VSYNC_WAIT);
+    start_ns = canvasstats_now_ns();
     result = ioctl(fbscreen->fb_fd, FBIO_WAITFORVSYNC, &useless);
     assert(!(result < 0));
     if (result < 0) return -1;
+    fbscreen->present_ns = canvasstats_now_ns();
+    fbscreen->dirty = 0;
+    canvasstats_sample(&canvasstats.vsync_wait, fbscreen->present_ns - start_ns);
+    if (CANVASTIMELINE_ENABLED())
+        canvastimeline_finish(&fbscreen->timeline);
+
+    /* rotated frame, damage of this frame is rotated into the
+     * other half at next flush instead */
+    if (NULL != fbscreen->shadow_mem)
+        return 0;
 
     /* copy data from 'active' to 'inactive' memory before
      * drawing API will modify 'inactive' memory.
      * Comment out this line to speedup a drawing in a cost of
      * different picture for each half of 'memory' */
+    start_ns = canvasstats_now_ns();
     memcpy(
         fbscreen->drawing_addrs[fbscreen->drawing_idx], 
         fbscreen->drawing_addrs[active_idx],
         fbscreen->drawing_mem_size
     );
+    canvasstats_sample(&canvasstats.flush_copy, canvasstats_now_ns() - start_ns);
+
+    return 0;
+}
+
+static void *fbscreen_present_thread(
+    void *arg
+)
+{
+    struct fbscreen *fbscreen = arg;
+    uint64_t count;
+    uint64_t one = 1;
+    ssize_t result;
+
+    for (;;)
+    {
+        result = read(fbscreen->present_request_fd, &count, sizeof(count));
+        if (!__atomic_load_n(&fbscreen->present_running, __ATOMIC_RELAXED))
+            break;
+        if (result != sizeof(count))
+            continue;
+        fbscreen->present_result = fbscreen_present(fbscreen);
+        result = write(fbscreen->present_done_fd, &one, sizeof(one));
+        (void)result;
+    }
+    return NULL;
+}
+
+/* flush returns right after flip is requested, completion is reported
+ * by 'present_done_fd' and fbscreen_present_done. Framebuffer only */
+int32_t fbscreen_init_presenter(
+    struct fbscreen *fbscreen
+)
+{
+    sigset_t sigset, sigset_old;
+    int32_t result;
+
+    assert(!(NULL == fbscreen || fbscreen->fb_fd < 0 || fbscreen->single_buffer));
+    if (NULL == fbscreen || fbscreen->fb_fd < 0 || fbscreen->single_buffer)
+        return -1;
+
+    fbscreen->present_request_fd = eventfd(0, EFD_CLOEXEC);
+    fbscreen->present_done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((fbscreen->present_request_fd < 0) || (fbscreen->present_done_fd < 0))
+    {
+        fbscreen_deinit_presenter(fbscreen);
+        return -1;
+    }
+
+    fbscreen->present_pending = 0;
+    fbscreen->present_running = 1;
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_BLOCK, &sigset, &sigset_old);
+    result = pthread_create(&fbscreen->present_thread, NULL, fbscreen_present_thread, fbscreen);
+    pthread_sigmask(SIG_SETMASK, &sigset_old, NULL);
+    if (0 != result)
+    {
+        fbscreen->present_running = 0;
+        fbscreen_deinit_presenter(fbscreen);
+        return -1;
+    }
+    return 0;
+}
+
+/* stop presenter, flip in flight is finished first */
+int32_t fbscreen_deinit_presenter(
+    struct fbscreen *fbscreen
+)
+{
+    uint64_t one = 1;
+    ssize_t result;
+
+    if (NULL == fbscreen)
+        return -1;
 
+    if (fbscreen->present_running)
+    {
+        __atomic_store_n(&fbscreen->present_running, 0, __ATOMIC_RELAXED);
+        result = write(fbscreen->present_request_fd, &one, sizeof(one));
+        (void)result;
+        pthread_join(fbscreen->present_thread, NULL);
+    }
+    if (fbscreen->present_request_fd >= 0)
+        close(fbscreen->present_request_fd);
+    if (fbscreen->present_done_fd >= 0)
+        close(fbscreen->present_done_fd);
+    fbscreen->present_request_fd = -1;
+    fbscreen->present_done_fd = -1;
+    fbscreen->present_pending = 0;
     return 0;
 }
+
+int32_t fbscreen_flush_drawing
+(
+    struct fbscreen *fbscreen
+)
+{
+    uint64_t start_ns;
+
+    assert(!(NULL == fbscreen));
+    if (NULL == fbscreen) return -1;
+
+    CANVASSTATS_ADD(canvasstats.frames, 1);
+
+    /* layers damaged since last flush make it to the frame */
+    fbscreen_composite(fbscreen);
+    if (NULL != fbscreen->shadow_mem)
+        fbscreen_rotate_damage(fbscreen);
+    CANVASTIMELINE_POINT(&fbscreen->timeline, CANVASTIMELINE_RASTER_END);
+
+    /* single buffer, everything drawn is already being scanned out */
+    if (fbscreen->single_buffer)
+    {
+        fbscreen->present_ns = canvasstats_now_ns();
+        fbscreen->dirty = 0;
+        if (CANVASTIMELINE_ENABLED())
+            canvastimeline_finish(&fbscreen->timeline);
+        return 0;
+    }
+
+    /* headless screen, only swap halves */
+    if (fbscreen->fb_fd < 0)
+    {
+        uint32_t active_idx = fbscreen->drawing_idx;
+        CANVASTIMELINE_POINT(&fbscreen->timeline, CANVASTIMELINE_PAN);
+        fbscreen->drawing_idx = (fbscreen->drawing_idx + 1) & 0x1;
+        if (NULL == fbscreen->shadow_mem)
+        {
+            fbscreen->drawing_mem = fbscreen->drawing_addrs[fbscreen->drawing_idx];
+            start_ns = canvasstats_now_ns();
+            memcpy(
+                fbscreen->drawing_addrs[fbscreen->drawing_idx],
+                fbscreen->drawing_addrs[active_idx],
+                fbscreen->drawing_mem_size
+            );
+            canvasstats_sample(&canvasstats.flush_copy, canvasstats_now_ns() - start_ns);
+        }
+        fbscreen->present_ns = canvasstats_now_ns();
+        fbscreen->dirty = 0;
+        if (CANVASTIMELINE_ENABLED())
+            canvastimeline_finish(&fbscreen->timeline);
+        return 0;
+    }
+
+    /* flip is waited for by presenter thread */
+    if (fbscreen->present_running)
+    {
+        uint64_t one = 1;
+
+        fbscreen->present_pending = 1;
+        if (sizeof(one) != write(fbscreen->present_request_fd, &one, sizeof(one)))
+        {
+            fbscreen->present_pending = 0;
+            return -1;
+        }
+        return 0;
+    }
+
+    return fbscreen_present(fbscreen);
+}
+
+/* test if presenting now would show frame at a refresh not used yet */
+int32_t fbscreen_present_due(
+    const struct fbscreen *fbscreen
+)
+{
+    assert(!(NULL == fbscreen));
+    if (NULL == fbscreen) return -1;
+
+    return (canvasstats_now_ns() - fbscreen->present_ns) >= fbscreen->frame_period_ns;
+}
+
+/* collect flip finished by presenter thread, returns 1 when it was,
+ * 0 when it is still in flight or none was requested */
+int32_t fbscreen_present_done(
+    struct fbscreen *fbscreen
+)
+{
+    uint64_t count;
+
+    assert(!(NULL == fbscreen));
+    if (NULL == fbscreen) return -1;
+
+    if (!fbscreen->present_pending)
+        return 0;
+    if (sizeof(count) != read(fbscreen->present_done_fd, &count, sizeof(count)))
+        return 0;
+
+    fbscreen->present_pending = 0;
+    return fbscreen->present_result < 0 ? -1 : 1;
+}
+
+/* single buffer mode, delay writes to rows 'ytop'..'ybottom' while the
+ * estimated beam scans them or is about to, so the touched region is not
+ * torn. Returns immediately in double buffer mode */
+int32_t fbscreen_beam_wait(
+    const struct fbscreen *fbscreen,
+    int32_t ytop,
+    int32_t ybottom
+)
+{
+    struct timespec delay;
+    uint64_t vsync_ns;
+    uint64_t now_ns;
+    int32_t line;
+
+    assert(!(NULL == fbscreen));
+    if (NULL == fbscreen) return -1;
+
+    if (!fbscreen->single_buffer)
+        return 0;
+
+    ytop = ytop < 0 ? 0 : ytop;
+    ybottom = ybottom >= (int32_t)fbscreen->panel_yres ? (int32_t)fbscreen->panel_yres - 1 : ybottom;
+    if (ytop > ybottom)
+        return 0;
+
+    now_ns = canvasstats_now_ns();
+    vsync_ns = __atomic_load_n(&fbscreen->vsync_ns, __ATOMIC_RELAXED);
+    line = ((now_ns - vsync_ns) % fbscreen->frame_period_ns) / fbscreen->line_ns;
+    line -= fbscreen->vblank_lines;
+
+    /* beam is below the region or far enough above it */
+    if ((line > ybottom) || (line + FBSCREEN_BEAM_GUARD_LINES < ytop))
+        return 0;
+
+    /* let it pass the region, next scan of it is a frame away */
+    delay.tv_sec = 0;
+    delay.tv_nsec = (uint64_t)(ybottom + 1 - line) * fbscreen->line_ns;
+    while (delay.tv_nsec >= 1000000000L)
+    {
+        delay.tv_sec++;
+        delay.tv_nsec -= 1000000000L;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, NULL);
+    return 1;
+}
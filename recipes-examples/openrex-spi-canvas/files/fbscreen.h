@@ -24,28 +24,53 @@
 #define __FBSCREEN_H__
 
 #include <stdint.h>
+#include <pthread.h>
 #include <linux/fb.h>
+#include "canvas_common.h"
+#include "canvasqoi.h"
+#include "canvasasset.h"
+#include "fbrect.h"
+#include "canvasscene.h"
+#include "canvastimeline.h"
 
-#ifndef CANVAS_RGBCOLOR
-#   define CANVAS_RGBCOLOR(r, g, b)        ((uint32_t)( (((uint8_t)(r)) << 16) | (((uint8_t)(g)) << 8) | (((uint8_t)(b))) ))
-#endif
-
-#ifndef CANVAS_RGBCOLOR_RED
-#   define CANVAS_RGBCOLOR_RED(color)      (((color) >> 16) & 0xFF)
-#endif
+/* refresh rate assumed when framebuffer does not report timings */
+#define FBSCREEN_REFRESH_HZ_DEFAULT     (60)
+/* lines beam advances while primitive is written, single buffer mode */
+#define FBSCREEN_BEAM_GUARD_LINES       (16)
+/* pixels of square block rotated at once, source and destination rows
+ * of block stay in cache */
+#define FBSCREEN_ROTATE_TILE            (32)
 
-#ifndef CANVAS_RGBCOLOR_GREEN
-#   define CANVAS_RGBCOLOR_GREEN(color)    (((color) >> 8) & 0xFF)
-#endif
+/* offscreen layer of frame size, 'damage' is changed since composite */
+struct fbscreen_layer {
+    uint8_t *mem;
+    /* CANVAS_LAYER_* flags */
+    uint32_t flags;
+    /* transparent pixel of layer which is not opaque */
+    uint32_t key_pixel;
+    struct fbscreen_rect damage;
+};
 
-#ifndef CANVAS_RGBCOLOR_BLUE
-#   define CANVAS_RGBCOLOR_BLUE(color)     ((color) & 0xFF)
-#endif
+/* strip chart as configured by slave */
+struct fbscreen_chart {
+    struct cmd_chart_config config;
+    /* row of newest drawn sample, line continues from it */
+    int32_t last_y;
+    uint32_t has_last;
+};
 
+/* compressed image being received */
+struct fbscreen_image {
+    struct canvasqoi qoi;
+    int32_t xpos;
+    int32_t ypos;
+    /* set by CANVAS_IMAGE_BEGIN, cleared on error */
+    uint32_t active;
+};
 
 /* framebuffers group */
 struct fbscreen {
-    /* famebuffer data */
+    /* famebuffer data, 'fb_fd' is negative for headless screen */
     int32_t fb_fd;
     uint8_t *fb_mem;
     uint32_t fb_mem_size;
@@ -59,26 +84,55 @@ struct fbscreen {
     /* precalculated data for mem swap */
     uint32_t drawing_yoffsets[2];
     uint8_t* drawing_addrs[2];
+    /* frame pacing, 'dirty' is set when something was drawn since present */
+    uint32_t dirty;
+    uint64_t frame_period_ns;
+    uint64_t present_ns;
+    /* single buffer mode, drawing goes straight to scanned out memory
+     * and writes are delayed while estimated beam is in touched rows */
+    uint32_t single_buffer;
+    uint64_t line_ns;
+    uint32_t vblank_lines;
+    uint64_t vsync_ns;
+    pthread_t vsync_thread;
+    uint32_t vsync_running;
+    /* asynchronous present, flip and copy are done by presenter thread
+     * while caller serves other screens, no drawing while pending */
+    int32_t present_request_fd;
+    int32_t present_done_fd;
+    uint32_t present_pending;
+    int32_t present_result;
+    pthread_t present_thread;
+    uint32_t present_running;
+    /* layers composited into drawing memory at flush, primitives go to
+     * 'layer_target' or straight to drawing memory (CANVAS_LAYER_DIRECT) */
+    struct fbscreen_layer layers[CANVAS_LAYER_COUNT];
+    uint32_t layer_target;
+    struct fbscreen_chart charts[CANVAS_CHART_COUNT];
+    /* entries in framebuffer pixel format */
+    uint32_t palette[CANVAS_PALETTE_SIZE];
+    struct fbscreen_image image;
+    /* asset pack of display, may be NULL */
+    const struct canvasasset *assets;
+    /* retained objects, repainted at flush by canvasscene_render */
+    struct canvasscene scene;
+    /* panel mounted rotated (clockwise degrees), 'var_info' has upright
+     * geometry and primitives go to 'shadow_mem', its damaged region is
+     * rotated into framebuffer at flush. Other half still lacks damage
+     * of previous frame, it is rotated too instead of copying halves */
+    uint32_t rotation;
+    uint8_t *shadow_mem;
+    uint32_t panel_xres;
+    uint32_t panel_yres;
+    struct fbscreen_rect shadow_damage;
+    struct fbscreen_rect shadow_damage_prev;
+    /* stages of frames while tracing, frame in flight is finished by
+     * whoever waits for its vsync */
+    struct canvastimeline timeline;
 };
 
-/* fbscreen circle */
-struct fbscreen_circle {
-    int32_t xpos;
-    int32_t ypos;
-    uint32_t color;
-    uint32_t in_centre;
-    uint32_t radius;
-};
-
-/* fbscreen rectangle */
-struct fbscreen_rectangle {
-    int32_t xpos;
-    int32_t ypos;
-    uint32_t color;
-    uint32_t in_centre;
-    uint32_t width;
-    uint32_t height;
-};
+/* primitives are described by wire structs of canvas_common.h,
+ * so commands are drawn straight from the receive buffer */
 
 int32_t fbscreen_init(
     struct fbscreen *fbscreen,
@@ -86,6 +140,40 @@ int32_t fbscreen_init(
     const uint8_t color_depth
 );
 
+int32_t fbscreen_init_warm(
+    struct fbscreen *fbscreen,
+    const char *fb_path,
+    const uint8_t color_depth
+);
+
+int32_t fbscreen_init_headless(
+    struct fbscreen *fbscreen,
+    const uint32_t xres,
+    const uint32_t yres,
+    const uint8_t color_depth
+);
+
+int32_t fbscreen_init_single_buffer(
+    struct fbscreen *fbscreen
+);
+
+int32_t fbscreen_init_rotation(
+    struct fbscreen *fbscreen,
+    const uint32_t rotation
+);
+
+int32_t fbscreen_damage_frame(
+    struct fbscreen *fbscreen
+);
+
+int32_t fbscreen_init_presenter(
+    struct fbscreen *fbscreen
+);
+
+int32_t fbscreen_deinit_presenter(
+    struct fbscreen *fbscreen
+);
+
 int32_t fbscreen_deinit(
     struct fbscreen *fbscreen
 );
@@ -105,18 +193,94 @@ int32_t fbscreen_get_pixel(
 );
 
 int32_t fbscreen_clear_screen(
-    const struct fbscreen *fbscreen,
+    struct fbscreen *fbscreen,
     const uint32_t color
 );
 
 int32_t fbscreen_draw_rectangle(
-    const struct fbscreen *fbscreen,
-    const struct fbscreen_rectangle *rectangle
+    struct fbscreen *fbscreen,
+    const struct cmd_rectangle *rectangle
 );
 
 int32_t fbscreen_draw_circle(
-    const struct fbscreen *fbscreen,
-    const struct fbscreen_circle *circle
+    struct fbscreen *fbscreen,
+    const struct cmd_circle *circle
+);
+
+int32_t fbscreen_rect_batch(
+    struct fbscreen *fbscreen,
+    const struct cmd_rect_batch *batch,
+    const struct cmd_batch_position *positions
+);
+
+int32_t fbscreen_circle_batch(
+    struct fbscreen *fbscreen,
+    const struct cmd_circle_batch *batch,
+    const struct cmd_batch_position *positions
+);
+
+int32_t fbscreen_copy_area(
+    struct fbscreen *fbscreen,
+    const struct cmd_copy_area *copy
+);
+
+int32_t fbscreen_put_pixels(
+    struct fbscreen *fbscreen,
+    const struct cmd_put_pixels *put,
+    const uint8_t *pixels
+);
+
+int32_t fbscreen_set_palette(
+    struct fbscreen *fbscreen,
+    const uint32_t first,
+    const uint32_t *colors,
+    uint32_t count
+);
+
+int32_t fbscreen_put_indexed(
+    struct fbscreen *fbscreen,
+    const struct cmd_put_indexed *put,
+    const uint8_t *indices
+);
+
+int32_t fbscreen_put_image(
+    struct fbscreen *fbscreen,
+    const struct cmd_put_image *put,
+    const uint8_t *data
+);
+
+int32_t fbscreen_draw_asset(
+    struct fbscreen *fbscreen,
+    const struct cmd_draw_asset *draw
+);
+
+int32_t fbscreen_asset_palette(
+    struct fbscreen *fbscreen,
+    const uint32_t id
+);
+
+int32_t fbscreen_chart_config(
+    struct fbscreen *fbscreen,
+    const struct cmd_chart_config *config
+);
+
+int32_t fbscreen_chart_push(
+    struct fbscreen *fbscreen,
+    const uint32_t chart_idx,
+    const int16_t *samples,
+    uint32_t count
+);
+
+int32_t fbscreen_set_layer(
+    struct fbscreen *fbscreen,
+    const uint32_t layer,
+    const uint32_t flags,
+    const uint32_t key_color
+);
+
+int32_t fbscreen_select_layer(
+    struct fbscreen *fbscreen,
+    const uint32_t layer
 );
 
 int32_t fbscreen_flush_drawing
@@ -124,4 +288,18 @@ int32_t fbscreen_flush_drawing
     struct fbscreen *fbscreen
 );
 
+int32_t fbscreen_present_due(
+    const struct fbscreen *fbscreen
+);
+
+int32_t fbscreen_present_done(
+    struct fbscreen *fbscreen
+);
+
+int32_t fbscreen_beam_wait(
+    const struct fbscreen *fbscreen,
+    int32_t ytop,
+    int32_t ybottom
+);
+
 #endif
@@ -26,12 +26,24 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/epoll.h>
 
 #include "config.h"
 #include "canvas_common.h"
 #include "spidevice.h"
 #include "fbscreen.h"
 #include "canvascmd.h"
+#include "canvastrace.h"
+#include "dataready.h"
+#include "canvaslink.h"
+#include "canvasstats.h"
+#include "canvasrt.h"
+#include "canvassnap.h"
+#include "canvasdisplay.h"
+#include "canvaslocal.h"
+#include "canvastimeline.h"
 
 
 /* app action to CLI */
@@ -45,13 +57,40 @@ enum app_action{
 /* application settings */
 #define PATH_SIZE 256
 struct app_settings {
-    char fb_path[PATH_SIZE + 1];
-    uint32_t baudrate;
     char tty_path[PATH_SIZE + 1];
-    char spidev_path[PATH_SIZE + 1];
     enum app_action action;
+    /* display described by single display options (-f, -s, ...) */
+    struct canvasdisplay_config display;
+    /* more displays, -D spec or -c config file */
+    struct canvasdisplay_config displays[CANVASDISPLAY_MAX];
+    uint32_t display_count;
+    /* local socket serving statistics */
+    char stats_path[PATH_SIZE + 1];
+    /* real-time profile */
+    uint32_t realtime;
+    struct canvasrt_thread rt_receive;
+    struct canvasrt_thread rt_render;
+    uint32_t lock_memory;
+    /* ftrace markers and frame timelines */
+    uint32_t timeline;
 };
 
+/* commands executed for one display before others are served */
+#define DAEMON_BATCH 64
+/* flips and queues of displays, sockets and queues of local clients */
+#define DAEMON_EVENTS (CANVASDISPLAY_MAX * (3 + 2 * CANVASLOCAL_CLIENTS))
+/* rounds without sleep before local sockets are checked anyway, client
+ * connecting or hanging up waits at most this many DAEMON_BATCH of slave
+ * and of local clients of every display */
+#define DAEMON_LOCAL_ROUNDS 4
+
+/* cleared by SIGINT/SIGTERM */
+static volatile sig_atomic_t daemon_running = 1;
+/* set by SIGUSR1 */
+static volatile sig_atomic_t stats_requested = 0;
+/* set by SIGUSR2 */
+static volatile sig_atomic_t timeline_requested = 0;
+
 /* parse CLI params */
 int32_t parse_opt(
     int argc,
@@ -60,29 +99,32 @@ int32_t parse_opt(
     struct app_settings *app_options
 )
 {
+    struct canvasdisplay_config *display;
     int long_index = 0;
     int opt;
+    int32_t count;
 
     assert(!(app_options == NULL));
     if (app_options == NULL) return -1;
+    display = &app_options->display;
 
     while (
-        (opt = getopt_long(argc, argv,"f:t:s:b:hix", long_options, &long_index )) != -1
+        (opt = getopt_long(argc, argv,"f:t:s:b:hixH:R:P:Fg:le:w:S:r:O:Lj:J:mTWk:A:C:D:c:", long_options, &long_index )) != -1
     )
     {
         switch (opt)
         {
             case 'f':
-                strncpy(app_options->fb_path, optarg, PATH_SIZE);
+                strncpy(display->fb_path, optarg, CANVASDISPLAY_PATH_SIZE);
             break;
             case 't':
                 strncpy(app_options->tty_path, optarg, PATH_SIZE);
             break;
             case 's':
-                strncpy(app_options->spidev_path, optarg, PATH_SIZE);
+                strncpy(display->spidev_path, optarg, CANVASDISPLAY_PATH_SIZE);
             break;
             case 'b':
-                app_options->baudrate = atoi(optarg);
+                display->baudrate = atoi(optarg);
             break;
             case 'h':
                 app_options->action = app_action_help;
@@ -93,6 +135,112 @@ int32_t parse_opt(
             case 'x':
                 app_options->action = app_action_demo;
             break;
+            case 'H':
+                if (2 != sscanf(optarg, "%ux%u", &display->headless_xres, &display->headless_yres))
+                {
+                    display->headless_xres = 0;
+                    display->headless_yres = 0;
+                }
+            break;
+            case 'R':
+                strncpy(display->record_path, optarg, CANVASDISPLAY_PATH_SIZE);
+            break;
+            case 'P':
+                strncpy(display->replay_path, optarg, CANVASDISPLAY_PATH_SIZE);
+            break;
+            case 'F':
+                display->replay_fast = 1;
+            break;
+            case 'g':
+            {
+                /* CHIP:LINE, e.g. /dev/gpiochip0:17 */
+                char *separator = strrchr(optarg, ':');
+                if (NULL != separator)
+                {
+                    *separator = '\0';
+                    strncpy(display->ready_chip_path, optarg, CANVASDISPLAY_PATH_SIZE);
+                    display->ready_line = atoi(separator + 1);
+                }
+            }
+            break;
+            case 'l':
+                display->ready_active_low = 1;
+            break;
+            case 'e':
+                display->ready_fd = atoi(optarg);
+            break;
+            case 'w':
+                display->idle_ms = atoi(optarg);
+            break;
+            case 'S':
+                strncpy(app_options->stats_path, optarg, PATH_SIZE);
+            break;
+            case 'r':
+                display->refresh_hz = atoi(optarg);
+            break;
+            case 'O':
+                display->rotation = atoi(optarg);
+                if ((display->rotation % 90) || (display->rotation >= 360))
+                {
+                    fprintf(stderr, "rotation must be 0, 90, 180 or 270\n");
+                    return -1;
+                }
+            break;
+            case 'L':
+                display->single_buffer = 1;
+            break;
+            case 'j':
+                canvasrt_parse(&app_options->rt_receive, optarg);
+                app_options->realtime = 1;
+            break;
+            case 'J':
+                canvasrt_parse(&app_options->rt_render, optarg);
+                app_options->realtime = 1;
+            break;
+            case 'm':
+                app_options->lock_memory = 1;
+            break;
+            case 'T':
+                app_options->timeline = 1;
+            break;
+            case 'W':
+                display->warm_start = 1;
+            break;
+            case 'k':
+                strncpy(display->snapshot_path, optarg, CANVASDISPLAY_PATH_SIZE);
+            break;
+            case 'A':
+                strncpy(display->asset_path, optarg, CANVASDISPLAY_PATH_SIZE);
+            break;
+            case 'C':
+                strncpy(display->local_path, optarg, CANVASDISPLAY_PATH_SIZE);
+            break;
+            case 'D':
+                if (app_options->display_count >= CANVASDISPLAY_MAX)
+                {
+                    fprintf(stderr, "more than %d displays\n", CANVASDISPLAY_MAX);
+                    return -1;
+                }
+                canvasdisplay_config_init(&app_options->displays[app_options->display_count]);
+                if (0 > canvasdisplay_parse(&app_options->displays[app_options->display_count], optarg))
+                {
+                    fprintf(stderr, "bad display spec '%s'\n", optarg);
+                    return -1;
+                }
+                app_options->display_count++;
+            break;
+            case 'c':
+                count = canvasdisplay_load(
+                    optarg, &app_options->displays[app_options->display_count],
+                    CANVASDISPLAY_MAX - app_options->display_count
+                );
+                if (0 > count)
+                {
+                    fprintf(stderr, "cannot load displays from '%s'\n", optarg);
+                    return -1;
+                }
+                app_options->display_count += count;
+            break;
         }
     }
 
@@ -120,35 +268,342 @@ int32_t disable_tty(
     return result < 0 ? -1 : 0;
 }
 
-/* daemon main loop */
-int32_t run_daemon(
-    struct fbscreen *fbscreen,
-    struct spidevice *spidevice,
-    struct canvascmd *commands
+/* stop daemon loop */
+void stop_daemon(
+    int signum
+)
+{
+    daemon_running = 0;
+}
+
+/* dump statistics from daemon loop */
+void request_stats(
+    int signum
+)
+{
+    stats_requested = 1;
+}
+
+/* dump frame timelines from daemon loop */
+void request_timeline(
+    int signum
+)
+{
+    timeline_requested = 1;
+}
+
+/* real-time profile, memory is locked once everything is allocated */
+int32_t setup_realtime(
+    const struct app_settings *settings,
+    struct canvasdisplay *displays,
+    const uint32_t count
+)
+{
+    int32_t result = 0;
+    uint32_t i;
+
+    assert(!(NULL == settings || NULL == displays));
+    if (NULL == settings || NULL == displays)
+        return -1;
+
+    if (settings->lock_memory)
+    {
+        if (0 > canvasrt_lock_memory())
+            result = -1;
+        /* framebuffer is device mapping, mlockall does not populate it */
+        for (i = 0; i < count; i++)
+        {
+            if (0 > canvasrt_prefault(displays[i].fbscreen.fb_mem, displays[i].fbscreen.fb_mem_size))
+                result = -1;
+        }
+    }
+    if (settings->realtime)
+    {
+        /* receive threads apply their own settings once started */
+        for (i = 0; i < count; i++)
+            displays[i].link.rt = &settings->rt_receive;
+        if (0 > canvasrt_apply(&settings->rt_render, "render"))
+            result = -1;
+    }
+    return result;
+}
+
+/* execute up to DAEMON_BATCH commands of display and as many of its local
+ * clients, returns number of executed commands or negative on error */
+int32_t serve_display(
+    struct canvasdisplay *display
 )
 {
-    uint8_t cmd_code;
+    struct canvasqueue_entry *entry;
     int32_t result;
+    int32_t count;
 
-    canvas_dbg("main loop started \n");
-    for (volatile int32_t loop = 1; loop;)
+    /* previous frame is not flipped yet, drawing memory is busy */
+    if (display->fbscreen.present_pending)
     {
-        result = spidevice_read(spidevice, &cmd_code, sizeof(cmd_code));
+        if (0 > fbscreen_present_done(&display->fbscreen))
+            return -1;
+        if (display->fbscreen.present_pending)
+            return 0;
+    }
+
+    for (count = 0; count < DAEMON_BATCH; count++)
+    {
+        entry = canvasqueue_peek(&display->link.commands, 0);
+        if (NULL == entry)
+        {
+            /* receive thread finished (stream exhausted, error), closing
+             * is published after last commit so second look is enough */
+            if (canvasqueue_is_closed(&display->link.commands) &&
+                (NULL == canvasqueue_peek(&display->link.commands, 0)))
+            {
+                display->active = 0;
+                canvastrace_replay_done(&display->trace);
+            }
+            break;
+        }
+        canvas_dbg("command code: 0x%x \n", entry->cmd_code);
+
+        canvaslink_frame(&display->link, entry, &display->frame);
+
+        canvas_dbg("executing\n");
+        result = canvascmd_exec(&display->fbscreen, &display->frame);
+        canvasqueue_release(&display->link.commands, entry);
         assert(!(result < 0));
         if (result < 0) return -1;
-        canvas_dbg("command code: 0x%x \n", cmd_code);
-        for (int i = 0; commands[i].cmd_code; i++ )
+
+        /* flip handed over to presenter thread */
+        if (display->fbscreen.present_pending)
+        {
+            count++;
+            break;
+        }
+    }
+    if (!display->fbscreen.present_pending)
+        count += canvaslocal_serve(&display->local, DAEMON_BATCH);
+
+    /* running animations get frame of every refresh from daemon, unless
+     * slave drew something it did not flush yet */
+    if (display->fbscreen.scene.animating && !display->fbscreen.dirty &&
+        !display->fbscreen.present_pending && (1 == fbscreen_present_due(&display->fbscreen)))
+    {
+        canvasscene_animate(&display->fbscreen, canvasstats_now_ns());
+        canvasscene_render(&display->fbscreen);
+        if (0 > fbscreen_flush_drawing(&display->fbscreen))
+            return -1;
+    }
+    return count;
+}
+
+/* ms until earliest frame of running animation is due, -1 when none */
+static int32_t animation_timeout(
+    const struct canvasdisplay *displays,
+    const uint32_t count
+)
+{
+    const struct fbscreen *fbscreen;
+    uint64_t now_ns = canvasstats_now_ns();
+    uint64_t wait_ns;
+    int32_t timeout = -1;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        fbscreen = &displays[i].fbscreen;
+        if (!displays[i].active || !fbscreen->scene.animating || fbscreen->dirty ||
+            fbscreen->present_pending)
         {
-            canvas_dbg("current code: 0x%x \n", commands[i].cmd_code);
-            if (commands[i].cmd_code == cmd_code)
+            continue;
+        }
+        wait_ns = now_ns - fbscreen->present_ns >= fbscreen->frame_period_ns ? 0 :
+            fbscreen->frame_period_ns - (now_ns - fbscreen->present_ns);
+        if ((timeout < 0) || ((wait_ns + 999999) / 1000000 < timeout))
+            timeout = (wait_ns + 999999) / 1000000;
+    }
+    return timeout;
+}
+
+/* accept and drop local clients of displays whose socket is 'ready' */
+static void poll_local(
+    struct canvasdisplay *displays,
+    const uint32_t count,
+    const struct epoll_event *events,
+    const int32_t ready
+)
+{
+    for (int32_t event_idx = 0; event_idx < ready; event_idx++)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (events[event_idx].data.ptr == &displays[i].local)
+                canvaslocal_poll(&displays[i].local);
+        }
+    }
+}
+
+/* daemon main loop, commands are received by 'canvaslink' thread of
+ * every display, single epoll wait covers all queues and flips */
+int32_t run_daemon(
+    struct canvasdisplay *displays,
+    const uint32_t count
+)
+{
+    struct epoll_event events[DAEMON_EVENTS];
+    struct epoll_event event = { .events = EPOLLIN };
+    struct canvasdisplay *display;
+    uint32_t active = 0;
+    uint32_t busy, sleep;
+    /* any local socket and rounds since it was last checked */
+    uint32_t local = 0, rounds = 0;
+    int32_t epoll_fd;
+    int32_t ready;
+    int32_t result = 0;
+    uint32_t i;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    assert(!(epoll_fd < 0));
+    if (epoll_fd < 0) return -1;
+
+    for (i = 0; i < count; i++)
+    {
+        display = &displays[i];
+
+        /* framebuffer flips of displays must not wait for each other */
+        if ((display->fbscreen.fb_fd >= 0) && !display->fbscreen.single_buffer)
+        {
+            result = fbscreen_init_presenter(&display->fbscreen);
+            assert(!(result < 0));
+            if (result < 0) break;
+            event.data.ptr = display;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, display->fbscreen.present_done_fd, &event);
+        }
+
+        result = canvaslink_start(&display->link);
+        assert(!(result < 0));
+        if (result < 0) break;
+        event.data.ptr = display;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, display->link.commands.data_fd, &event);
+        if (display->local.fd >= 0)
+        {
+            if (0 > canvaslocal_watch(&display->local, epoll_fd))
             {
-                canvas_dbg("executing\n");
-                result = commands[i].cmd_exec(fbscreen, spidevice);
-                assert(!(result < 0));
-                if (result < 0) return -1;
+                result = -1;
                 break;
             }
+            local = 1;
+        }
+        display->active = 1;
+        active++;
+    }
+
+    canvas_dbg("main loop started \n");
+    while (daemon_running && active && (result >= 0))
+    {
+        if (stats_requested)
+        {
+            stats_requested = 0;
+            canvasstats_dump(&canvasstats, stderr);
+        }
+        if (timeline_requested)
+        {
+            timeline_requested = 0;
+            for (i = 0; i < count; i++)
+                canvastimeline_dump(&displays[i].fbscreen.timeline, stderr);
+        }
+
+        /* round robin, busy display cannot starve others */
+        busy = 0;
+        for (i = 0; i < count; i++)
+        {
+            display = &displays[i];
+            if (!display->active)
+                continue;
+            result = serve_display(display);
+            if (result < 0) break;
+            if (!display->active)
+                active--;
+            else if (result >= DAEMON_BATCH)
+                busy = 1;
+        }
+        /* last display finished in this round, nothing would wake us */
+        if ((result < 0) || !active)
+            continue;
+
+        /* slave keeps loop from sleeping, local sockets are checked
+         * without waiting every DAEMON_LOCAL_ROUNDS */
+        if (local && (++rounds >= DAEMON_LOCAL_ROUNDS))
+        {
+            rounds = 0;
+            ready = epoll_wait(epoll_fd, events, DAEMON_EVENTS, 0);
+            poll_local(displays, count, events, ready);
         }
+        if (busy)
+            continue;
+
+        /* sleep until any queue gets data or any flip is done */
+        sleep = 1;
+        for (i = 0; i < count; i++)
+        {
+            display = &displays[i];
+            display->waiting = 0;
+            if (!display->active || display->fbscreen.present_pending)
+                continue;
+            display->waiting = canvasqueue_wait_begin(&display->link.commands);
+            if (!display->waiting)
+                sleep = 0;
+            if (!canvaslocal_wait_begin(&display->local))
+                sleep = 0;
+        }
+        if (sleep)
+        {
+            /* interrupted by signal, loop checks flags */
+            ready = epoll_wait(epoll_fd, events, DAEMON_EVENTS, animation_timeout(displays, count));
+            if ((0 > ready) && (EINTR != errno))
+                result = -1;
+            poll_local(displays, count, events, ready);
+            rounds = 0;
+        }
+        for (i = 0; i < count; i++)
+        {
+            if (displays[i].waiting)
+                canvasqueue_wait_end(&displays[i].link.commands);
+            displays[i].waiting = 0;
+            canvaslocal_wait_end(&displays[i].local);
+        }
+    }
+
+    /* stop receive threads, they report bus errors */
+    for (i = 0; i < count; i++)
+    {
+        if (0 > canvaslink_stop(&displays[i].link))
+            result = -1;
+        fbscreen_deinit_presenter(&displays[i].fbscreen);
+    }
+    close(epoll_fd);
+    return result < 0 ? -1 : 0;
+}
+
+/* print replay summary */
+int32_t print_replay(
+    const struct canvastrace *trace
+)
+{
+    double elapsed = canvastrace_elapsed_ns(trace) / 1e9;
+
+    assert(!(NULL == trace));
+    if (NULL == trace)
+        return -1;
+
+    printf("replayed %llu commands, %llu bytes in %.3f s\n",
+        (unsigned long long)trace->commands, (unsigned long long)trace->bytes, elapsed);
+    if (elapsed > 0)
+    {
+        printf("throughput %.0f cmd/s, %.3f MB/s\n",
+            trace->commands / elapsed, trace->bytes / elapsed / 1e6);
+    }
+    if (!trace->fast && trace->commands > 1)
+    {
+        printf("lateness avg %.1f us, max %.1f us\n",
+            trace->lateness_sum_ns / 1e3 / (trace->commands - 1), trace->lateness_max_ns / 1e3);
     }
     return 0;
 }
@@ -217,7 +672,7 @@ int32_t run_demo(
     fbscreen_flush_drawing(fbscreen);
     fbscreen_clear_screen(fbscreen, CANVAS_COLOR_GREEN);
     // rectangle
-    struct fbscreen_rectangle rectangle1 = {
+    struct cmd_rectangle rectangle1 = {
         .xpos = 0,
         .ypos = 60, //fbscreen->var_info.yres/2,
         .color = CANVAS_COLOR_RED,
@@ -225,7 +680,7 @@ int32_t run_demo(
         .height = 300,
         .in_centre = 0,
     };
-    struct fbscreen_rectangle rectangle2 = {
+    struct cmd_rectangle rectangle2 = {
         .xpos = 0,
         .ypos = 0, //fbscreen->var_info.yres/2,
         .color = CANVAS_COLOR_BLUE,
@@ -233,7 +688,7 @@ int32_t run_demo(
         .height = 300,
         .in_centre = 0,
     };
-    struct fbscreen_rectangle rectangle3 = {
+    struct cmd_rectangle rectangle3 = {
         .xpos = fbscreen->var_info.xres - 100,
         .ypos = 0, //fbscreen->var_info.yres/2,
         .color = CANVAS_COLOR_WHITE,
@@ -241,7 +696,7 @@ int32_t run_demo(
         .height = 100,
         .in_centre = 0,
     };
-    struct fbscreen_rectangle rectangle4 = {
+    struct cmd_rectangle rectangle4 = {
         .xpos = fbscreen->var_info.xres - 100,
         .ypos = fbscreen->var_info.yres - 100, //fbscreen->var_info.yres/2,
         .color = CANVAS_COLOR_BLACK,
@@ -289,6 +744,30 @@ int32_t print_help(void)
     printf("-b = baudrate speed \n");
     printf("-i print info \n");
     printf("-x run test demo \n");
+    printf("-H = draw into memory of WIDTHxHEIGHT instead of framebuffer \n");
+    printf("-R = record received command stream into trace file \n");
+    printf("-P = replay trace file instead of reading spidev \n");
+    printf("-F replay trace as fast as possible \n");
+    printf("-g = CHIP:LINE of slave data-ready gpio, e.g. /dev/gpiochip0:17 \n");
+    printf("-l data-ready gpio is active low \n");
+    printf("-e = inherited descriptor used as data-ready line (eventfd, pipe) \n");
+    printf("-w = idle bus poll period in ms when slave has no data \n");
+    printf("-r = display refresh rate in Hz used for frame pacing \n");
+    printf("-O = panel rotation, 90, 180 or 270 degrees clockwise, slave draws upright \n");
+    printf("-L low latency, draw into scanned out memory behind the beam \n");
+    printf("-j = PRIO[:CPU] SCHED_FIFO priority and cpu of receive thread \n");
+    printf("-J = PRIO[:CPU] SCHED_FIFO priority and cpu of render thread \n");
+    printf("-m lock memory and prefault framebuffer \n");
+    printf("-T trace frame stages into ftrace trace_marker, SIGUSR2 dumps frame timelines \n");
+    printf("-W warm start, keep mode and picture left by previous instance \n");
+    printf("-k = snapshot file restored at start and saved at exit \n");
+    printf("-A = asset pack of sprites and palettes in framebuffer format \n");
+    printf("-C = path of socket for local clients drawing into the screen (canvasclient.h) \n");
+    printf("-S = path of local socket serving statistics, SIGUSR1 dumps them to stderr \n");
+    printf("-D = another display, e.g. fb=/dev/fb1,spi=/dev/spidev1.0,baud=400000 \n");
+    printf("     items fb, headless, refresh, rotate, single-buffer, warm, snapshot, assets, spi, baud, \n");
+    printf("     record, replay, fast, gpio, active-low, ready-fd, idle, local \n");
+    printf("-c = file with one display spec (as -D) per line \n");
     return 0;
 }
 
@@ -301,34 +780,115 @@ static struct option long_options[] = {
     { "help", no_argument, 0, 'h' },
     { "info", no_argument, 0, 'i' },
     { "demo", no_argument, 0, 'x' },
+    { "headless", required_argument, 0, 'H' },
+    { "record", required_argument, 0, 'R' },
+    { "replay", required_argument, 0, 'P' },
+    { "replay-fast", no_argument, 0, 'F' },
+    { "ready-gpio", required_argument, 0, 'g' },
+    { "ready-active-low", no_argument, 0, 'l' },
+    { "ready-fd", required_argument, 0, 'e' },
+    { "idle-poll", required_argument, 0, 'w' },
+    { "stats-socket", required_argument, 0, 'S' },
+    { "refresh", required_argument, 0, 'r' },
+    { "rotate", required_argument, 0, 'O' },
+    { "single-buffer", no_argument, 0, 'L' },
+    { "rt-receive", required_argument, 0, 'j' },
+    { "rt-render", required_argument, 0, 'J' },
+    { "lock-memory", no_argument, 0, 'm' },
+    { "trace-frames", no_argument, 0, 'T' },
+    { "warm", no_argument, 0, 'W' },
+    { "snapshot", required_argument, 0, 'k' },
+    { "assets", required_argument, 0, 'A' },
+    { "local", required_argument, 0, 'C' },
+    { "display", required_argument, 0, 'D' },
+    { "config", required_argument, 0, 'c' },
     { 0 },
 };
 
 /* supported commands */
 struct canvascmd commands[] = {
-    { CANVAS_CMD_CLEAR, canvascmd_clear_screen },
-    { CANVAS_CMD_GETDIMENSION, canvascmd_get_dimension },
-    { CANVAS_CMD_RECTANGLE, canvascmd_draw_rectangle },
-    { CANVAS_CMD_CIRCLE, canvascmd_draw_circle },
-    { CANVAS_CMD_FLUSH_DRAWING, canvascmd_flush_drawing },
-    { CANVAS_CMD_DUMMY, canvascmd_do_nothing },
+    { CANVAS_CMD_CLEAR, canvascmd_clear_screen, sizeof(struct cmd_clearscreen), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_GETDIMENSION, canvascmd_get_dimension, 0, CANVASCMD_FLAG_QUERY },
+    { CANVAS_CMD_RECTANGLE, canvascmd_draw_rectangle, sizeof(struct cmd_rectangle), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_CIRCLE, canvascmd_draw_circle, sizeof(struct cmd_circle), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_GETCOLOR, canvascmd_get_color, sizeof(struct cmd_getcolor), CANVASCMD_FLAG_QUERY },
+    { CANVAS_CMD_FLUSH_DRAWING, canvascmd_flush_drawing, 0, 0 },
+    { CANVAS_CMD_GETCAPS, canvascmd_get_caps, 0, CANVASCMD_FLAG_QUERY },
+    { CANVAS_CMD_GETSTATS, canvascmd_get_stats, sizeof(struct cmd_getstats), CANVASCMD_FLAG_QUERY },
+    { CANVAS_CMD_LAYER_CONFIG, canvascmd_layer_config, sizeof(struct cmd_layer_config), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_LAYER_SELECT, canvascmd_layer_select, sizeof(struct cmd_layer_select), 0 },
+    { CANVAS_CMD_COPY_AREA, canvascmd_copy_area, sizeof(struct cmd_copy_area), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_CHART_CONFIG, canvascmd_chart_config, sizeof(struct cmd_chart_config), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_CHART_PUSH, canvascmd_chart_push, sizeof(struct cmd_chart_push), CANVASCMD_FLAG_DRAW,
+        canvascmd_chart_push_extra },
+    { CANVAS_CMD_PUT_PIXELS, canvascmd_put_pixels, sizeof(struct cmd_put_pixels), CANVASCMD_FLAG_DRAW,
+        canvascmd_put_pixels_extra },
+    { CANVAS_CMD_SET_PALETTE, canvascmd_set_palette, sizeof(struct cmd_set_palette), 0,
+        canvascmd_set_palette_extra },
+    { CANVAS_CMD_PUT_INDEXED, canvascmd_put_indexed, sizeof(struct cmd_put_indexed), CANVASCMD_FLAG_DRAW,
+        canvascmd_put_indexed_extra },
+    { CANVAS_CMD_PUT_IMAGE, canvascmd_put_image, sizeof(struct cmd_put_image), CANVASCMD_FLAG_DRAW,
+        canvascmd_put_image_extra },
+    { CANVAS_CMD_DRAW_ASSET, canvascmd_draw_asset, sizeof(struct cmd_draw_asset), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_ASSET_PALETTE, canvascmd_asset_palette, sizeof(struct cmd_asset_palette), 0 },
+    { CANVAS_CMD_SCENE_CONFIG, canvascmd_scene_config, sizeof(struct cmd_scene_config), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_SCENE_CREATE, canvascmd_scene_create, sizeof(struct cmd_scene_create), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_SCENE_UPDATE, canvascmd_scene_update, sizeof(struct cmd_scene_update), CANVASCMD_FLAG_DRAW, canvascmd_scene_update_extra },
+    { CANVAS_CMD_SCENE_TEXT, canvascmd_scene_text, sizeof(struct cmd_scene_text), CANVASCMD_FLAG_DRAW, canvascmd_scene_text_extra },
+    { CANVAS_CMD_SCENE_DELETE, canvascmd_scene_delete, sizeof(struct cmd_scene_delete), CANVASCMD_FLAG_DRAW },
+    { CANVAS_CMD_ANIMATE, canvascmd_animate, sizeof(struct cmd_animate), 0 },
+    { CANVAS_CMD_RECT_BATCH, canvascmd_rect_batch, sizeof(struct cmd_rect_batch), CANVASCMD_FLAG_DRAW, canvascmd_rect_batch_extra },
+    { CANVAS_CMD_CIRCLE_BATCH, canvascmd_circle_batch, sizeof(struct cmd_circle_batch), CANVASCMD_FLAG_DRAW, canvascmd_circle_batch_extra },
+    { CANVAS_CMD_DUMMY, canvascmd_do_nothing, 0, 0 },
 // other commands ...
 // and NULL terminated list of commands
     {0},
 };
 
 
-struct fbscreen fbscreen = {0};
-struct spidevice spidevice = {0};
+struct canvasdisplay displays[CANVASDISPLAY_MAX];
+struct canvasstats_server canvasstats_server = { .fd = -1 };
 
 
 int main(int argc, char **argv)
 {
-    struct app_settings settings = {0};
+    struct app_settings settings = {
+        .display = { .ready_fd = -1 },
+        .rt_receive = { .priority = 0, .cpu = -1 },
+        .rt_render = { .priority = 0, .cpu = -1 },
+    };
+    struct canvasdisplay_config configs[CANVASDISPLAY_MAX];
+    struct sigaction sigact = {0};
+    uint32_t count = 0;
+    uint32_t initialized = 0;
+    uint32_t save_snapshot = 0;
     int32_t result = 0;
+    uint32_t i;
 
     /* parse command line settings */
-    parse_opt(argc, argv, (void*)&long_options, &settings);
+    if (0 > parse_opt(argc, argv, (void*)&long_options, &settings))
+        return -1;
+
+    /* build command dispatch table */
+    canvascmd_init(commands);
+
+    /* single display options describe the first display, it is
+     * left out only when all displays come from -D or -c */
+    if (('\0' != settings.display.fb_path[0]) ||
+        (settings.display.headless_xres && settings.display.headless_yres) ||
+        (0 == settings.display_count))
+    {
+        configs[count++] = settings.display;
+    }
+    for (i = 0; i < settings.display_count; i++)
+    {
+        if (count >= CANVASDISPLAY_MAX)
+        {
+            fprintf(stderr, "more than %d displays\n", CANVASDISPLAY_MAX);
+            return -1;
+        }
+        configs[count++] = settings.displays[i];
+    }
 
     if ((app_action_help == settings.action) || (argc == 1))
     {
@@ -336,8 +896,21 @@ int main(int argc, char **argv)
     }
     else
     {
+        /* let daemon loop finish, trace must be flushed */
+        sigact.sa_handler = stop_daemon;
+        sigaction(SIGINT, &sigact, NULL);
+        sigaction(SIGTERM, &sigact, NULL);
+        sigact.sa_handler = request_stats;
+        sigaction(SIGUSR1, &sigact, NULL);
+        sigact.sa_handler = request_timeline;
+        sigaction(SIGUSR2, &sigact, NULL);
+
+        /* optional - pipeline tracing, before receive threads start */
+        if (settings.timeline && (0 == canvastimeline_enable()))
+            fprintf(stderr, "ftrace trace_marker is not writable, frame timelines only\n");
+
         /* optional - disable graphics tty */
-        if (NULL != settings.tty_path)
+        if ('\0' != settings.tty_path[0])
         {
             result = disable_tty(settings.tty_path);
             if (0 > result)
@@ -347,42 +920,56 @@ int main(int argc, char **argv)
             }
         }
 
-        /* initialize single framebuffer */
-        result = fbscreen_init(&fbscreen, settings.fb_path, 16);
-        if (0 > result)
+        /* screens and transports of all displays */
+        for (i = 0; i < count; i++)
         {
-            fprintf(stderr, "cannot initialize framebuffer '%s', error %d\n", settings.fb_path, result);
-            goto error1;
+            initialized = i + 1;
+            result = canvasdisplay_init(&displays[i], &configs[i]);
+            if (0 > result) goto error;
+            displays[i].fbscreen.timeline.id = i;
         }
 
-        /* initialize spi device */
-        result = spidevice_init(&spidevice, settings.spidev_path, settings.baudrate);
-        if (0 > result)
+        /* optional - serve statistics on local socket */
+        if ('\0' != settings.stats_path[0])
         {
-            fprintf(stderr, "cannot initialize spi device '%s', error %d\n", settings.spidev_path, result);
-            goto error2;
+            result = canvasstats_server_start(&canvasstats_server, settings.stats_path);
+            if (0 > result)
+            {
+                fprintf(stderr, "cannot create stats socket '%s', error %d\n", settings.stats_path, result);
+                goto error;
+            }
         }
 
-        /* perform action according CLI */
+        /* perform action according CLI, info and demo use first display */
         if (app_action_info == settings.action)
         {
-            print_info(&fbscreen);
+            print_info(&displays[0].fbscreen);
         }
         else if (app_action_demo == settings.action)
         {
-            run_demo(&fbscreen);
+            run_demo(&displays[0].fbscreen);
         }
         else
         {
-            run_daemon(&fbscreen, &spidevice, commands);
+            setup_realtime(&settings, displays, count);
+            result = run_daemon(displays, count);
+            for (i = 0; i < count; i++)
+            {
+                if ('\0' == displays[i].config.replay_path[0])
+                    continue;
+                if (count > 1)
+                    printf("display %u\n", i);
+                print_replay(&displays[i].trace);
+            }
+            save_snapshot = 1;
         }
 
-        error2:
-            spidevice_deinit(&spidevice);
-        error1:
-            fbscreen_deinit(&fbscreen);
+        canvasstats_server_stop(&canvasstats_server);
+        error:
+            for (i = 0; i < initialized; i++)
+                canvasdisplay_deinit(&displays[i], save_snapshot);
+            canvastimeline_disable();
     }
 
     return result;
 }
-
@@ -45,6 +45,24 @@ int32_t spidevice_init(
     if ((spidevice->fd = open(dev_path, O_RDWR)) < 0)
         return -1;
     spidevice->speed_hz = speed_hz;
+    spidevice->ops = NULL;
+    spidevice->priv = NULL;
+    return 0;
+}
+
+int32_t spidevice_init_ops(
+    struct spidevice *spidevice,
+    const struct spidevice_ops *ops,
+    void *priv
+)
+{
+    assert(!(NULL == spidevice || NULL == ops || NULL == ops->transfer));
+    if (NULL == spidevice || NULL == ops || NULL == ops->transfer)
+        return -1;
+    spidevice->fd = -1;
+    spidevice->speed_hz = 0;
+    spidevice->ops = ops;
+    spidevice->priv = priv;
     return 0;
 }
 
@@ -65,6 +83,8 @@ int32_t spidevice_transfer(
     const struct spi_ioc_transfer *message
 )
 {
+    int32_t result = 0;
+
     // check params
     assert(!(NULL == spidevice || NULL == message || message->bits_per_word != 8));
     if (NULL == spidevice || NULL == message || message->bits_per_word != 8)
@@ -74,9 +94,15 @@ int32_t spidevice_transfer(
     if (message->rx_buf == 0 && message->tx_buf == 0)
         return -1;
 
+    // alternative transport
+    if (NULL != spidevice->ops)
+    {
+        result = spidevice->ops->transfer(spidevice, message);
+        goto done;
+    }
+
     // clone message
     struct spi_ioc_transfer new_message = *message;
-    int32_t result;
     uint8_t tx_dummy = 0xFF, rx_dummy;
 
     // update baudrate and length
@@ -109,7 +135,17 @@ int32_t spidevice_transfer(
         if ((result = ioctl(spidevice->fd, SPI_IOC_MESSAGE(1), &new_message)) < 0)
             return result;
     }
-    return 0;
+    result = 0;
+
+done:
+    // let observer see received data
+    if ((result >= 0) && (NULL != spidevice->rx_hook) && (0 != message->rx_buf))
+    {
+        spidevice->rx_hook(
+            spidevice->rx_hook_priv, (const uint8_t*)(uintptr_t)message->rx_buf, message->len
+        );
+    }
+    return result;
 }
 
 int32_t spidevice_write(
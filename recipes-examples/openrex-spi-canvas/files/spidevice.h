@@ -33,9 +33,27 @@
 #include <linux/spi/spidev.h>
 #include <sys/types.h>
 
+/* returned by alternative transports once the stream is exhausted */
+#define SPIDEVICE_EOF (-2)
+
+struct spidevice;
+
+/* alternative transport (trace replay, ...), spidev is used when NULL */
+struct spidevice_ops {
+    int32_t (*transfer)(
+        const struct spidevice *spidevice,
+        const struct spi_ioc_transfer *message
+    );
+};
+
 struct spidevice {
     int32_t fd;
     uint32_t speed_hz;
+    const struct spidevice_ops *ops;
+    void *priv;
+    /* optional observer of received data (trace record) */
+    void (*rx_hook)(void *priv, const uint8_t *buffer, const size_t size);
+    void *rx_hook_priv;
 };
 
 int32_t spidevice_init(
@@ -44,6 +62,12 @@ int32_t spidevice_init(
     uint32_t speed_hz
 );
 
+int32_t spidevice_init_ops(
+    struct spidevice *spidevice,
+    const struct spidevice_ops *ops,
+    void *priv
+);
+
 int32_t spidevice_deinit(
     struct spidevice *spidevice
 );